@@ -32,9 +32,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <errno.h>
 #include <stdexcept>
-#include <set>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
 #include "nan.h"
 
 #ifdef _WIN32
@@ -55,10 +59,32 @@
   };
 #endif
 
+#ifndef _WIN32
+# include <sys/time.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <signal.h>
+# include <unistd.h>
+# define ZMQ_CAN_SHM 1
+#else
+# define ZMQ_CAN_SHM 0
+#endif
+#if defined(ZMQ_HAVE_SDT)
+# include <sys/sdt.h>
+#endif
+
 #define ZMQ_CAN_DISCONNECT (ZMQ_VERSION_MAJOR == 3 && ZMQ_VERSION_MINOR >= 2) || ZMQ_VERSION_MAJOR > 3
 #define ZMQ_CAN_UNBIND (ZMQ_VERSION_MAJOR == 3 && ZMQ_VERSION_MINOR >= 2) || ZMQ_VERSION_MAJOR > 3
 #define ZMQ_CAN_MONITOR (ZMQ_VERSION > 30201)
 #define ZMQ_CAN_SET_CTX (ZMQ_VERSION_MAJOR == 3 && ZMQ_VERSION_MINOR >= 2) || ZMQ_VERSION_MAJOR > 3
+// SERVER/CLIENT, RADIO/DISH and SCATTER/GATHER, from a libzmq built with
+// draft APIs; its pkg-config cflags define ZMQ_BUILD_DRAFT_API
+#if defined(ZMQ_BUILD_DRAFT_API) && defined(ZMQ_SERVER) && ZMQ_VERSION >= 40302
+# define ZMQ_CAN_THREADSAFE 1
+#else
+# define ZMQ_CAN_THREADSAFE 0
+#endif
 
 using namespace v8;
 using namespace node;
@@ -69,13 +95,165 @@ enum {
   , STATE_CLOSED
 };
 
+// what the first part of a message on a thread-safe socket stands for
+enum {
+    ADDRESS_NONE
+  , ADDRESS_ROUTING_ID    // SERVER, a routing id
+  , ADDRESS_GROUP         // RADIO and DISH, a group name
+};
+
 namespace zmq {
 
-  std::set<int> opts_int;
-  std::set<int> opts_uint32;
-  std::set<int> opts_int64;
-  std::set<int> opts_uint64;
-  std::set<int> opts_binary;
+  /*
+   * Socket option types, indexed by option id. The table is a constant
+   * so getsockopt/setsockopt resolve the type with a single load; the few
+   * options whose type changed between 2.x and 3.x and the 4.x security
+   * options are picked per libzmq version at compile time.
+   */
+
+  enum OptionType {
+      OPT_NONE
+    , OPT_INT
+    , OPT_UINT32
+    , OPT_INT64
+    , OPT_UINT64
+    , OPT_BINARY
+  };
+
+#if ZMQ_VERSION_MAJOR >= 3
+# define OPT_V3(v3, v2) v3
+#else
+# define OPT_V3(v3, v2) v2
+#endif
+#if ZMQ_VERSION_MAJOR >= 4
+# define OPT_V4(v4) v4
+#else
+# define OPT_V4(v4) OPT_NONE
+#endif
+
+  static const unsigned char opt_types[] = {
+      OPT_NONE                        // 0
+    , OPT_UINT64                      // 1 ZMQ_HWM
+    , OPT_NONE                        // 2
+    , OPT_INT64                       // 3 ZMQ_SWAP
+    , OPT_UINT64                      // 4 ZMQ_AFFINITY
+    , OPT_BINARY                      // 5 ZMQ_IDENTITY
+    , OPT_BINARY                      // 6 ZMQ_SUBSCRIBE
+    , OPT_BINARY                      // 7 ZMQ_UNSUBSCRIBE
+    , OPT_V3(OPT_INT, OPT_INT64)      // 8 ZMQ_RATE
+    , OPT_V3(OPT_INT, OPT_INT64)      // 9 ZMQ_RECOVERY_IVL
+    , OPT_INT64                       // 10 ZMQ_MCAST_LOOP
+    , OPT_V3(OPT_INT, OPT_UINT64)     // 11 ZMQ_SNDBUF
+    , OPT_V3(OPT_INT, OPT_UINT64)     // 12 ZMQ_RCVBUF
+    , OPT_V3(OPT_INT, OPT_INT64)      // 13 ZMQ_RCVMORE
+    , OPT_INT                         // 14 ZMQ_FD
+    , OPT_V3(OPT_INT, OPT_UINT32)     // 15 ZMQ_EVENTS
+    , OPT_INT                         // 16 ZMQ_TYPE
+    , OPT_INT                         // 17 ZMQ_LINGER
+    , OPT_INT                         // 18 ZMQ_RECONNECT_IVL
+    , OPT_INT                         // 19 ZMQ_BACKLOG
+    , OPT_INT64                       // 20 ZMQ_RECOVERY_IVL_MSEC
+    , OPT_INT                         // 21 ZMQ_RECONNECT_IVL_MAX
+    , OPT_INT64                       // 22 ZMQ_MAXMSGSIZE
+    , OPT_INT                         // 23 ZMQ_SNDHWM
+    , OPT_INT                         // 24 ZMQ_RCVHWM
+    , OPT_INT                         // 25 ZMQ_MULTICAST_HOPS
+    , OPT_NONE                        // 26
+    , OPT_INT                         // 27 ZMQ_RCVTIMEO
+    , OPT_INT                         // 28 ZMQ_SNDTIMEO
+    , OPT_INT                         // 29 ZMQ_RCVLABEL
+    , OPT_INT                         // 30 ZMQ_RCVCMD
+    , OPT_INT                         // 31 ZMQ_IPV4ONLY
+    , OPT_BINARY                      // 32 ZMQ_LAST_ENDPOINT
+    , OPT_INT                         // 33 ZMQ_ROUTER_MANDATORY
+    , OPT_INT                         // 34 ZMQ_TCP_KEEPALIVE
+    , OPT_INT                         // 35 ZMQ_TCP_KEEPALIVE_CNT
+    , OPT_INT                         // 36 ZMQ_TCP_KEEPALIVE_IDLE
+    , OPT_INT                         // 37 ZMQ_TCP_KEEPALIVE_INTVL
+    , OPT_BINARY                      // 38 ZMQ_TCP_ACCEPT_FILTER
+    , OPT_INT                         // 39 ZMQ_DELAY_ATTACH_ON_CONNECT
+    , OPT_INT                         // 40 ZMQ_XPUB_VERBOSE
+    , OPT_INT                         // 41 ZMQ_ROUTER_RAW
+    , OPT_INT                         // 42 ZMQ_IPV6
+    , OPT_V4(OPT_INT)                 // 43 ZMQ_MECHANISM
+    , OPT_V4(OPT_INT)                 // 44 ZMQ_PLAIN_SERVER
+    , OPT_V4(OPT_BINARY)              // 45 ZMQ_PLAIN_USERNAME
+    , OPT_V4(OPT_BINARY)              // 46 ZMQ_PLAIN_PASSWORD
+    , OPT_V4(OPT_INT)                 // 47 ZMQ_CURVE_SERVER
+    , OPT_V4(OPT_BINARY)              // 48 ZMQ_CURVE_PUBLICKEY
+    , OPT_V4(OPT_BINARY)              // 49 ZMQ_CURVE_SECRETKEY
+    , OPT_V4(OPT_BINARY)              // 50 ZMQ_CURVE_SERVERKEY
+    , OPT_V4(OPT_INT)                 // 51 ZMQ_PROBE_ROUTER
+    , OPT_NONE                        // 52
+    , OPT_NONE                        // 53
+    , OPT_NONE                        // 54
+    , OPT_V4(OPT_BINARY)              // 55 ZMQ_ZAP_DOMAIN
+    , OPT_NONE, OPT_NONE, OPT_NONE    // 56 - 58
+    , OPT_NONE, OPT_NONE, OPT_NONE    // 59 - 61
+    , OPT_NONE, OPT_NONE, OPT_NONE    // 62 - 64
+    , OPT_NONE                        // 65
+    , OPT_V4(OPT_INT)                 // 66 ZMQ_HANDSHAKE_IVL
+  };
+
+#undef OPT_V3
+#undef OPT_V4
+
+  static inline int OptionTypeOf(int64_t option) {
+    if (option < 0 || option >= (int64_t) sizeof(opt_types))
+      return OPT_NONE;
+    return opt_types[option];
+  }
+
+  /*
+   * Tracing. The hot paths fire USDT probes in the `zmq` provider where
+   * sys/sdt.h is available (see binding.gyp), for bpftrace or perf, and Node
+   * trace_events in the `zmq.io` category. Probes are nops until attached
+   * to and trace events cost a load and a branch while the category is off.
+   */
+
+#if defined(ZMQ_HAVE_SDT)
+# define ZMQ_PROBE1(name, a) DTRACE_PROBE1(zmq, name, a)
+# define ZMQ_PROBE2(name, a, b) DTRACE_PROBE2(zmq, name, a, b)
+# define ZMQ_PROBE3(name, a, b, c) DTRACE_PROBE3(zmq, name, a, b, c)
+#else
+# define ZMQ_PROBE1(name, a) do {} while (0)
+# define ZMQ_PROBE2(name, a, b) do {} while (0)
+# define ZMQ_PROBE3(name, a, b, c) do {} while (0)
+#endif
+
+#if NODE_MODULE_VERSION >= NODE_12_0_MODULE_VERSION && !defined(V8_USE_PERFETTO)
+  static const uint8_t *trace_io = NULL;
+
+  static void
+  InitTracing() {
+    v8::TracingController *controller = node::GetTracingController();
+    if (controller != NULL)
+      trace_io = controller->GetCategoryGroupEnabled("zmq.io");
+  }
+
+  static inline bool
+  Tracing() {
+    return trace_io != NULL && *trace_io != 0;
+  }
+
+  // phase 'B' begins a slice, 'E' ends it and 'I' marks an instant
+  static void
+  Trace(char phase, const char *name, const char *arg1 = NULL, uint64_t value1 = 0,
+        const char *arg2 = NULL, uint64_t value2 = 0) {
+    const char *names[2] = { arg1, arg2 };
+    const uint8_t types[2] = { 2, 2 };  // TRACE_VALUE_TYPE_UINT
+    const uint64_t values[2] = { value1, value2 };
+    int32_t count = arg2 != NULL ? 2 : arg1 != NULL ? 1 : 0;
+
+    node::GetTracingController()->AddTraceEvent(phase, trace_io, name, NULL, 0, 0,
+                                                count, names, types, values, NULL, 0);
+  }
+
+# define ZMQ_TRACE(phase, ...) do { if (Tracing()) Trace(phase, __VA_ARGS__); } while (0)
+#else
+  static inline void InitTracing() {}
+# define ZMQ_TRACE(phase, ...) do {} while (0)
+#endif
 
   class Socket;
 
@@ -91,14 +269,262 @@ namespace zmq {
       static Context *GetContext(const Nan::FunctionCallbackInfo<Value>&);
       void Close();
       static NAN_METHOD(Close);
+      struct CloseState;
+      static NAN_METHOD(CloseAsync);
+      static void UV_CloseAsync(uv_work_t* req);
+      static void UV_CloseAsyncAfter(uv_work_t* req);
+      static NAN_GETTER(GetSockets);
 #if ZMQ_CAN_SET_CTX
       static NAN_METHOD(GetOpt);
       static NAN_METHOD(SetOpt);
 #endif
 
       void* context_;
+      int32_t sockets_;  // open sockets, zmq_term would wait for them
+  };
+
+  /*
+   * Declarative receive filter, evaluated against the first part of every
+   * incoming message while it is still a zmq_msg_t, so rejected messages
+   * never become Buffers.
+   */
+
+  class MessageFilter {
+    public:
+      struct ByteRule {
+        size_t offset;
+        unsigned char value;
+        unsigned char mask;
+        bool negate;
+      };
+
+      inline MessageFilter() : min_size(0), max_size(static_cast<size_t>(-1)) {}
+
+      inline bool Accepts(const char *data, size_t size) const {
+        if (size < min_size || size > max_size)
+          return false;
+
+        for (size_t i = 0; i < bytes.size(); i++) {
+          const ByteRule &rule = bytes[i];
+          bool match = rule.offset < size &&
+            (static_cast<unsigned char>(data[rule.offset]) & rule.mask) == (rule.value & rule.mask);
+          if (match == rule.negate)
+            return false;
+        }
+
+        for (size_t i = 0; i < deny.size(); i++) {
+          if (HasPrefix(data, size, deny[i]))
+            return false;
+        }
+
+        if (allow.empty())
+          return true;
+
+        for (size_t i = 0; i < allow.size(); i++) {
+          if (HasPrefix(data, size, allow[i]))
+            return true;
+        }
+        return false;
+      }
+
+      size_t min_size;
+      size_t max_size;
+      std::vector<ByteRule> bytes;
+      std::vector<std::string> allow;
+      std::vector<std::string> deny;
+
+    private:
+      static inline bool HasPrefix(const char *data, size_t size, const std::string &prefix) {
+        return prefix.size() <= size && memcmp(data, prefix.data(), prefix.size()) == 0;
+      }
+  };
+
+  /*
+   * Token buckets pacing outgoing messages, see Socket::SetRate. A message
+   * takes one message token and a byte token per byte. Rates are per second
+   * and 0 leaves that bucket out. A message larger than the byte burst goes
+   * out once the bucket is full and leaves it in debt, so it is still paced.
+   * The observed rates are exponentially weighted over about a second.
+   */
+
+  class Pacer {
+    public:
+      inline Pacer(double msg_rate, double byte_rate, double msg_burst, double byte_burst)
+        : msg_rate(msg_rate), byte_rate(byte_rate), msg_burst(msg_burst), byte_burst(byte_burst),
+          msg_tokens(msg_burst), byte_tokens(byte_burst), last_(uv_hrtime()),
+          sent(0), sent_bytes(0), msg_sum(0), byte_sum(0), sum_at_(last_),
+          throttled(0), throttled_ns(0), throttled_since(0) {}
+
+      // nanoseconds until a message of `bytes` may be sent, 0 for right away
+      inline uint64_t Wait(size_t bytes) {
+        uint64_t now = uv_hrtime();
+        Refill(now);
+
+        double wait = 0;
+        if (msg_rate > 0 && msg_tokens < 1)
+          wait = (1 - msg_tokens) / msg_rate;
+
+        double need = std::min(static_cast<double>(bytes), byte_burst);
+        if (byte_rate > 0 && byte_tokens < need)
+          wait = std::max(wait, (need - byte_tokens) / byte_rate);
+
+        if (wait <= 0) {
+          if (throttled_since) {
+            throttled_ns += now - throttled_since;
+            throttled_since = 0;
+          }
+          return 0;
+        }
+
+        if (!throttled_since) {
+          throttled_since = now;
+          throttled++;
+        }
+        return static_cast<uint64_t>(ceil(wait * 1e9));
+      }
+
+      inline void Consume(size_t bytes) {
+        msg_tokens -= 1;
+        byte_tokens -= static_cast<double>(bytes);
+        sent++;
+        sent_bytes += bytes;
+
+        Decay(uv_hrtime());
+        msg_sum += 1;
+        byte_sum += static_cast<double>(bytes);
+      }
+
+      // current rates, per second
+      inline double MessageRate() { Decay(uv_hrtime()); return msg_sum; }
+      inline double ByteRate() { Decay(uv_hrtime()); return byte_sum; }
+
+      inline uint64_t ThrottledTime() {
+        return throttled_ns + (throttled_since ? uv_hrtime() - throttled_since : 0);
+      }
+
+      double msg_rate;
+      double byte_rate;
+      double msg_burst;
+      double byte_burst;
+      double msg_tokens;
+      double byte_tokens;
+      uint64_t last_;
+      uint64_t sent;
+      uint64_t sent_bytes;
+      double msg_sum;
+      double byte_sum;
+      uint64_t sum_at_;
+      uint64_t throttled;
+      uint64_t throttled_ns;
+      uint64_t throttled_since;
+
+    private:
+      inline void Refill(uint64_t now) {
+        double elapsed = static_cast<double>(now - last_) / 1e9;
+        last_ = now;
+        msg_tokens = std::min(msg_burst, msg_tokens + elapsed * msg_rate);
+        byte_tokens = std::min(byte_burst, byte_tokens + elapsed * byte_rate);
+      }
+
+      inline void Decay(uint64_t now) {
+        double factor = exp(-static_cast<double>(now - sum_at_) / 1e9);
+        sum_at_ = now;
+        msg_sum *= factor;
+        byte_sum *= factor;
+      }
+  };
+
+  /*
+   * Log-linear histogram of nanosecond durations in the spirit of
+   * HdrHistogram: every power of two is split into 16 buckets, so recorded
+   * values keep about 6% precision over the whole uint64_t range at a fixed
+   * 8KB of counters.
+   */
+
+  class LatencyHistogram {
+    public:
+      static const int SUB_BITS = 4;
+      static const int SUB_COUNT = 1 << SUB_BITS;
+      static const int BUCKETS = (64 - SUB_BITS) * SUB_COUNT + SUB_COUNT;
+
+      inline LatencyHistogram() { Reset(); }
+
+      inline void Reset() {
+        memset(counts_, 0, sizeof(counts_));
+        count = 0;
+        min = 0;
+        max = 0;
+        sum = 0;
+      }
+
+      inline void Record(uint64_t value) {
+        counts_[Index(value)]++;
+        if (count == 0 || value < min)
+          min = value;
+        if (value > max)
+          max = value;
+        sum += static_cast<double>(value);
+        count++;
+      }
+
+      // the highest value equivalent to the one at `percentile`
+      inline uint64_t Percentile(double percentile) const {
+        if (count == 0)
+          return 0;
+        uint64_t rank = static_cast<uint64_t>(ceil(percentile / 100 * count));
+        if (rank < 1)
+          rank = 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+          seen += counts_[i];
+          if (seen >= rank)
+            return std::min(Highest(i), max);
+        }
+        return max;
+      }
+
+      uint64_t count;
+      uint64_t min;
+      uint64_t max;
+      double sum;
+
+    private:
+      static inline int Index(uint64_t value) {
+        if (value < 2 * SUB_COUNT)
+          return static_cast<int>(value);
+        int msb = 0;
+        for (uint64_t v = value; v > 1; v >>= 1)
+          msb++;
+        int shift = msb - SUB_BITS;
+        return shift * SUB_COUNT + static_cast<int>(value >> shift);
+      }
+
+      static inline uint64_t Highest(int index) {
+        if (index < 2 * SUB_COUNT)
+          return static_cast<uint64_t>(index);
+        int shift = index / SUB_COUNT - 1;
+        uint64_t mantissa = static_cast<uint64_t>(index % SUB_COUNT + SUB_COUNT);
+        return (mantissa << shift) + ((static_cast<uint64_t>(1) << shift) - 1);
+      }
+
+      uint64_t counts_[BUCKETS];
   };
 
+  // wall clock time in microseconds, for timestamps compared across hosts
+  static inline int64_t
+  RealtimeMicros() {
+  #ifdef _WIN32
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    uint64_t t = (static_cast<uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+    return static_cast<int64_t>(t / 10) - 11644473600000000LL;
+  #else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+  #endif
+  }
+
   class Socket : public Nan::ObjectWrap {
     public:
       static NAN_MODULE_INIT(Initialize);
@@ -106,6 +532,7 @@ namespace zmq {
       void NotifyReadReady();
       void NotifySendReady();
       void CallbackIfReady();
+      void BusyPoll();
 
 #if ZMQ_CAN_MONITOR
       void MonitorEvent(uint16_t event_id, int32_t event_value, char *endpoint);
@@ -118,16 +545,51 @@ namespace zmq {
 
       static Socket* GetSocket(const Nan::FunctionCallbackInfo<Value>&);
       static NAN_GETTER(GetState);
+      static NAN_GETTER(GetConflated);
+      static NAN_GETTER(GetTraffic);
+      static NAN_GETTER(GetEndpoints);
 
       static NAN_GETTER(GetPending);
       static NAN_SETTER(SetPending);
 
+      static NAN_GETTER(GetDecode);
+      static NAN_SETTER(SetDecode);
+
+      static NAN_GETTER(GetBusyPoll);
+      static NAN_SETTER(SetBusyPoll);
+      static NAN_METHOD(BusyPollStats);
+
+      static NAN_METHOD(SetFilter);
+      static NAN_METHOD(FilterStats);
+      bool Filtered(zmq_msg_t *msg);
+
+      static NAN_METHOD(SetRate);
+      static NAN_METHOD(RateStats);
+
+      static NAN_GETTER(GetTimestamps);
+      static NAN_SETTER(SetTimestamps);
+      static NAN_GETTER(GetTimestampTrailer);
+      static NAN_SETTER(SetTimestampTrailer);
+      static NAN_METHOD(RecordHandling);
+      static NAN_METHOD(LatencyStats);
+      void InitHistograms();
+      bool TakeTrailer(zmq_msg_t *msg, size_t index);
+      bool ReadTrailer(zmq_msg_t *msg, Local<Array> result, size_t index);
+      int SendTrailer(int flags);
+      void SchedulePace(uint64_t wait);
+      static void UV_PaceCallback(uv_timer_t* handle, int status);
+
       template<typename T>
       Local<Value> GetSockOpt(int option);
       template<typename T>
       Local<Value> SetSockOpt(int option, Local<Value> wrappedValue);
       static NAN_METHOD(GetSockOpt);
       static NAN_METHOD(SetSockOpt);
+      Local<Value> GetOption(int option);
+      Local<Value> SetOption(int option, Local<Value> value);
+      static NAN_METHOD(Configure);
+      static NAN_GETTER(GetEvents);
+      static NAN_GETTER(GetMore);
 
       void _AttachToEventLoop();
       void _DetachFromEventLoop();
@@ -150,24 +612,68 @@ namespace zmq {
       static NAN_METHOD(UnbindSync);
 #endif
       static NAN_METHOD(Connect);
+      struct AttachState;
+      static void AttachMany(const Nan::FunctionCallbackInfo<Value>& info, bool bind);
+      static NAN_METHOD(BindMany);
+      static NAN_METHOD(ConnectMany);
+      static void UV_AttachManyAsync(uv_work_t* req);
+      static void UV_AttachManyAsyncAfter(uv_work_t* req);
 #if ZMQ_CAN_DISCONNECT
       static NAN_METHOD(Disconnect);
 #endif
+#if ZMQ_CAN_THREADSAFE
+      static NAN_METHOD(Join);
+      static NAN_METHOD(Leave);
+#endif
 
       class IncomingMessage;
+      int RecvPart(zmq_msg_t *msg);
+      int ReadMessage(Local<Array> result);
+      static Local<Value> DecodePart(zmq_msg_t *msg);
+      int CopyMessage(char *data, size_t length, size_t &offset,
+                      uint32_t *index, size_t slots, uint32_t &frames);
+      int ReceiveParts(std::vector<zmq_msg_t*> &parts);
+      inline bool HasHeld() { return held_ != NULL && !held_->empty(); }
       static NAN_METHOD(Recv);
       static NAN_METHOD(Readv);
+      static NAN_METHOD(ReadMany);
+      class ConflatedMessages;
+      int ConflateMessages(ConflatedMessages &messages, int64_t max);
+      static NAN_METHOD(ReadConflated);
+      static NAN_METHOD(RecvInto);
       class OutgoingMessage;
+      int SendBatch(Local<Array> batch, uint32_t &sent);
       static NAN_METHOD(Send);
       static NAN_METHOD(Sendv);
+      static NAN_METHOD(SendMany);
       void Close();
       static NAN_METHOD(Close);
 
+      // kept small and flat, processes run 100k+ sockets; rarely used
+      // features hang off pointers that stay NULL until first use
       Nan::Persistent<Object> context_;
+      Context *owner_;  // kept alive by context_
       void *socket_;
       bool pending_;
+      bool decode_;
+      bool timestamps_;
+      bool trailer_;
       uint8_t state_;
+      uint8_t addressing_;
       int32_t endpoints;
+      int64_t busy_poll_;
+      uint64_t spin_hits_;
+      uint64_t spin_misses_;
+      MessageFilter *filter_;
+      uint64_t filtered_;
+      uint64_t filtered_bytes_;
+      uint64_t conflated_;
+      uint64_t traffic_;
+      std::vector<zmq_msg_t*> *held_;
+      Pacer *pacer_;
+      uv_timer_t *pace_timer_;
+      struct Histograms;
+      Histograms *histograms_;
 #if ZMQ_CAN_MONITOR
       void *monitor_socket_;
       uv_timer_t *monitor_handle_;
@@ -182,10 +688,23 @@ namespace zmq {
       short PollForEvents();
       uv_poll_t *poll_handle_;
       static void UV_PollCallback(uv_poll_t* handle, int status, int events);
+#if ZMQ_CAN_THREADSAFE
+      // thread-safe sockets have no ZMQ_FD, uv watches this poller instead
+      void *poller_;
+      bool WatchThreadSafe(uv_os_sock_t *fd);
+      int SetAddress(zmq_msg_t *msg, Local<Value> address);
+#endif
+  };
+
+  struct Socket::Histograms {
+    LatencyHistogram dwell;
+    LatencyHistogram handler;
+    LatencyHistogram latency;
   };
 
   Nan::Persistent<String> send_callback_symbol;
   Nan::Persistent<String> read_callback_symbol;
+  Nan::Persistent<String> received_at_symbol;
 
 #if ZMQ_CAN_MONITOR
   Nan::Persistent<String> monitor_symbol;
@@ -209,159 +728,903 @@ namespace zmq {
     return Nan::Error(ErrorMessage());
   }
 
-
   /*
-   * Context methods.
+   * MessagePack codec.
+   *
+   * Packer writes JS values straight into caller provided memory, normally
+   * the data of a freshly sized zmq_msg_t. Without memory it only measures
+   * how many bytes the value needs, so the message can be sized exactly
+   * before writing. Unpacker turns received bytes back into JS values without
+   * an intermediate Buffer or string. Typed arrays other than Uint8Array use
+   * ext types 1 to 8 holding their raw bytes in host order, Dates use the
+   * timestamp ext type -1.
    */
 
-  NAN_MODULE_INIT(Context::Initialize) {
-    Nan::HandleScope scope;
-    Local<FunctionTemplate> t = Nan::New<FunctionTemplate>(New);
-    t->InstanceTemplate()->SetInternalFieldCount(1);
-
-    Nan::SetPrototypeMethod(t, "close", Close);
-#if ZMQ_CAN_SET_CTX
-    Nan::SetPrototypeMethod(t, "setOpt", SetOpt);
-    Nan::SetPrototypeMethod(t, "getOpt", GetOpt);
-#endif
+  static const int CODEC_MAX_DEPTH = 512;
 
-    Nan::Set(target, Nan::New("Context").ToLocalChecked(), Nan::GetFunction(t).ToLocalChecked());
+#if defined(V8_MAJOR_VERSION) && (V8_MAJOR_VERSION > 6 || (V8_MAJOR_VERSION == 6 && V8_MINOR_VERSION >= 9))
+  static inline size_t
+  Utf8Length(Local<String> str) {
+    return str->Utf8Length(v8::Isolate::GetCurrent());
   }
 
-
-  Context::~Context() {
-    Close();
+  static inline void
+  WriteUtf8(Local<String> str, char *data, size_t len) {
+    str->WriteUtf8(v8::Isolate::GetCurrent(), data, static_cast<int>(len), NULL, String::NO_NULL_TERMINATION);
   }
-
-  NAN_METHOD(Context::New) {
-    assert(info.IsConstructCall());
-    int io_threads = 1;
-    if (info.Length() == 1) {
-      if (!info[0]->IsNumber()) {
-        return Nan::ThrowTypeError("io_threads must be an integer");
-      }
-      io_threads = Nan::To<int>(info[0]).FromJust();
-      if (io_threads < 1) {
-        return Nan::ThrowRangeError("io_threads must be a positive number");
-      }
-    }
-    Context *context = new Context(io_threads);
-    context->Wrap(info.This());
-    info.GetReturnValue().Set(info.This());
+#else
+  static inline size_t
+  Utf8Length(Local<String> str) {
+    return str->Utf8Length();
   }
 
-  Context::Context(int io_threads) : Nan::ObjectWrap() {
-    context_ = zmq_init(io_threads);
-    if (!context_) throw std::runtime_error(ErrorMessage());
+  static inline void
+  WriteUtf8(Local<String> str, char *data, size_t len) {
+    str->WriteUtf8(data, static_cast<int>(len), NULL, String::NO_NULL_TERMINATION);
   }
+#endif
 
-  Context *
-  Context::GetContext(const Nan::FunctionCallbackInfo<Value>& info) {
-    return Nan::ObjectWrap::Unwrap<Context>(info.This());
-  }
+  class Packer {
+    public:
+      inline Packer(char *data, size_t capacity)
+        : data_(data), capacity_(capacity), size_(0), error_(NULL) {}
 
-  void
-  Context::Close() {
-    if (context_ != NULL) {
-      if (zmq_term(context_) < 0) throw std::runtime_error(ErrorMessage());
-      context_ = NULL;
-    }
-  }
+      inline bool Pack(Local<Value> value) {
+        return Pack(value, 0);
+      }
 
-  NAN_METHOD(Context::Close) {
-    GetContext(info)->Close();
-    return;
-  }
+      inline size_t size() const { return size_; }
+      inline const char *error() const { return error_; }
 
-#if ZMQ_CAN_SET_CTX
-  NAN_METHOD(Context::SetOpt) {
-    if (info.Length() != 2)
-      return Nan::ThrowError("Must pass an option and a value");
-    if (!info[0]->IsNumber() || !info[1]->IsNumber())
-      return Nan::ThrowTypeError("Arguments must be numbers");
-    int option = Nan::To<int32_t>(info[0]).FromJust();
-    int value = Nan::To<int32_t>(info[1]).FromJust();
+    private:
+      bool Pack(Local<Value> value, int depth);
 
-    Context *context = GetContext(info);
-    if (zmq_ctx_set(context->context_, option, value) < 0)
-      return Nan::ThrowError(ExceptionFromError());
-    return;
-  }
+      inline bool Fail(const char *error) {
+        error_ = error;
+        return false;
+      }
 
-  NAN_METHOD(Context::GetOpt) {
-    if (info.Length() != 1)
-      return Nan::ThrowError("Must pass an option");
-    if (!info[0]->IsNumber())
-      return Nan::ThrowTypeError("Option must be an integer");
-    int option = Nan::To<int32_t>(info[0]).FromJust();
+      inline char *Reserve(size_t len) {
+        char *at = data_ != NULL && size_ + len <= capacity_ ? data_ + size_ : NULL;
+        size_ += len;
+        return at;
+      }
 
-    Context *context = GetContext(info);
-    int value = zmq_ctx_get(context->context_, option);
-    info.GetReturnValue().Set(Nan::New<Integer>(value));
-  }
-#endif
-  /*
-   * Socket methods.
-   */
+      inline void Put(const void *bytes, size_t len) {
+        char *at = Reserve(len);
+        if (at != NULL)
+          memcpy(at, bytes, len);
+      }
 
-  NAN_MODULE_INIT(Socket::Initialize) {
-    Nan::HandleScope scope;
+      inline void PutByte(unsigned char byte) {
+        Put(&byte, 1);
+      }
 
-    Local<FunctionTemplate> t = Nan::New<FunctionTemplate>(New);
-    t->InstanceTemplate()->SetInternalFieldCount(1);
-    Nan::SetAccessor(t->InstanceTemplate(),
-      Nan::New("state").ToLocalChecked(), Socket::GetState);
-    Nan::SetAccessor(t->InstanceTemplate(),
-      Nan::New("pending").ToLocalChecked(), GetPending, SetPending);
+      inline void PutBigEndian(uint64_t value, int len) {
+        unsigned char bytes[8];
+        for (int i = len - 1; i >= 0; i--) {
+          bytes[i] = static_cast<unsigned char>(value & 0xff);
+          value >>= 8;
+        }
+        Put(bytes, len);
+      }
 
-    Nan::SetPrototypeMethod(t, "bind", Bind);
-    Nan::SetPrototypeMethod(t, "bindSync", BindSync);
-#if ZMQ_CAN_UNBIND
-    Nan::SetPrototypeMethod(t, "unbind", Unbind);
-    Nan::SetPrototypeMethod(t, "unbindSync", UnbindSync);
-#endif
-    Nan::SetPrototypeMethod(t, "connect", Connect);
-    Nan::SetPrototypeMethod(t, "getsockopt", GetSockOpt);
-    Nan::SetPrototypeMethod(t, "setsockopt", SetSockOpt);
-    Nan::SetPrototypeMethod(t, "ref", AttachToEventLoop);
-    Nan::SetPrototypeMethod(t, "unref", DetachFromEventLoop);
-    Nan::SetPrototypeMethod(t, "recv", Recv);
-    Nan::SetPrototypeMethod(t, "readv", Readv);
-    Nan::SetPrototypeMethod(t, "send", Send);
-    Nan::SetPrototypeMethod(t, "sendv", Sendv);
-    Nan::SetPrototypeMethod(t, "close", Close);
+      inline void PutHeader(unsigned char type, uint64_t value, int len) {
+        PutByte(type);
+        PutBigEndian(value, len);
+      }
 
-#if ZMQ_CAN_DISCONNECT
-    Nan::SetPrototypeMethod(t, "disconnect", Disconnect);
-#endif
+      // fixed (small) form when there is one, then the 8, 16 and 32 bit forms
+      inline void PutLength(size_t len, unsigned char fix, size_t fixmax,
+                            unsigned char b8, unsigned char b16, unsigned char b32) {
+        if (fix != 0 && len <= fixmax)
+          PutByte(static_cast<unsigned char>(fix | len));
+        else if (len < 0x100 && b8 != 0)
+          PutHeader(b8, len, 1);
+        else if (len < 0x10000)
+          PutHeader(b16, len, 2);
+        else
+          PutHeader(b32, len, 4);
+      }
 
-#if ZMQ_CAN_MONITOR
-    Nan::SetPrototypeMethod(t, "monitor", Monitor);
-    Nan::SetPrototypeMethod(t, "unmonitor", Unmonitor);
-    monitor_symbol.Reset(Nan::New("onMonitorEvent").ToLocalChecked());
-    monitor_error.Reset(Nan::New("onMonitorError").ToLocalChecked());
-#endif
+      void PackUnsigned(uint64_t value);
+      void PackSigned(int64_t value);
+      void PackDouble(double value);
+      void PackExt(int8_t type, const char *bytes, size_t len);
+      void PackDate(double ms);
 
-    Nan::Set(target, Nan::New("SocketBinding").ToLocalChecked(), Nan::GetFunction(t).ToLocalChecked());
+      char *data_;
+      size_t capacity_;
+      size_t size_;
+      const char *error_;
+  };
 
-    read_callback_symbol.Reset(Nan::New("onReadReady").ToLocalChecked());
-    send_callback_symbol.Reset(Nan::New("onSendReady").ToLocalChecked());
+  void
+  Packer::PackUnsigned(uint64_t value) {
+    if (value < 0x80)
+      PutByte(static_cast<unsigned char>(value));
+    else if (value < 0x100)
+      PutHeader(0xcc, value, 1);
+    else if (value < 0x10000)
+      PutHeader(0xcd, value, 2);
+    else if (value < 0x100000000ULL)
+      PutHeader(0xce, value, 4);
+    else
+      PutHeader(0xcf, value, 8);
   }
 
-  Socket::~Socket() {
-    Close();
+  void
+  Packer::PackSigned(int64_t value) {
+    if (value >= 0)
+      PackUnsigned(static_cast<uint64_t>(value));
+    else if (value >= -32)
+      PutByte(static_cast<unsigned char>(value));
+    else if (value >= -0x80)
+      PutHeader(0xd0, static_cast<uint64_t>(value), 1);
+    else if (value >= -0x8000)
+      PutHeader(0xd1, static_cast<uint64_t>(value), 2);
+    else if (value >= -0x80000000LL)
+      PutHeader(0xd2, static_cast<uint64_t>(value), 4);
+    else
+      PutHeader(0xd3, static_cast<uint64_t>(value), 8);
   }
 
-  NAN_METHOD(Socket::New) {
-    assert(info.IsConstructCall());
+  void
+  Packer::PackDouble(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    PutHeader(0xcb, bits, 8);
+  }
 
-    if (info.Length() != 2) {
-      return Nan::ThrowError("Must pass a context and a type to constructor");
+  void
+  Packer::PackExt(int8_t type, const char *bytes, size_t len) {
+    switch (len) {
+      case 1: PutByte(0xd4); break;
+      case 2: PutByte(0xd5); break;
+      case 4: PutByte(0xd6); break;
+      case 8: PutByte(0xd7); break;
+      case 16: PutByte(0xd8); break;
+      default: PutLength(len, 0, 0, 0xc7, 0xc8, 0xc9);
     }
+    PutByte(static_cast<unsigned char>(type));
+    Put(bytes, len);
+  }
 
-    Context *context = Nan::ObjectWrap::Unwrap<Context>(info[0].As<Object>());
+  void
+  Packer::PackDate(double ms) {
+    // Date values are whole milliseconds
+    int64_t time = static_cast<int64_t>(ms);
+    int64_t sec = time / 1000;
+    int64_t rem = time % 1000;
+    if (rem < 0) {
+      rem += 1000;
+      sec--;
+    }
+    uint32_t nsec = static_cast<uint32_t>(rem * 1000000);
 
-    if (!info[1]->IsNumber()) {
+    if (sec >= 0 && sec < 0x400000000LL) {  // 34 bits
+      uint64_t value = (static_cast<uint64_t>(nsec) << 34) | static_cast<uint64_t>(sec);
+      if (nsec == 0 && sec < 0x100000000LL) {
+        PutHeader(0xd6, 0xff, 1);
+        PutBigEndian(value, 4);
+      } else {
+        PutHeader(0xd7, 0xff, 1);
+        PutBigEndian(value, 8);
+      }
+    } else {
+      PutHeader(0xc7, 12, 1);
+      PutByte(0xff);
+      PutBigEndian(nsec, 4);
+      PutBigEndian(static_cast<uint64_t>(sec), 8);
+    }
+  }
+
+  bool
+  Packer::Pack(Local<Value> value, int depth) {
+    if (depth > CODEC_MAX_DEPTH)
+      return Fail("Value is nested too deeply");
+
+    if (value->IsNull() || value->IsUndefined()) {
+      PutByte(0xc0);
+    } else if (value->IsBoolean()) {
+      PutByte(value->IsTrue() ? 0xc3 : 0xc2);
+    } else if (value->IsInt32()) {
+      PackSigned(Nan::To<int32_t>(value).FromJust());
+    } else if (value->IsNumber()) {
+      double number = Nan::To<double>(value).FromJust();
+      if (number == floor(number) && number >= -9223372036854775808.0 && number < 0) {
+        PackSigned(static_cast<int64_t>(number));
+      } else if (number == floor(number) && number >= 0 && number < 18446744073709551616.0) {
+        PackUnsigned(static_cast<uint64_t>(number));
+      } else {
+        PackDouble(number);
+      }
+    } else if (value->IsString()) {
+      Local<String> str = value.As<String>();
+      size_t len = Utf8Length(str);
+      PutLength(len, 0xa0, 31, 0xd9, 0xda, 0xdb);
+      char *at = Reserve(len);
+      if (at != NULL)
+        WriteUtf8(str, at, len);
+#if NODE_MODULE_VERSION >= NODE_4_0_MODULE_VERSION
+    } else if (value->IsArrayBufferView() && !value->IsUint8Array()) {
+      int8_t type;
+      if (value->IsInt8Array()) type = 1;
+      else if (value->IsUint8ClampedArray()) type = 2;
+      else if (value->IsInt16Array()) type = 3;
+      else if (value->IsUint16Array()) type = 4;
+      else if (value->IsInt32Array()) type = 5;
+      else if (value->IsUint32Array()) type = 6;
+      else if (value->IsFloat32Array()) type = 7;
+      else if (value->IsFloat64Array()) type = 8;
+      else type = 0;  // DataView, sent as plain binary
+
+      Nan::TypedArrayContents<char> contents(value);
+      if (type == 0) {
+        PutLength(contents.length(), 0, 0, 0xc4, 0xc5, 0xc6);
+        Put(*contents, contents.length());
+      } else {
+        PackExt(type, *contents, contents.length());
+      }
+#endif
+    } else if (Buffer::HasInstance(value)) {
+      size_t len = Buffer::Length(value);
+      PutLength(len, 0, 0, 0xc4, 0xc5, 0xc6);
+      Put(Buffer::Data(value), len);
+    } else if (value->IsDate()) {
+      double ms = value.As<v8::Date>()->ValueOf();
+      if (ms != ms) {
+        PutByte(0xc0);  // invalid date
+      } else {
+        PackDate(ms);
+      }
+    } else if (value->IsArray()) {
+      Local<Array> array = value.As<Array>();
+      uint32_t len = array->Length();
+      PutLength(len, 0x90, 15, 0, 0xdc, 0xdd);
+      for (uint32_t i = 0; i < len; i++) {
+        Local<Value> element;
+        if (!Nan::Get(array, i).ToLocal(&element))
+          return Fail("Could not read an array element");
+        if (!Pack(element, depth + 1))
+          return false;
+      }
+    } else if (value->IsFunction() || value->IsSymbol()) {
+      return Fail("Cannot encode functions or symbols");
+    } else if (value->IsObject()) {
+      Local<Object> object = value.As<Object>();
+      Local<Array> keys;
+      if (!Nan::GetOwnPropertyNames(object).ToLocal(&keys))
+        return Fail("Could not list the properties of an object");
+
+      uint32_t len = keys->Length();
+      PutLength(len, 0x80, 15, 0, 0xde, 0xdf);
+      for (uint32_t i = 0; i < len; i++) {
+        Local<Value> key = Nan::Get(keys, i).ToLocalChecked();
+        Local<Value> property;
+        if (!Nan::Get(object, key).ToLocal(&property))
+          return Fail("Could not read an object property");
+
+        if (key->IsString()) {
+          Pack(key, depth + 1);
+        } else {
+          // integer keys are listed as numbers, they are sent as strings
+          Local<String> name;
+          if (!Nan::To<String>(key).ToLocal(&name))
+            return Fail("Could not read an object property");
+          Pack(name, depth + 1);
+        }
+        if (!Pack(property, depth + 1))
+          return false;
+      }
+    } else {
+      return Fail("Cannot encode a value of this type");
+    }
+
+    return true;
+  }
+
+  class Unpacker {
+    public:
+      inline Unpacker(const char *data, size_t size)
+        : data_(reinterpret_cast<const unsigned char *>(data)), size_(size), pos_(0), error_(NULL) {}
+
+      /*
+       * Decodes the single value the data holds. Returns an empty handle
+       * and sets error() when the data is malformed.
+       */
+      inline Local<Value> Unpack() {
+        Local<Value> value = Unpack(0);
+        if (!value.IsEmpty() && pos_ != size_) {
+          error_ = "Unexpected data after the encoded value";
+          return Local<Value>();
+        }
+        return value;
+      }
+
+      inline const char *error() const { return error_; }
+
+    private:
+      Local<Value> Unpack(int depth);
+      Local<Value> UnpackExt(int8_t type, size_t len);
+      Local<Value> UnpackArray(size_t len, int depth);
+      Local<Value> UnpackMap(size_t len, int depth);
+      MaybeLocal<String> UnpackKey(int depth);
+
+      inline Local<Value> Fail(const char *error) {
+        error_ = error;
+        return Local<Value>();
+      }
+
+      inline bool Need(size_t len) {
+        if (size_ - pos_ >= len)
+          return true;
+        error_ = "Encoded value is truncated";
+        return false;
+      }
+
+      inline uint64_t BigEndian(int len) {
+        uint64_t value = 0;
+        for (int i = 0; i < len; i++)
+          value = (value << 8) | data_[pos_++];
+        return value;
+      }
+
+      inline const char *Take(size_t len) {
+        const char *at = reinterpret_cast<const char *>(data_ + pos_);
+        pos_ += len;
+        return at;
+      }
+
+      const unsigned char *data_;
+      size_t size_;
+      size_t pos_;
+      const char *error_;
+  };
+
+  Local<Value>
+  Unpacker::Unpack(int depth) {
+    if (depth > CODEC_MAX_DEPTH)
+      return Fail("Encoded value is nested too deeply");
+    if (!Need(1))
+      return Local<Value>();
+
+    unsigned char type = data_[pos_++];
+    size_t len;
+
+    if (type < 0x80)
+      return Nan::New<Integer>(type);
+    if (type >= 0xe0)
+      return Nan::New<Integer>(static_cast<int8_t>(type));
+    if (type >= 0xa0 && type < 0xc0) {
+      len = type & 0x1f;
+      goto str;
+    }
+    if (type >= 0x90 && type < 0xa0)
+      return UnpackArray(type & 0x0f, depth);
+    if (type < 0x90)
+      return UnpackMap(type & 0x0f, depth);
+
+    switch (type) {
+      case 0xc0: return Nan::Null();
+      case 0xc2: return Nan::False();
+      case 0xc3: return Nan::True();
+
+      case 0xc4: case 0xc5: case 0xc6: {
+        int bytes = 1 << (type - 0xc4);
+        if (!Need(bytes))
+          return Local<Value>();
+        len = static_cast<size_t>(BigEndian(bytes));
+        if (!Need(len))
+          return Local<Value>();
+        return Nan::CopyBuffer(Take(len), static_cast<uint32_t>(len)).ToLocalChecked();
+      }
+
+      case 0xc7: case 0xc8: case 0xc9: {
+        int bytes = 1 << (type - 0xc7);
+        if (!Need(bytes + 1))
+          return Local<Value>();
+        len = static_cast<size_t>(BigEndian(bytes));
+        return UnpackExt(static_cast<int8_t>(data_[pos_++]), len);
+      }
+
+      case 0xca: {
+        if (!Need(4))
+          return Local<Value>();
+        uint32_t bits = static_cast<uint32_t>(BigEndian(4));
+        float number;
+        memcpy(&number, &bits, sizeof(number));
+        return Nan::New<Number>(number);
+      }
+
+      case 0xcb: {
+        if (!Need(8))
+          return Local<Value>();
+        uint64_t bits = BigEndian(8);
+        double number;
+        memcpy(&number, &bits, sizeof(number));
+        return Nan::New<Number>(number);
+      }
+
+      case 0xcc: case 0xcd: case 0xce: case 0xcf: {
+        int bytes = 1 << (type - 0xcc);
+        if (!Need(bytes))
+          return Local<Value>();
+        return Nan::New<Number>(static_cast<double>(BigEndian(bytes)));
+      }
+
+      case 0xd0: case 0xd1: case 0xd2: case 0xd3: {
+        int bytes = 1 << (type - 0xd0);
+        if (!Need(bytes))
+          return Local<Value>();
+        uint64_t bits = BigEndian(bytes);
+        int shift = 64 - 8 * bytes;  // sign extend
+        int64_t number = static_cast<int64_t>(bits << shift) >> shift;
+        return Nan::New<Number>(static_cast<double>(number));
+      }
+
+      case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8:
+        if (!Need(1))
+          return Local<Value>();
+        return UnpackExt(static_cast<int8_t>(data_[pos_++]), static_cast<size_t>(1) << (type - 0xd4));
+
+      case 0xd9: case 0xda: case 0xdb: {
+        int bytes = 1 << (type - 0xd9);
+        if (!Need(bytes))
+          return Local<Value>();
+        len = static_cast<size_t>(BigEndian(bytes));
+        goto str;
+      }
+
+      case 0xdc: case 0xdd: {
+        int bytes = type == 0xdc ? 2 : 4;
+        if (!Need(bytes))
+          return Local<Value>();
+        return UnpackArray(static_cast<size_t>(BigEndian(bytes)), depth);
+      }
+
+      case 0xde: case 0xdf: {
+        int bytes = type == 0xde ? 2 : 4;
+        if (!Need(bytes))
+          return Local<Value>();
+        return UnpackMap(static_cast<size_t>(BigEndian(bytes)), depth);
+      }
+
+      default:
+        return Fail("Invalid type in encoded value");
+    }
+
+  str:
+    if (!Need(len))
+      return Local<Value>();
+    if (len > 0x3fffffff)
+      return Fail("Encoded string is too long");
+
+    Local<String> str;
+    if (!Nan::New<String>(Take(len), static_cast<int>(len)).ToLocal(&str))
+      return Fail("Encoded string is too long");
+    return str;
+  }
+
+  Local<Value>
+  Unpacker::UnpackArray(size_t len, int depth) {
+    // every element takes at least one byte
+    if (!Need(len))
+      return Local<Value>();
+
+    Local<Array> array = Nan::New<Array>(static_cast<int>(len));
+    for (size_t i = 0; i < len; i++) {
+      Local<Value> element = Unpack(depth + 1);
+      if (element.IsEmpty())
+        return element;
+      Nan::Set(array, static_cast<uint32_t>(i), element);
+    }
+    return array;
+  }
+
+  Local<Value>
+  Unpacker::UnpackMap(size_t len, int depth) {
+    if (len > (size_ - pos_) / 2)
+      return Fail("Encoded value is truncated");
+
+    Local<Object> object = Nan::New<Object>();
+    for (size_t i = 0; i < len; i++) {
+      Local<String> name;
+      if (!UnpackKey(depth + 1).ToLocal(&name))
+        return Local<Value>();
+      Local<Value> value = Unpack(depth + 1);
+      if (value.IsEmpty())
+        return value;
+
+      // define rather than set, so a "__proto__" key stays a plain property
+#if NODE_MODULE_VERSION >= NODE_6_0_MODULE_VERSION
+      if (!object->CreateDataProperty(Nan::GetCurrentContext(), name, value).FromMaybe(false))
+        return Fail("Could not define a decoded property");
+#else
+      Nan::DefineOwnProperty(object, name, value);
+#endif
+    }
+    return object;
+  }
+
+  /*
+   * Short string keys are internalized. The same keys come back in every
+   * message, and V8 can then share them and reuse the objects' shapes.
+   */
+
+  MaybeLocal<String>
+  Unpacker::UnpackKey(int depth) {
+    if (!Need(1))
+      return MaybeLocal<String>();
+
+#if NODE_MODULE_VERSION >= NODE_4_0_MODULE_VERSION
+    unsigned char type = data_[pos_];
+    size_t len = 0;
+    if (type >= 0xa0 && type < 0xc0) {
+      len = type & 0x1f;
+      pos_ += 1;
+    } else if (type == 0xd9 && Need(2)) {
+      len = data_[pos_ + 1];
+      pos_ += 2;
+    } else {
+      type = 0;
+    }
+
+    if (type != 0) {
+      if (!Need(len))
+        return MaybeLocal<String>();
+      return String::NewFromUtf8(v8::Isolate::GetCurrent(), Take(len),
+        v8::NewStringType::kInternalized, static_cast<int>(len));
+    }
+#endif
+
+    Local<Value> key = Unpack(depth);
+    if (key.IsEmpty())
+      return MaybeLocal<String>();
+    MaybeLocal<String> name = Nan::To<String>(key);
+    if (name.IsEmpty())
+      error_ = "Invalid key in encoded map";
+    return name;
+  }
+
+  Local<Value>
+  Unpacker::UnpackExt(int8_t type, size_t len) {
+    if (!Need(len))
+      return Local<Value>();
+    const char *bytes = Take(len);
+
+    if (type == -1) {
+      double ms;
+      if (len == 4) {
+        pos_ -= 4;
+        ms = static_cast<double>(BigEndian(4)) * 1000;
+      } else if (len == 8) {
+        pos_ -= 8;
+        uint64_t value = BigEndian(8);
+        ms = static_cast<double>(value & 0x3ffffffffULL) * 1000 +
+          static_cast<double>(value >> 34) / 1000000;
+      } else if (len == 12) {
+        pos_ -= 12;
+        uint32_t nsec = static_cast<uint32_t>(BigEndian(4));
+        int64_t sec = static_cast<int64_t>(BigEndian(8));
+        ms = static_cast<double>(sec) * 1000 + static_cast<double>(nsec) / 1000000;
+      } else {
+        return Fail("Invalid encoded timestamp");
+      }
+      return Nan::New<v8::Date>(ms).ToLocalChecked();
+    }
+
+    Local<Object> buf = Nan::CopyBuffer(bytes, static_cast<uint32_t>(len)).ToLocalChecked();
+
+#if NODE_MODULE_VERSION >= NODE_4_0_MODULE_VERSION
+    static const size_t element_sizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+    if (type < 1 || type > 8)
+      return buf;  // unknown extension, hand over the raw bytes
+    if (len % element_sizes[type] != 0)
+      return Fail("Invalid encoded typed array");
+
+    Local<v8::Uint8Array> view = buf.As<v8::Uint8Array>();
+    Local<v8::ArrayBuffer> storage = view->Buffer();
+    size_t offset = view->ByteOffset();
+    size_t count = len / element_sizes[type];
+    if (offset % element_sizes[type] != 0)
+      return Fail("Could not align decoded typed array");
+
+    switch (type) {
+      case 1: return v8::Int8Array::New(storage, offset, count);
+      case 2: return v8::Uint8ClampedArray::New(storage, offset, count);
+      case 3: return v8::Int16Array::New(storage, offset, count);
+      case 4: return v8::Uint16Array::New(storage, offset, count);
+      case 5: return v8::Int32Array::New(storage, offset, count);
+      case 6: return v8::Uint32Array::New(storage, offset, count);
+      case 7: return v8::Float32Array::New(storage, offset, count);
+      default: return v8::Float64Array::New(storage, offset, count);
+    }
+#else
+    return buf;
+#endif
+  }
+
+
+  /*
+   * Context methods.
+   */
+
+  NAN_MODULE_INIT(Context::Initialize) {
+    Nan::HandleScope scope;
+    Local<FunctionTemplate> t = Nan::New<FunctionTemplate>(New);
+    t->InstanceTemplate()->SetInternalFieldCount(1);
+
+    Nan::SetPrototypeMethod(t, "close", Close);
+    Nan::SetPrototypeMethod(t, "closeAsync", CloseAsync);
+    Nan::SetAccessor(t->InstanceTemplate(),
+      Nan::New("sockets").ToLocalChecked(), GetSockets);
+#if ZMQ_CAN_SET_CTX
+    Nan::SetPrototypeMethod(t, "setOpt", SetOpt);
+    Nan::SetPrototypeMethod(t, "getOpt", GetOpt);
+#endif
+
+    Nan::Set(target, Nan::New("Context").ToLocalChecked(), Nan::GetFunction(t).ToLocalChecked());
+  }
+
+
+  Context::~Context() {
+    Close();
+  }
+
+  NAN_METHOD(Context::New) {
+    assert(info.IsConstructCall());
+    int io_threads = 1;
+    if (info.Length() == 1) {
+      if (!info[0]->IsNumber()) {
+        return Nan::ThrowTypeError("io_threads must be an integer");
+      }
+      io_threads = Nan::To<int>(info[0]).FromJust();
+      if (io_threads < 1) {
+        return Nan::ThrowRangeError("io_threads must be a positive number");
+      }
+    }
+    Context *context = new Context(io_threads);
+    context->Wrap(info.This());
+    info.GetReturnValue().Set(info.This());
+  }
+
+  Context::Context(int io_threads) : Nan::ObjectWrap() {
+    context_ = zmq_init(io_threads);
+    if (!context_) throw std::runtime_error(ErrorMessage());
+    sockets_ = 0;
+  }
+
+  Context *
+  Context::GetContext(const Nan::FunctionCallbackInfo<Value>& info) {
+    return Nan::ObjectWrap::Unwrap<Context>(info.This());
+  }
+
+  void
+  Context::Close() {
+    if (context_ != NULL) {
+      if (zmq_term(context_) < 0) throw std::runtime_error(ErrorMessage());
+      context_ = NULL;
+    }
+  }
+
+  NAN_METHOD(Context::Close) {
+    GetContext(info)->Close();
+    return;
+  }
+
+  NAN_GETTER(Context::GetSockets) {
+    Context* context = Nan::ObjectWrap::Unwrap<Context>(info.Holder());
+    info.GetReturnValue().Set(Nan::New<Integer>(context->sockets_));
+  }
+
+  /*
+   * zmq_term blocks until every socket is closed and its linger expired, so
+   * closeAsync(cb) runs it on the threadpool. The context takes no new
+   * sockets from the moment it is called. With sockets still open the
+   * threadpool thread would never come back, so that throws instead.
+   */
+
+  struct Context::CloseState {
+    CloseState(Context* context_, Local<Function> cb_) {
+      context_obj.Reset(context_->handle());
+      context = context_->context_;
+      cb.Reset(cb_);
+      error = 0;
+    }
+
+    ~CloseState() {
+      context_obj.Reset();
+      cb.Reset();
+    }
+
+    Nan::Persistent<Object> context_obj;
+    void* context;
+    Nan::Persistent<Function> cb;
+    int error;
+  };
+
+  NAN_METHOD(Context::CloseAsync) {
+    if (!info[0]->IsFunction())
+      return Nan::ThrowTypeError("Provided callback must be a function");
+
+    Context *context = GetContext(info);
+    if (context->context_ == NULL)
+      return Nan::ThrowError("Context is closed");
+    if (context->sockets_ > 0)
+      return Nan::ThrowError("Context still has open sockets");
+
+    CloseState* state = new CloseState(context, info[0].As<Function>());
+    context->context_ = NULL;
+
+    uv_work_t* req = new uv_work_t;
+    req->data = state;
+    uv_queue_work(uv_default_loop(),
+                  req,
+                  UV_CloseAsync,
+                  (uv_after_work_cb)UV_CloseAsyncAfter);
+  }
+
+  void Context::UV_CloseAsync(uv_work_t* req) {
+    CloseState* state = static_cast<CloseState*>(req->data);
+    while (zmq_term(state->context) < 0) {
+      if (zmq_errno() != EINTR) {
+        state->error = zmq_errno();
+        break;
+      }
+    }
+  }
+
+  void Context::UV_CloseAsyncAfter(uv_work_t* req) {
+    CloseState* state = static_cast<CloseState*>(req->data);
+    Nan::HandleScope scope;
+
+    Local<Value> argv[1];
+    if (state->error) {
+      argv[0] = Nan::Error(zmq_strerror(state->error));
+    } else {
+      argv[0] = Nan::Undefined();
+    }
+
+    Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(state->cb), 1, argv);
+
+    delete state;
+    delete req;
+  }
+
+#if ZMQ_CAN_SET_CTX
+  NAN_METHOD(Context::SetOpt) {
+    if (info.Length() != 2)
+      return Nan::ThrowError("Must pass an option and a value");
+    if (!info[0]->IsNumber() || !info[1]->IsNumber())
+      return Nan::ThrowTypeError("Arguments must be numbers");
+    int option = Nan::To<int32_t>(info[0]).FromJust();
+    int value = Nan::To<int32_t>(info[1]).FromJust();
+
+    Context *context = GetContext(info);
+    if (zmq_ctx_set(context->context_, option, value) < 0)
+      return Nan::ThrowError(ExceptionFromError());
+    return;
+  }
+
+  NAN_METHOD(Context::GetOpt) {
+    if (info.Length() != 1)
+      return Nan::ThrowError("Must pass an option");
+    if (!info[0]->IsNumber())
+      return Nan::ThrowTypeError("Option must be an integer");
+    int option = Nan::To<int32_t>(info[0]).FromJust();
+
+    Context *context = GetContext(info);
+    int value = zmq_ctx_get(context->context_, option);
+    info.GetReturnValue().Set(Nan::New<Integer>(value));
+  }
+#endif
+  /*
+   * Socket methods.
+   */
+
+  NAN_MODULE_INIT(Socket::Initialize) {
+    Nan::HandleScope scope;
+
+    Local<FunctionTemplate> t = Nan::New<FunctionTemplate>(New);
+    t->InstanceTemplate()->SetInternalFieldCount(1);
+    Nan::SetAccessor(t->InstanceTemplate(),
+      Nan::New("state").ToLocalChecked(), Socket::GetState);
+    Nan::SetAccessor(t->InstanceTemplate(),
+      Nan::New("conflated").ToLocalChecked(), GetConflated);
+    Nan::SetAccessor(t->InstanceTemplate(),
+      Nan::New("traffic").ToLocalChecked(), GetTraffic);
+    Nan::SetAccessor(t->InstanceTemplate(),
+      Nan::New("endpoints").ToLocalChecked(), GetEndpoints);
+    Nan::SetAccessor(t->InstanceTemplate(),
+      Nan::New("pending").ToLocalChecked(), GetPending, SetPending);
+    Nan::SetAccessor(t->InstanceTemplate(),
+      Nan::New("decode").ToLocalChecked(), GetDecode, SetDecode);
+    Nan::SetAccessor(t->InstanceTemplate(),
+      Nan::New("busyPoll").ToLocalChecked(), GetBusyPoll, SetBusyPoll);
+    Nan::SetAccessor(t->InstanceTemplate(),
+      Nan::New("timestamps").ToLocalChecked(), GetTimestamps, SetTimestamps);
+    Nan::SetAccessor(t->InstanceTemplate(),
+      Nan::New("timestampTrailer").ToLocalChecked(), GetTimestampTrailer, SetTimestampTrailer);
+    Nan::SetAccessor(t->InstanceTemplate(),
+      Nan::New("events").ToLocalChecked(), GetEvents);
+    Nan::SetAccessor(t->InstanceTemplate(),
+      Nan::New("more").ToLocalChecked(), GetMore);
+
+    Nan::SetPrototypeMethod(t, "bind", Bind);
+    Nan::SetPrototypeMethod(t, "bindSync", BindSync);
+#if ZMQ_CAN_UNBIND
+    Nan::SetPrototypeMethod(t, "unbind", Unbind);
+    Nan::SetPrototypeMethod(t, "unbindSync", UnbindSync);
+#endif
+    Nan::SetPrototypeMethod(t, "connect", Connect);
+    Nan::SetPrototypeMethod(t, "bindMany", BindMany);
+    Nan::SetPrototypeMethod(t, "connectMany", ConnectMany);
+    Nan::SetPrototypeMethod(t, "getsockopt", GetSockOpt);
+    Nan::SetPrototypeMethod(t, "setsockopt", SetSockOpt);
+    Nan::SetPrototypeMethod(t, "configure", Configure);
+    Nan::SetPrototypeMethod(t, "ref", AttachToEventLoop);
+    Nan::SetPrototypeMethod(t, "unref", DetachFromEventLoop);
+    Nan::SetPrototypeMethod(t, "recv", Recv);
+    Nan::SetPrototypeMethod(t, "readv", Readv);
+    Nan::SetPrototypeMethod(t, "readMany", ReadMany);
+    Nan::SetPrototypeMethod(t, "readConflated", ReadConflated);
+    Nan::SetPrototypeMethod(t, "recvInto", RecvInto);
+    Nan::SetPrototypeMethod(t, "setFilter", SetFilter);
+    Nan::SetPrototypeMethod(t, "filterStats", FilterStats);
+    Nan::SetPrototypeMethod(t, "setRate", SetRate);
+    Nan::SetPrototypeMethod(t, "rateStats", RateStats);
+    Nan::SetPrototypeMethod(t, "recordHandling", RecordHandling);
+    Nan::SetPrototypeMethod(t, "latencyStats", LatencyStats);
+    Nan::SetPrototypeMethod(t, "send", Send);
+    Nan::SetPrototypeMethod(t, "sendv", Sendv);
+    Nan::SetPrototypeMethod(t, "sendMany", SendMany);
+    Nan::SetPrototypeMethod(t, "close", Close);
+    Nan::SetPrototypeMethod(t, "busyPollStats", BusyPollStats);
+
+#if ZMQ_CAN_DISCONNECT
+    Nan::SetPrototypeMethod(t, "disconnect", Disconnect);
+#endif
+#if ZMQ_CAN_THREADSAFE
+    Nan::SetPrototypeMethod(t, "join", Join);
+    Nan::SetPrototypeMethod(t, "leave", Leave);
+#endif
+
+#if ZMQ_CAN_MONITOR
+    Nan::SetPrototypeMethod(t, "monitor", Monitor);
+    Nan::SetPrototypeMethod(t, "unmonitor", Unmonitor);
+    monitor_symbol.Reset(Nan::New("onMonitorEvent").ToLocalChecked());
+    monitor_error.Reset(Nan::New("onMonitorError").ToLocalChecked());
+#endif
+
+    Nan::Set(target, Nan::New("SocketBinding").ToLocalChecked(), Nan::GetFunction(t).ToLocalChecked());
+
+    read_callback_symbol.Reset(Nan::New("onReadReady").ToLocalChecked());
+    received_at_symbol.Reset(Nan::New("receivedAt").ToLocalChecked());
+    send_callback_symbol.Reset(Nan::New("onSendReady").ToLocalChecked());
+  }
+
+  Socket::~Socket() {
+    Close();
+    delete filter_;
+    delete pacer_;
+    delete histograms_;
+    delete held_;
+  }
+
+  NAN_METHOD(Socket::New) {
+    assert(info.IsConstructCall());
+
+    if (info.Length() != 2) {
+      return Nan::ThrowError("Must pass a context and a type to constructor");
+    }
+
+    Context *context = Nan::ObjectWrap::Unwrap<Context>(info[0].As<Object>());
+    if (context->context_ == NULL) {
+      return Nan::ThrowError("Context is closed");
+    }
+
+    if (!info[1]->IsNumber()) {
       return Nan::ThrowTypeError("Type must be an integer");
     }
 
@@ -374,6 +1637,23 @@ namespace zmq {
 
   short
   Socket::PollForEvents() {
+  #if ZMQ_CAN_THREADSAFE
+    if (poller_ != NULL) {
+      // waiting also consumes the wakeup uv saw on the poller's fd
+      zmq_poller_event_t event;
+      short wanted = pending_ ? ZMQ_POLLIN | ZMQ_POLLOUT : ZMQ_POLLIN;
+      if (zmq_poller_modify(poller_, socket_, wanted) < 0)
+        throw std::runtime_error(ErrorMessage());
+      while (zmq_poller_wait(poller_, &event, 0) < 0) {
+        if (zmq_errno() == EAGAIN)
+          return 0;
+        if (zmq_errno() != EINTR)
+          throw std::runtime_error(ErrorMessage());
+      }
+      return event.events & wanted;
+    }
+  #endif
+
     zmq_pollitem_t item = { socket_, 0, ZMQ_POLLIN, 0 };
     if (pending_)
       item.events |= ZMQ_POLLOUT;
@@ -411,13 +1691,88 @@ namespace zmq {
   void
   Socket::CallbackIfReady() {
     short events = PollForEvents();
+    ZMQ_PROBE2(ready, this, events);
 
     if ((events & ZMQ_POLLIN) != 0) {
+      ZMQ_TRACE('B', "flushReads");
       NotifyReadReady();
+      ZMQ_TRACE('E', "flushReads");
     }
 
-    if ((events & ZMQ_POLLOUT) != 0) {
-      NotifySendReady();
+    if ((events & ZMQ_POLLOUT) != 0) {
+      ZMQ_TRACE('B', "flushWrites");
+      NotifySendReady();
+      ZMQ_TRACE('E', "flushWrites");
+    }
+
+    if (busy_poll_ > 0) {
+      BusyPoll();
+    }
+  }
+
+  // however busy the socket stays, one wakeup spins this many windows at most
+  static const uint64_t BUSY_POLL_WINDOWS = 8;
+
+  /*
+   * Keeps spinning on ZMQ_EVENTS for up to busy_poll_ microseconds after a
+   * wakeup, handling whatever becomes ready without a round trip through the
+   * uv_poll_t watcher. Callbacks that drain the socket earn a fresh spin
+   * window, up to BUSY_POLL_WINDOWS in all so that a steady trickle can't
+   * keep the loop from other work. A reader that does not consume (paused or
+   * out of read budget) only gets the window it already had. A hit is work
+   * that showed up after the socket had gone idle, i.e. a saved wakeup.
+   */
+  void
+  Socket::BusyPoll() {
+    int events;
+    size_t events_size = sizeof(events);
+    bool handled = false;
+    bool idle = false;
+    uint64_t window = static_cast<uint64_t>(busy_poll_) * 1000;
+    uint64_t now = uv_hrtime();
+    uint64_t deadline = now + window;
+    uint64_t limit = now + window * BUSY_POLL_WINDOWS;
+
+    while (state_ == STATE_READY) {
+      if (zmq_getsockopt(socket_, ZMQ_EVENTS, &events, &events_size) < 0) {
+        if (zmq_errno() == EINTR)
+          continue;
+        return;
+      }
+
+      if (!pending_)
+        events &= ~ZMQ_POLLOUT;
+
+      if ((events & (ZMQ_POLLIN | ZMQ_POLLOUT)) != 0) {
+        if (idle)
+          spin_hits_++;
+        idle = false;
+        handled = true;
+
+        if ((events & ZMQ_POLLIN) != 0) {
+          NotifyReadReady();
+        }
+
+        if ((events & ZMQ_POLLOUT) != 0 && state_ == STATE_READY) {
+          NotifySendReady();
+        }
+
+        now = uv_hrtime();
+        if (now >= deadline || now >= limit)
+          return;
+      } else {
+        idle = true;
+        now = uv_hrtime();
+        if (now >= limit)
+          return;
+        if (handled) {
+          handled = false;
+          deadline = now + window;
+        } else if (now >= deadline) {
+          spin_misses_++;
+          return;
+        }
+      }
     }
   }
 
@@ -428,13 +1783,21 @@ namespace zmq {
       return;
     }
     Socket* s = static_cast<Socket*>(handle->data);
+    // a bind on the threadpool owns the socket, its callback flushes
+    if (s->state_ != STATE_READY)
+      return;
+    ZMQ_PROBE2(poll, s, events);
+    ZMQ_TRACE('B', "poll");
     s->CallbackIfReady();
+    ZMQ_TRACE('E', "poll");
   }
 
 #if ZMQ_CAN_MONITOR
   void
   Socket::MonitorEvent(uint16_t event_id, int32_t event_value, char *event_endpoint) {
     Nan::HandleScope scope;
+    ZMQ_PROBE3(monitor, this, event_id, event_value);
+    ZMQ_TRACE('I', "monitor", "event", event_id, "value", static_cast<uint32_t>(event_value));
 
     Local<Value> callback_v = Nan::Get(this->handle(), Nan::New(monitor_symbol)).ToLocalChecked();
     if (!callback_v->IsFunction()) {
@@ -501,122 +1864,682 @@ namespace zmq {
         event_id = *reinterpret_cast<uint16_t *>(data);
         event_value = *reinterpret_cast<uint32_t *>(data + 2);
 
-        zmq_msg_t msg2; /* 4.x has 2 messages per event */
+        zmq_msg_t msg2; /* 4.x has 2 messages per event */
+
+        // get our next frame it may have the target address and safely copy to our buffer
+        zmq_msg_init (&msg2);
+        if (zmq_msg_more(&msg1) == 0 || zmq_recvmsg (s->monitor_socket_, &msg2, 0) == -1) {
+          error = ErrorMessage();
+          zmq_msg_close(&msg2);
+          break;
+        }
+
+        // protect from overflow
+        size_t len = zmq_msg_size(&msg2);
+        // MIN message size and buffer size with null padding
+        len = len < sizeof(event_endpoint)-1 ? len : sizeof(event_endpoint)-1;
+        memcpy(event_endpoint, zmq_msg_data(&msg2), len);
+        zmq_msg_close(&msg2);
+
+        // null terminate our string
+        event_endpoint[len]=0;
+#else
+        // monitoring on zmq < 4 used zmq_event_t
+        zmq_event_t event;
+        memcpy (&event, zmq_msg_data (&msg1), sizeof (zmq_event_t));
+        event_id = event.event;
+
+        // Bit of a hack, but all events in the zmq_event_t union have the same layout so this will work for all event types.
+        event_value = event.data.connected.fd;
+        snprintf(event_endpoint, sizeof(event_endpoint), "%s", event.data.connected.addr);
+#endif
+
+        s->MonitorEvent(event_id, event_value, event_endpoint);
+        zmq_msg_close(&msg1);
+      }
+      else {
+        error = ErrorMessage();
+        zmq_msg_close(&msg1);
+        break;
+      }
+    }
+
+    // If there was no error and we still monitor we reset the monitor timer
+    if (error == NULL && s->monitor_handle_ != NULL) {
+      uv_timer_start(s->monitor_handle_, reinterpret_cast<uv_timer_cb>(Socket::UV_MonitorCallback), s->timer_interval_, 0);
+    }
+    // If error raise the monitor error event and stop the monitor
+    else if (error != NULL) {
+      s->Unmonitor();
+      s->MonitorError(error);
+    }
+  }
+#endif
+
+  Socket::Socket(Context *context, int type) : Nan::ObjectWrap() {
+    context_.Reset(context->handle());
+    owner_ = context;
+    socket_ = zmq_socket(context->context_, type);
+    if (socket_ != NULL)
+      owner_->sockets_++;
+    pending_ = false;
+    decode_ = false;
+    state_ = STATE_READY;
+    busy_poll_ = 0;
+    spin_hits_ = 0;
+    spin_misses_ = 0;
+    filter_ = NULL;
+    filtered_ = 0;
+    filtered_bytes_ = 0;
+    conflated_ = 0;
+    traffic_ = 0;
+    held_ = NULL;
+    pacer_ = NULL;
+    pace_timer_ = NULL;
+    timestamps_ = false;
+    trailer_ = false;
+    histograms_ = NULL;
+    addressing_ = ADDRESS_NONE;
+  #if ZMQ_CAN_THREADSAFE
+    poller_ = NULL;
+    if (type == ZMQ_SERVER)
+      addressing_ = ADDRESS_ROUTING_ID;
+    else if (type == ZMQ_RADIO || type == ZMQ_DISH)
+      addressing_ = ADDRESS_GROUP;
+  #endif
+
+    if (NULL == socket_) {
+      Nan::ThrowError(ErrorMessage());
+      return;
+    }
+
+    endpoints = 0;
+
+    poll_handle_ = new uv_poll_t;
+
+    poll_handle_->data = this;
+
+    uv_os_sock_t socket;
+    size_t len = sizeof(uv_os_sock_t);
+
+    if (zmq_getsockopt(socket_, ZMQ_FD, &socket, &len)) {
+    #if ZMQ_CAN_THREADSAFE
+      if (zmq_errno() != EINVAL || !WatchThreadSafe(&socket))
+    #endif
+      throw std::runtime_error(ErrorMessage());
+    }
+
+    #if ZMQ_CAN_MONITOR
+      this->monitor_socket_ = NULL;
+    #endif
+
+    uv_poll_init_socket(uv_default_loop(), poll_handle_, socket);
+    uv_poll_start(poll_handle_, UV_READABLE, Socket::UV_PollCallback);
+  }
+
+#if ZMQ_CAN_THREADSAFE
+  /*
+   * A thread-safe socket signals a poller's fd instead of its own. That fd
+   * stays readable until PollForEvents() waits on the poller, so unlike
+   * ZMQ_FD it is level-triggered. Returns false with zmq_errno() set.
+   */
+
+  bool
+  Socket::WatchThreadSafe(uv_os_sock_t *fd) {
+    poller_ = zmq_poller_new();
+    if (poller_ == NULL)
+      return false;
+
+    zmq_fd_t poller_fd;
+    if (zmq_poller_add(poller_, socket_, NULL, ZMQ_POLLIN) < 0
+        || zmq_poller_fd(poller_, &poller_fd) < 0) {
+      int err = zmq_errno();
+      zmq_poller_destroy(&poller_);
+      errno = err;
+      return false;
+    }
+    *fd = poller_fd;
+    return true;
+  }
+#endif
+
+  Socket *
+  Socket::GetSocket(const Nan::FunctionCallbackInfo<Value> &info) {
+    return Nan::ObjectWrap::Unwrap<Socket>(info.This());
+  }
+
+  /*
+   * This macro makes a call to GetSocket and checks the socket state. These two
+   * things go hand in hand everywhere in our code.
+   */
+  #define GET_SOCKET(info)                                      \
+      Socket* socket = GetSocket(info);                         \
+      if (socket->state_ == STATE_CLOSED)                       \
+          return Nan::ThrowTypeError("Socket is closed");       \
+      if (socket->state_ == STATE_BUSY)                         \
+          return Nan::ThrowTypeError("Socket is busy");
+
+  NAN_GETTER(Socket::GetState) {
+    Socket* socket = Nan::ObjectWrap::Unwrap<Socket>(info.Holder());
+    info.GetReturnValue().Set(Nan::New<Integer>(socket->state_));
+  }
+
+  // messages dropped by readConflated() because a newer one replaced them
+  NAN_GETTER(Socket::GetConflated) {
+    Socket* socket = Nan::ObjectWrap::Unwrap<Socket>(info.Holder());
+    info.GetReturnValue().Set(Nan::New<Number>(static_cast<double>(socket->conflated_)));
+  }
+
+  // bytes sent and received, sampled for the I/O thread load report
+  NAN_GETTER(Socket::GetTraffic) {
+    Socket* socket = Nan::ObjectWrap::Unwrap<Socket>(info.Holder());
+    info.GetReturnValue().Set(Nan::New<Number>(static_cast<double>(socket->traffic_)));
+  }
+
+  // bound and connected endpoints, the socket is referenced while any exist
+  NAN_GETTER(Socket::GetEndpoints) {
+    Socket* socket = Nan::ObjectWrap::Unwrap<Socket>(info.Holder());
+    info.GetReturnValue().Set(Nan::New<Integer>(socket->endpoints));
+  }
+
+  NAN_GETTER(Socket::GetPending) {
+    Socket* socket = Nan::ObjectWrap::Unwrap<Socket>(info.Holder());
+    info.GetReturnValue().Set(socket->pending_);
+  }
+
+  NAN_SETTER(Socket::SetPending) {
+    if (!value->IsBoolean())
+      return Nan::ThrowTypeError("Pending must be a boolean");
+
+    Socket* socket = Nan::ObjectWrap::Unwrap<Socket>(info.Holder());
+    socket->pending_ = Nan::To<bool>(value).FromJust();
+  }
+
+  NAN_GETTER(Socket::GetDecode) {
+    Socket* socket = Nan::ObjectWrap::Unwrap<Socket>(info.Holder());
+    info.GetReturnValue().Set(socket->decode_);
+  }
+
+  NAN_SETTER(Socket::SetDecode) {
+    if (!value->IsBoolean())
+      return Nan::ThrowTypeError("Decode must be a boolean");
+
+    Socket* socket = Nan::ObjectWrap::Unwrap<Socket>(info.Holder());
+    socket->decode_ = Nan::To<bool>(value).FromJust();
+  }
+
+  NAN_GETTER(Socket::GetBusyPoll) {
+    Socket* socket = Nan::ObjectWrap::Unwrap<Socket>(info.Holder());
+    info.GetReturnValue().Set(Nan::New<Number>(static_cast<double>(socket->busy_poll_)));
+  }
+
+  NAN_SETTER(Socket::SetBusyPoll) {
+    if (!value->IsNumber())
+      return Nan::ThrowTypeError("Busy poll time must be a number of microseconds");
+    int64_t busy_poll = Nan::To<int64_t>(value).FromJust();
+    if (busy_poll < 0)
+      return Nan::ThrowRangeError("Busy poll time must not be negative");
+
+    Socket* socket = Nan::ObjectWrap::Unwrap<Socket>(info.Holder());
+    socket->busy_poll_ = busy_poll;
+  }
+
+  NAN_METHOD(Socket::BusyPollStats) {
+    Socket* socket = GetSocket(info);
+
+    Local<Object> obj = Nan::New<Object>();
+    Nan::Set(obj, Nan::New("hits").ToLocalChecked(), Nan::New<Number>(static_cast<double>(socket->spin_hits_)));
+    Nan::Set(obj, Nan::New("misses").ToLocalChecked(), Nan::New<Number>(static_cast<double>(socket->spin_misses_)));
+
+    info.GetReturnValue().Set(obj);
+  }
+
+  /*
+   * Reads a filter prefix given either as a Buffer or as a string.
+   */
+
+  static bool
+  FilterPrefix(Local<Value> value, std::string &prefix) {
+    if (Buffer::HasInstance(value)) {
+      prefix.assign(Buffer::Data(value), Buffer::Length(value));
+      return true;
+    }
+    if (value->IsString()) {
+      Nan::Utf8String str(value);
+      prefix.assign(*str, str.length());
+      return true;
+    }
+    return false;
+  }
+
+  static bool
+  FilterPrefixes(Local<Object> spec, const char *name, std::vector<std::string> &prefixes) {
+    Local<Value> value = Nan::Get(spec, Nan::New(name).ToLocalChecked()).ToLocalChecked();
+    if (value->IsUndefined())
+      return true;
+    if (!value->IsArray())
+      return false;
+
+    Local<Array> list = value.As<Array>();
+    for (uint32_t i = 0; i < list->Length(); i++) {
+      std::string prefix;
+      if (!FilterPrefix(Nan::Get(list, i).ToLocalChecked(), prefix))
+        return false;
+      prefixes.push_back(prefix);
+    }
+    return true;
+  }
+
+  static bool
+  FilterSize(Local<Object> spec, const char *name, size_t &size) {
+    Local<Value> value = Nan::Get(spec, Nan::New(name).ToLocalChecked()).ToLocalChecked();
+    if (value->IsUndefined())
+      return true;
+    if (!value->IsNumber() || Nan::To<int64_t>(value).FromJust() < 0)
+      return false;
+    size = static_cast<size_t>(Nan::To<int64_t>(value).FromJust());
+    return true;
+  }
+
+  /*
+   * setFilter({minSize, maxSize, bytes: [{offset, value, mask, negate}],
+   * allow: [prefix, ...], deny: [prefix, ...]}) installs a receive filter,
+   * setFilter(null) removes it. A message passes when its first part is
+   * within the size bounds, satisfies every byte rule, starts with none of
+   * the denied prefixes and, when given, with one of the allowed ones.
+   */
+
+  NAN_METHOD(Socket::SetFilter) {
+    if (info.Length() != 1)
+      return Nan::ThrowError("Must pass a filter or null");
+
+    Socket* socket = GetSocket(info);
+
+    if (info[0]->IsNull() || info[0]->IsUndefined()) {
+      delete socket->filter_;
+      socket->filter_ = NULL;
+      return;
+    }
+
+    if (!info[0]->IsObject())
+      return Nan::ThrowTypeError("Filter must be an object");
+
+    Local<Object> spec = info[0].As<Object>();
+    MessageFilter *filter = new MessageFilter();
+
+    if (!FilterSize(spec, "minSize", filter->min_size) ||
+        !FilterSize(spec, "maxSize", filter->max_size)) {
+      delete filter;
+      return Nan::ThrowTypeError("Filter sizes must be non-negative integers");
+    }
+
+    if (!FilterPrefixes(spec, "allow", filter->allow) ||
+        !FilterPrefixes(spec, "deny", filter->deny)) {
+      delete filter;
+      return Nan::ThrowTypeError("Filter prefixes must be arrays of strings or Buffers");
+    }
+
+    Local<Value> bytes = Nan::Get(spec, Nan::New("bytes").ToLocalChecked()).ToLocalChecked();
+    if (!bytes->IsUndefined()) {
+      if (!bytes->IsArray()) {
+        delete filter;
+        return Nan::ThrowTypeError("Filter bytes must be an array");
+      }
+
+      Local<Array> rules = bytes.As<Array>();
+      for (uint32_t i = 0; i < rules->Length(); i++) {
+        Local<Value> entry = Nan::Get(rules, i).ToLocalChecked();
+        if (!entry->IsObject()) {
+          delete filter;
+          return Nan::ThrowTypeError("Byte rules must be objects");
+        }
+
+        Local<Object> rule = entry.As<Object>();
+        Local<Value> offset = Nan::Get(rule, Nan::New("offset").ToLocalChecked()).ToLocalChecked();
+        Local<Value> value = Nan::Get(rule, Nan::New("value").ToLocalChecked()).ToLocalChecked();
+        Local<Value> mask = Nan::Get(rule, Nan::New("mask").ToLocalChecked()).ToLocalChecked();
+        Local<Value> negate = Nan::Get(rule, Nan::New("negate").ToLocalChecked()).ToLocalChecked();
+
+        if (!offset->IsNumber() || Nan::To<int64_t>(offset).FromJust() < 0 ||
+            !value->IsNumber() || (!mask->IsUndefined() && !mask->IsNumber())) {
+          delete filter;
+          return Nan::ThrowTypeError("Byte rules need a numeric offset and value");
+        }
+
+        MessageFilter::ByteRule byte;
+        byte.offset = static_cast<size_t>(Nan::To<int64_t>(offset).FromJust());
+        byte.value = static_cast<unsigned char>(Nan::To<uint32_t>(value).FromJust());
+        byte.mask = mask->IsUndefined() ? 0xff : static_cast<unsigned char>(Nan::To<uint32_t>(mask).FromJust());
+        byte.negate = Nan::To<bool>(negate).FromJust();
+        filter->bytes.push_back(byte);
+      }
+    }
+
+    delete socket->filter_;
+    socket->filter_ = filter;
+  }
+
+  NAN_METHOD(Socket::FilterStats) {
+    Socket* socket = GetSocket(info);
+
+    Local<Object> obj = Nan::New<Object>();
+    Nan::Set(obj, Nan::New("filtered").ToLocalChecked(), Nan::New<Number>(static_cast<double>(socket->filtered_)));
+    Nan::Set(obj, Nan::New("filteredBytes").ToLocalChecked(), Nan::New<Number>(static_cast<double>(socket->filtered_bytes_)));
+
+    info.GetReturnValue().Set(obj);
+  }
+
+  static bool
+  RateOption(Local<Object> spec, const char *name, double &rate) {
+    Local<Value> value = Nan::Get(spec, Nan::New(name).ToLocalChecked()).ToLocalChecked();
+    if (value->IsUndefined())
+      return true;
+    if (!value->IsNumber() || !(Nan::To<double>(value).FromJust() >= 0))
+      return false;
+    rate = Nan::To<double>(value).FromJust();
+    return true;
+  }
+
+  /*
+   * setRate({messages, bytes, burstMessages, burstBytes}) paces sends to
+   * `messages` and `bytes` per second, setRate(null) stops pacing. Bursts
+   * default to a hundredth of a second's worth, at least one message. A
+   * message that has to wait makes sendv/sendMany stop as if the socket were
+   * full, and a timer signals send readiness once it may go out.
+   */
+
+  NAN_METHOD(Socket::SetRate) {
+    if (info.Length() != 1)
+      return Nan::ThrowError("Must pass a rate or null");
+
+    Socket* socket = GetSocket(info);
+    if (socket->state_ == STATE_CLOSED)
+      return Nan::ThrowTypeError("Socket is closed");
+
+    if (info[0]->IsNull() || info[0]->IsUndefined()) {
+      delete socket->pacer_;
+      socket->pacer_ = NULL;
+      if (socket->pace_timer_)
+        uv_timer_stop(socket->pace_timer_);
+      return;
+    }
+
+    if (!info[0]->IsObject())
+      return Nan::ThrowTypeError("Rate must be an object");
+
+    Local<Object> spec = info[0].As<Object>();
+    double messages = 0, bytes = 0, burst_messages = -1, burst_bytes = -1;
+
+    if (!RateOption(spec, "messages", messages) ||
+        !RateOption(spec, "bytes", bytes) ||
+        !RateOption(spec, "burstMessages", burst_messages) ||
+        !RateOption(spec, "burstBytes", burst_bytes))
+      return Nan::ThrowTypeError("Rates and bursts must be non-negative numbers");
+
+    if (messages == 0 && bytes == 0)
+      return Nan::ThrowRangeError("Must pass a message or byte rate");
+
+    if (burst_messages < 0)
+      burst_messages = std::max(messages / 100, 1.0);
+    if (burst_bytes < 0)
+      burst_bytes = bytes / 100;
+
+    delete socket->pacer_;
+    socket->pacer_ = new Pacer(messages, bytes, burst_messages, burst_bytes);
+
+    if (socket->pace_timer_ == NULL) {
+      socket->pace_timer_ = new uv_timer_t;
+      uv_timer_init(uv_default_loop(), socket->pace_timer_);
+      socket->pace_timer_->data = socket;
+      // liveness is the poll handle's business, see ref()/unref()
+      uv_unref(reinterpret_cast<uv_handle_t *>(socket->pace_timer_));
+    }
+  }
+
+  NAN_METHOD(Socket::RateStats) {
+    Socket* socket = GetSocket(info);
+    Pacer *pacer = socket->pacer_;
+
+    Local<Object> obj = Nan::New<Object>();
+    Nan::Set(obj, Nan::New("sent").ToLocalChecked(), Nan::New<Number>(pacer ? static_cast<double>(pacer->sent) : 0));
+    Nan::Set(obj, Nan::New("sentBytes").ToLocalChecked(), Nan::New<Number>(pacer ? static_cast<double>(pacer->sent_bytes) : 0));
+    Nan::Set(obj, Nan::New("messageRate").ToLocalChecked(), Nan::New<Number>(pacer ? pacer->MessageRate() : 0));
+    Nan::Set(obj, Nan::New("byteRate").ToLocalChecked(), Nan::New<Number>(pacer ? pacer->ByteRate() : 0));
+    Nan::Set(obj, Nan::New("throttled").ToLocalChecked(), Nan::New<Number>(pacer ? static_cast<double>(pacer->throttled) : 0));
+    Nan::Set(obj, Nan::New("throttledTime").ToLocalChecked(), Nan::New<Number>(pacer ? pacer->ThrottledTime() / 1e6 : 0));
+
+    info.GetReturnValue().Set(obj);
+  }
+
+  /*
+   * Latency tracking. With `timestamps` set every message read by readv or
+   * readMany carries a `receivedAt` time in ms on the uv_hrtime clock, the
+   * one process.hrtime() uses. JS reports back how long the message waited
+   * before its handlers ran and how long they took. With `timestampTrailer`
+   * set, sent messages get an extra last part holding the wall clock send
+   * time in microseconds, and received messages have it stripped and their
+   * one-way latency recorded.
+   */
+
+  void
+  Socket::InitHistograms() {
+    if (histograms_ == NULL)
+      histograms_ = new Histograms();
+  }
+
+  NAN_GETTER(Socket::GetTimestamps) {
+    Socket* socket = Nan::ObjectWrap::Unwrap<Socket>(info.Holder());
+    info.GetReturnValue().Set(socket->timestamps_);
+  }
+
+  NAN_SETTER(Socket::SetTimestamps) {
+    if (!value->IsBoolean())
+      return Nan::ThrowTypeError("Timestamps must be a boolean");
+
+    Socket* socket = Nan::ObjectWrap::Unwrap<Socket>(info.Holder());
+    socket->timestamps_ = Nan::To<bool>(value).FromJust();
+    socket->InitHistograms();
+  }
+
+  NAN_GETTER(Socket::GetTimestampTrailer) {
+    Socket* socket = Nan::ObjectWrap::Unwrap<Socket>(info.Holder());
+    info.GetReturnValue().Set(socket->trailer_);
+  }
 
-        // get our next frame it may have the target address and safely copy to our buffer
-        zmq_msg_init (&msg2);
-        if (zmq_msg_more(&msg1) == 0 || zmq_recvmsg (s->monitor_socket_, &msg2, 0) == -1) {
-          error = ErrorMessage();
-          zmq_msg_close(&msg2);
-          break;
-        }
+  NAN_SETTER(Socket::SetTimestampTrailer) {
+    if (!value->IsBoolean())
+      return Nan::ThrowTypeError("Timestamp trailer must be a boolean");
 
-        // protect from overflow
-        size_t len = zmq_msg_size(&msg2);
-        // MIN message size and buffer size with null padding
-        len = len < sizeof(event_endpoint)-1 ? len : sizeof(event_endpoint)-1;
-        memcpy(event_endpoint, zmq_msg_data(&msg2), len);
-        zmq_msg_close(&msg2);
+    Socket* socket = Nan::ObjectWrap::Unwrap<Socket>(info.Holder());
+  #if ZMQ_CAN_THREADSAFE
+    if (socket->poller_ != NULL)
+      return Nan::ThrowTypeError("Thread-safe sockets send single frames, without a trailer");
+  #endif
+    socket->trailer_ = Nan::To<bool>(value).FromJust();
+    socket->InitHistograms();
+  }
 
-        // null terminate our string
-        event_endpoint[len]=0;
-#else
-        // monitoring on zmq < 4 used zmq_event_t
-        zmq_event_t event;
-        memcpy (&event, zmq_msg_data (&msg1), sizeof (zmq_event_t));
-        event_id = event.event;
+  // recordHandling(dwell, handler), both in ms
+  NAN_METHOD(Socket::RecordHandling) {
+    if (info.Length() != 2 || !info[0]->IsNumber() || !info[1]->IsNumber())
+      return Nan::ThrowTypeError("Must pass the dwell and handler times");
 
-        // Bit of a hack, but all events in the zmq_event_t union have the same layout so this will work for all event types.
-        event_value = event.data.connected.fd;
-        snprintf(event_endpoint, sizeof(event_endpoint), "%s", event.data.connected.addr);
-#endif
+    Socket* socket = GetSocket(info);
+    if (socket->histograms_ == NULL)
+      return;
 
-        s->MonitorEvent(event_id, event_value, event_endpoint);
-        zmq_msg_close(&msg1);
-      }
-      else {
-        error = ErrorMessage();
-        zmq_msg_close(&msg1);
-        break;
-      }
-    }
+    double dwell = Nan::To<double>(info[0]).FromJust();
+    double handler = Nan::To<double>(info[1]).FromJust();
+    socket->histograms_->dwell.Record(dwell > 0 ? static_cast<uint64_t>(dwell * 1e6) : 0);
+    socket->histograms_->handler.Record(handler > 0 ? static_cast<uint64_t>(handler * 1e6) : 0);
+  }
 
-    // If there was no error and we still monitor we reset the monitor timer
-    if (error == NULL && s->monitor_handle_ != NULL) {
-      uv_timer_start(s->monitor_handle_, reinterpret_cast<uv_timer_cb>(Socket::UV_MonitorCallback), s->timer_interval_, 0);
-    }
-    // If error raise the monitor error event and stop the monitor
-    else if (error != NULL) {
-      s->Unmonitor();
-      s->MonitorError(error);
-    }
+  static Local<Object>
+  HistogramSnapshot(LatencyHistogram *histogram) {
+    Local<Object> obj = Nan::New<Object>();
+    uint64_t count = histogram ? histogram->count : 0;
+
+    Nan::Set(obj, Nan::New("count").ToLocalChecked(), Nan::New<Number>(static_cast<double>(count)));
+    Nan::Set(obj, Nan::New("min").ToLocalChecked(), Nan::New<Number>(count ? histogram->min / 1e6 : 0));
+    Nan::Set(obj, Nan::New("max").ToLocalChecked(), Nan::New<Number>(count ? histogram->max / 1e6 : 0));
+    Nan::Set(obj, Nan::New("mean").ToLocalChecked(), Nan::New<Number>(count ? histogram->sum / count / 1e6 : 0));
+    Nan::Set(obj, Nan::New("p50").ToLocalChecked(), Nan::New<Number>(count ? histogram->Percentile(50) / 1e6 : 0));
+    Nan::Set(obj, Nan::New("p90").ToLocalChecked(), Nan::New<Number>(count ? histogram->Percentile(90) / 1e6 : 0));
+    Nan::Set(obj, Nan::New("p99").ToLocalChecked(), Nan::New<Number>(count ? histogram->Percentile(99) / 1e6 : 0));
+    Nan::Set(obj, Nan::New("p999").ToLocalChecked(), Nan::New<Number>(count ? histogram->Percentile(99.9) / 1e6 : 0));
+
+    return obj;
   }
-#endif
 
-  Socket::Socket(Context *context, int type) : Nan::ObjectWrap() {
-    context_.Reset(context->handle());
-    socket_ = zmq_socket(context->context_, type);
-    pending_ = false;
-    state_ = STATE_READY;
+  // latencyStats(reset) snapshots the histograms, all times in ms
+  NAN_METHOD(Socket::LatencyStats) {
+    Socket* socket = GetSocket(info);
 
-    if (NULL == socket_) {
-      Nan::ThrowError(ErrorMessage());
-      return;
-    }
+    Histograms *histograms = socket->histograms_;
 
-    endpoints = 0;
+    Local<Object> obj = Nan::New<Object>();
+    Nan::Set(obj, Nan::New("dwell").ToLocalChecked(), HistogramSnapshot(histograms ? &histograms->dwell : NULL));
+    Nan::Set(obj, Nan::New("handler").ToLocalChecked(), HistogramSnapshot(histograms ? &histograms->handler : NULL));
+    Nan::Set(obj, Nan::New("latency").ToLocalChecked(), HistogramSnapshot(histograms ? &histograms->latency : NULL));
+
+    if (info.Length() > 0 && Nan::To<bool>(info[0]).FromJust() && histograms != NULL) {
+      histograms->dwell.Reset();
+      histograms->handler.Reset();
+      histograms->latency.Reset();
+    }
 
-    poll_handle_ = new uv_poll_t;
+    info.GetReturnValue().Set(obj);
+  }
 
-    poll_handle_->data = this;
+  /*
+   * Handles the last part of a message on a socket with a timestamp trailer.
+   * Once both ends have opted in every message after its first part ends in
+   * a trailer, so that part is dropped whatever it holds; only a well formed
+   * 8 byte one is recorded as latency. Returns false for the first part of a
+   * message, which is always kept.
+   */
 
-    uv_os_sock_t socket;
-    size_t len = sizeof(uv_os_sock_t);
+  bool
+  Socket::TakeTrailer(zmq_msg_t *msg, size_t index) {
+    if (index == 0)
+      return false;
+    if (zmq_msg_size(msg) != 8)
+      return true;
+
+    const unsigned char *data = static_cast<const unsigned char *>(zmq_msg_data(msg));
+    uint64_t sent = 0;
+    for (int i = 7; i >= 0; i--)
+      sent = (sent << 8) | data[i];
+
+    int64_t latency = RealtimeMicros() - static_cast<int64_t>(sent);
+    histograms_->latency.Record(latency > 0 ? static_cast<uint64_t>(latency) * 1000 : 0);
+    return true;
+  }
 
-    if (zmq_getsockopt(socket_, ZMQ_FD, &socket, &len)) {
-      throw std::runtime_error(ErrorMessage());
+  // like TakeTrailer, then decodes the part before the trailer if need be
+  bool
+  Socket::ReadTrailer(zmq_msg_t *msg, Local<Array> result, size_t index) {
+    if (!TakeTrailer(msg, index))
+      return false;
+
+    if (decode_) {
+      Local<Value> last = Nan::Get(result, index - 1).ToLocalChecked();
+      Unpacker unpacker(Buffer::Data(last), Buffer::Length(last));
+      Local<Value> value = unpacker.Unpack();
+      Nan::Set(result, index - 1, value.IsEmpty() ? Nan::Error(unpacker.error()) : value);
     }
+    return true;
+  }
 
-    #if ZMQ_CAN_MONITOR
-      this->monitor_socket_ = NULL;
+  // sends the trailer ending the current message, `flags` are its last part's
+  int
+  Socket::SendTrailer(int flags) {
+    zmq_msg_t msg;
+    if (zmq_msg_init_size(&msg, 8) != 0)
+      return -1;
+
+    uint64_t now = static_cast<uint64_t>(RealtimeMicros());
+    unsigned char *data = static_cast<unsigned char *>(zmq_msg_data(&msg));
+    for (int i = 0; i < 8; i++)
+      data[i] = static_cast<unsigned char>(now >> (8 * i));
+
+    flags &= ~ZMQ_SNDMORE;
+  #if ZMQ_VERSION_MAJOR >= 4
+    flags &= ~ZMQ_DONTWAIT;
+  #endif
+
+    while (true) {
+    #if ZMQ_VERSION_MAJOR == 2
+      int rc = zmq_send(socket_, &msg, flags);
+    #elif ZMQ_VERSION_MAJOR == 3
+      int rc = zmq_sendmsg(socket_, &msg, flags);
+    #else
+      int rc = zmq_msg_send(&msg, socket_, flags);
     #endif
+      if (rc < 0 && zmq_errno() == EINTR)
+        continue;
+      if (rc < 0) {
+        int err = zmq_errno();
+        zmq_msg_close(&msg);
+        errno = err;
+        return -1;
+      }
+      return 0;
+    }
+  }
 
-    uv_poll_init_socket(uv_default_loop(), poll_handle_, socket);
-    uv_poll_start(poll_handle_, UV_READABLE, Socket::UV_PollCallback);
+  void
+  Socket::SchedulePace(uint64_t wait) {
+    uint64_t timeout = (wait + 999999) / 1000000;
+    uv_timer_start(pace_timer_, reinterpret_cast<uv_timer_cb>(Socket::UV_PaceCallback), timeout, 0);
   }
 
-  Socket *
-  Socket::GetSocket(const Nan::FunctionCallbackInfo<Value> &info) {
-    return Nan::ObjectWrap::Unwrap<Socket>(info.This());
+  void
+  Socket::UV_PaceCallback(uv_timer_t* handle, int status) {
+    Socket* s = static_cast<Socket*>(handle->data);
+    if (s->state_ == STATE_READY && s->pending_)
+      s->NotifySendReady();
   }
 
   /*
-   * This macro makes a call to GetSocket and checks the socket state. These two
-   * things go hand in hand everywhere in our code.
+   * Called with the first part of a message. When the filter rejects it,
+   * the rest of the message is received and discarded and true is returned.
+   * A receive error while discarding is left for the next read to report.
    */
-  #define GET_SOCKET(info)                                      \
-      Socket* socket = GetSocket(info);                         \
-      if (socket->state_ == STATE_CLOSED)                       \
-          return Nan::ThrowTypeError("Socket is closed");       \
-      if (socket->state_ == STATE_BUSY)                         \
-          return Nan::ThrowTypeError("Socket is busy");
 
-  NAN_GETTER(Socket::GetState) {
-    Socket* socket = Nan::ObjectWrap::Unwrap<Socket>(info.Holder());
-    info.GetReturnValue().Set(Nan::New<Integer>(socket->state_));
-  }
+  bool
+  Socket::Filtered(zmq_msg_t *msg) {
+    if (filter_ == NULL)
+      return false;
 
-  NAN_GETTER(Socket::GetPending) {
-    Socket* socket = Nan::ObjectWrap::Unwrap<Socket>(info.Holder());
-    info.GetReturnValue().Set(socket->pending_);
-  }
+    size_t size = zmq_msg_size(msg);
+    if (filter_->Accepts(static_cast<const char *>(zmq_msg_data(msg)), size))
+      return false;
 
-  NAN_SETTER(Socket::SetPending) {
-    if (!value->IsBoolean())
-      return Nan::ThrowTypeError("Pending must be a boolean");
+    filtered_++;
+    filtered_bytes_ += size;
 
-    Socket* socket = Nan::ObjectWrap::Unwrap<Socket>(info.Holder());
-    socket->pending_ = Nan::To<bool>(value).FromJust();
+    int64_t more = 1;
+    size_t more_size = sizeof(more);
+
+    while (true) {
+      while (zmq_getsockopt(socket_, ZMQ_RCVMORE, &more, &more_size)) {
+        if (zmq_errno() != EINTR)
+          return true;
+      }
+      if (more != 1)
+        return true;
+
+      zmq_msg_t rest;
+      if (zmq_msg_init(&rest) < 0)
+        return true;
+      int rc = RecvPart(&rest);
+      if (rc >= 0)
+        filtered_bytes_ += zmq_msg_size(&rest);
+      zmq_msg_close(&rest);
+      if (rc < 0)
+        return true;
+    }
   }
 
   template<typename T>
@@ -649,16 +2572,36 @@ namespace zmq {
     return Nan::Undefined();
   }
 
+  // Nan::To has no uint64_t, and ZMQ_AFFINITY masks need the top bit
+  template<> Local<Value>
+  Socket::SetSockOpt<uint64_t>(int option, Local<Value> wrappedValue) {
+    if (!wrappedValue->IsNumber()) {
+      Nan::ThrowError("Value must be an integer");
+      return Nan::Undefined();
+    }
+    double number = Nan::To<double>(wrappedValue).FromJust();
+    if (!(number >= 0 && number < 18446744073709551616.0)) {
+      Nan::ThrowRangeError("Value must be an unsigned 64 bit integer");
+      return Nan::Undefined();
+    }
+    uint64_t value = static_cast<uint64_t>(number);
+    if (zmq_setsockopt(socket_, option, &value, sizeof(value)) < 0)
+      Nan::ThrowError(ExceptionFromError());
+    return Nan::Undefined();
+  }
+
   template<> Local<Value>
   Socket::GetSockOpt<char*>(int option) {
     char value[1024];
-    size_t len = sizeof(value) - 1;
+    size_t len = sizeof(value);
     if (zmq_getsockopt(socket_, option, value, &len) < 0) {
       Nan::ThrowError(ExceptionFromError());
       return Nan::Undefined();
     }
-    value[len] = '\0';
-    return Nan::New<String>(value).ToLocalChecked();
+    // string options come back with their terminator, identities without
+    if (len > 0 && value[len - 1] == '\0')
+      len--;
+    return Nan::New<String>(value, len).ToLocalChecked();
   }
 
   template<> Local<Value>
@@ -674,6 +2617,30 @@ namespace zmq {
     return Nan::Undefined();
   }
 
+  Local<Value> Socket::GetOption(int option) {
+    switch (OptionTypeOf(option)) {
+      case OPT_INT: return GetSockOpt<int>(option);
+      case OPT_UINT32: return GetSockOpt<uint32_t>(option);
+      case OPT_INT64: return GetSockOpt<int64_t>(option);
+      case OPT_UINT64: return GetSockOpt<uint64_t>(option);
+      case OPT_BINARY: return GetSockOpt<char*>(option);
+    }
+    Nan::ThrowError(zmq_strerror(EINVAL));
+    return Nan::Undefined();
+  }
+
+  Local<Value> Socket::SetOption(int option, Local<Value> value) {
+    switch (OptionTypeOf(option)) {
+      case OPT_INT: return SetSockOpt<int>(option, value);
+      case OPT_UINT32: return SetSockOpt<uint32_t>(option, value);
+      case OPT_INT64: return SetSockOpt<int64_t>(option, value);
+      case OPT_UINT64: return SetSockOpt<uint64_t>(option, value);
+      case OPT_BINARY: return SetSockOpt<char*>(option, value);
+    }
+    Nan::ThrowError(zmq_strerror(EINVAL));
+    return Nan::Undefined();
+  }
+
   NAN_METHOD(Socket::GetSockOpt) {
     if (info.Length() != 1)
       return Nan::ThrowError("Must pass an option");
@@ -682,20 +2649,7 @@ namespace zmq {
     int64_t option = Nan::To<int64_t>(info[0]).FromJust();
 
     GET_SOCKET(info);
-
-    if (opts_int.count(option)) {
-      info.GetReturnValue().Set(socket->GetSockOpt<int>(option));
-    } else if (opts_uint32.count(option)) {
-      info.GetReturnValue().Set(socket->GetSockOpt<uint32_t>(option));
-    } else if (opts_int64.count(option)) {
-      info.GetReturnValue().Set(socket->GetSockOpt<int64_t>(option));
-    } else if (opts_uint64.count(option)) {
-      info.GetReturnValue().Set(socket->GetSockOpt<uint64_t>(option));
-    } else if (opts_binary.count(option)) {
-      info.GetReturnValue().Set(socket->GetSockOpt<char*>(option));
-    } else {
-      return Nan::ThrowError(zmq_strerror(EINVAL));
-    }
+    info.GetReturnValue().Set(socket->GetOption(option));
   }
 
   NAN_METHOD(Socket::SetSockOpt) {
@@ -706,19 +2660,82 @@ namespace zmq {
     int64_t option = Nan::To<int64_t>(info[0]).FromJust();
     GET_SOCKET(info);
 
-    if (opts_int.count(option)) {
-      info.GetReturnValue().Set(socket->SetSockOpt<int>(option, info[1]));
-    } else if (opts_uint32.count(option)) {
-      info.GetReturnValue().Set(socket->SetSockOpt<uint32_t>(option, info[1]));
-    } else if (opts_int64.count(option)) {
-      info.GetReturnValue().Set(socket->SetSockOpt<int64_t>(option, info[1]));
-    } else if (opts_uint64.count(option)) {
-      info.GetReturnValue().Set(socket->SetSockOpt<int64_t>(option, info[1]));
-    } else if (opts_binary.count(option)) {
-      info.GetReturnValue().Set(socket->SetSockOpt<char*>(option, info[1]));
-    } else {
-      return Nan::ThrowError(zmq_strerror(EINVAL));
+    info.GetReturnValue().Set(socket->SetOption(option, info[1]));
+  }
+
+  /*
+   * Applies a flat [option, value, option, value, ...] array in one call,
+   * in order, stopping at the first option that fails.
+   */
+
+  NAN_METHOD(Socket::Configure) {
+    if (info.Length() != 1 || !info[0]->IsArray())
+      return Nan::ThrowTypeError("Must pass an array of options and values");
+    Local<Array> pairs = info[0].As<Array>();
+    uint32_t length = pairs->Length();
+    if (length % 2)
+      return Nan::ThrowError("Every option needs a value");
+    for (uint32_t i = 0; i < length; i += 2) {
+      if (!Nan::Get(pairs, i).ToLocalChecked()->IsNumber())
+        return Nan::ThrowTypeError("Option must be an integer");
+    }
+    GET_SOCKET(info);
+
+    // checked above, so the only exceptions left come from SetOption
+    Nan::TryCatch try_catch;
+    for (uint32_t i = 0; i < length; i += 2) {
+      Local<Value> option = Nan::Get(pairs, i).ToLocalChecked();
+      socket->SetOption(Nan::To<int64_t>(option).FromJust(),
+        Nan::Get(pairs, i + 1).ToLocalChecked());
+      if (try_catch.HasCaught()) {
+        try_catch.ReThrow();
+        return;
+      }
+    }
+  }
+
+  /*
+   * ZMQ_EVENTS and ZMQ_RCVMORE are read once per frame by read(), so they
+   * get accessors of their own instead of going through getsockopt.
+   */
+
+  NAN_GETTER(Socket::GetEvents) {
+    Socket* socket = Nan::ObjectWrap::Unwrap<Socket>(info.Holder());
+    if (socket->state_ == STATE_CLOSED)
+      return Nan::ThrowTypeError("Socket is closed");
+  #if ZMQ_VERSION_MAJOR >= 3
+    int events;
+  #else
+    uint32_t events;
+  #endif
+    size_t events_size = sizeof(events);
+    while (zmq_getsockopt(socket->socket_, ZMQ_EVENTS, &events, &events_size)) {
+      if (zmq_errno() != EINTR)
+        return Nan::ThrowError(ExceptionFromError());
+    }
+    if (socket->HasHeld())
+      events |= ZMQ_POLLIN;
+    info.GetReturnValue().Set(Nan::New<Integer>(static_cast<uint32_t>(events)));
+  }
+
+  NAN_GETTER(Socket::GetMore) {
+    Socket* socket = Nan::ObjectWrap::Unwrap<Socket>(info.Holder());
+    if (socket->state_ == STATE_CLOSED)
+      return Nan::ThrowTypeError("Socket is closed");
+    // recv() hands out a held message before anything else
+    if (socket->HasHeld())
+      return info.GetReturnValue().Set(Nan::True());
+  #if ZMQ_VERSION_MAJOR >= 3
+    int more;
+  #else
+    int64_t more;
+  #endif
+    size_t more_size = sizeof(more);
+    while (zmq_getsockopt(socket->socket_, ZMQ_RCVMORE, &more, &more_size)) {
+      if (zmq_errno() != EINTR)
+        return Nan::ThrowError(ExceptionFromError());
     }
+    info.GetReturnValue().Set(Nan::New<Boolean>(more != 0));
   }
 
   void Socket::_AttachToEventLoop() {
@@ -771,6 +2788,7 @@ namespace zmq {
     GET_SOCKET(info);
 
     BindState* state = new BindState(socket, cb, addr);
+    ZMQ_PROBE2(bind, socket, *state->addr);
     uv_work_t* req = new uv_work_t;
     req->data = state;
     uv_queue_work(uv_default_loop(),
@@ -804,12 +2822,16 @@ namespace zmq {
 
     Socket *socket = Nan::ObjectWrap::Unwrap<Socket>(Nan::New(state->sock_obj));
     socket->state_ = STATE_READY;
+    ZMQ_PROBE3(bound, socket, *state->addr, state->error);
+    ZMQ_TRACE('I', "bound", "error", state->error);
 
-    if (socket->endpoints == 0) {
-      socket->Ref();
-      socket->_AttachToEventLoop();
+    if (!state->error) {
+      if (socket->endpoints == 0) {
+        socket->Ref();
+        socket->_AttachToEventLoop();
+      }
+      socket->endpoints += 1;
     }
-    socket->endpoints += 1;
 
     Nan::MakeCallback(Nan::GetCurrentContext()->Global(), cb, 1, argv);
 
@@ -885,7 +2907,7 @@ namespace zmq {
     Socket *socket = Nan::ObjectWrap::Unwrap<Socket>(Nan::New(state->sock_obj));
     socket->state_ = STATE_READY;
 
-    if (--socket->endpoints == 0) {
+    if (!state->error && --socket->endpoints == 0) {
       socket->Unref();
       socket->_DetachFromEventLoop();
     }
@@ -937,6 +2959,122 @@ namespace zmq {
     return;
   }
 
+  /*
+   * bindMany(addrs, cb) and connectMany(addrs, cb) attach every address in
+   * a single threadpool job, so the socket is busy once instead of once per
+   * address and connects resolving host names stay off the main thread.
+   * The callback gets an array holding an Error or undefined per address.
+   */
+
+  struct Socket::AttachState {
+    AttachState(Socket* sock_, Local<Function> cb_, bool bind_) : bind(bind_) {
+      sock_obj.Reset(sock_->handle());
+      sock = sock_->socket_;
+      cb.Reset(cb_);
+    }
+
+    ~AttachState() {
+      sock_obj.Reset();
+      cb.Reset();
+    }
+
+    Nan::Persistent<Object> sock_obj;
+    void* sock;
+    Nan::Persistent<Function> cb;
+    bool bind;
+    std::vector<std::string> addrs;
+    std::vector<int> errors;
+  };
+
+  void
+  Socket::AttachMany(const Nan::FunctionCallbackInfo<Value>& info, bool bind) {
+    if (!info[0]->IsArray())
+      return Nan::ThrowTypeError("Addresses must be an array");
+    if (!info[1]->IsFunction())
+      return Nan::ThrowTypeError("Provided callback must be a function");
+    Local<Array> addrs = info[0].As<Array>();
+    uint32_t length = addrs->Length();
+    for (uint32_t i = 0; i < length; i++) {
+      if (!Nan::Get(addrs, i).ToLocalChecked()->IsString())
+        return Nan::ThrowTypeError("Address must be a string!");
+    }
+
+    GET_SOCKET(info);
+
+    AttachState* state = new AttachState(socket, info[1].As<Function>(), bind);
+    state->addrs.reserve(length);
+    for (uint32_t i = 0; i < length; i++) {
+      Nan::Utf8String addr(Nan::Get(addrs, i).ToLocalChecked());
+      state->addrs.push_back(std::string(*addr, addr.length()));
+      if (bind)
+        ZMQ_PROBE2(bind, socket, *addr);
+    }
+    state->errors.resize(length, 0);
+
+    uv_work_t* req = new uv_work_t;
+    req->data = state;
+    uv_queue_work(uv_default_loop(),
+                  req,
+                  UV_AttachManyAsync,
+                  (uv_after_work_cb)UV_AttachManyAsyncAfter);
+    socket->state_ = STATE_BUSY;
+  }
+
+  NAN_METHOD(Socket::BindMany) {
+    AttachMany(info, true);
+  }
+
+  NAN_METHOD(Socket::ConnectMany) {
+    AttachMany(info, false);
+  }
+
+  void Socket::UV_AttachManyAsync(uv_work_t* req) {
+    AttachState* state = static_cast<AttachState*>(req->data);
+    for (size_t i = 0; i < state->addrs.size(); i++) {
+      const char *addr = state->addrs[i].c_str();
+      int rc = state->bind ? zmq_bind(state->sock, addr) : zmq_connect(state->sock, addr);
+      if (rc < 0)
+        state->errors[i] = zmq_errno();
+    }
+  }
+
+  void Socket::UV_AttachManyAsyncAfter(uv_work_t* req) {
+    AttachState* state = static_cast<AttachState*>(req->data);
+    Nan::HandleScope scope;
+
+    Socket *socket = Nan::ObjectWrap::Unwrap<Socket>(Nan::New(state->sock_obj));
+    socket->state_ = STATE_READY;
+
+    Local<Array> errors = Nan::New<Array>(state->addrs.size());
+    int32_t attached = 0;
+    for (size_t i = 0; i < state->addrs.size(); i++) {
+      int error = state->errors[i];
+      if (state->bind)
+        ZMQ_PROBE3(bound, socket, state->addrs[i].c_str(), error);
+      if (error) {
+        Nan::Set(errors, i, Nan::Error(zmq_strerror(error)));
+      } else {
+        Nan::Set(errors, i, Nan::Undefined());
+        attached++;
+      }
+    }
+    ZMQ_TRACE('I', state->bind ? "boundMany" : "connectedMany", "attached", attached);
+
+    if (attached > 0) {
+      if (socket->endpoints == 0) {
+        socket->Ref();
+        socket->_AttachToEventLoop();
+      }
+      socket->endpoints += attached;
+    }
+
+    Local<Value> argv[1] = { errors };
+    Nan::MakeCallback(Nan::GetCurrentContext()->Global(), Nan::New(state->cb), 1, argv);
+
+    delete state;
+    delete req;
+  }
+
 #if ZMQ_CAN_DISCONNECT
   NAN_METHOD(Socket::Disconnect) {
 
@@ -954,7 +3092,34 @@ namespace zmq {
       socket->_DetachFromEventLoop();
     }
 
-    return;
+    return;
+  }
+#endif
+
+#if ZMQ_CAN_THREADSAFE
+  // DISH group membership
+  NAN_METHOD(Socket::Join) {
+    if (!info[0]->IsString()) {
+      return Nan::ThrowTypeError("Group must be a string!");
+    }
+
+    GET_SOCKET(info);
+
+    Nan::Utf8String group(info[0].As<String>());
+    if (zmq_join(socket->socket_, *group))
+      return Nan::ThrowError(ErrorMessage());
+  }
+
+  NAN_METHOD(Socket::Leave) {
+    if (!info[0]->IsString()) {
+      return Nan::ThrowTypeError("Group must be a string!");
+    }
+
+    GET_SOCKET(info);
+
+    Nan::Utf8String group(info[0].As<String>());
+    if (zmq_leave(socket->socket_, *group))
+      return Nan::ThrowError(ErrorMessage());
   }
 #endif
 
@@ -1024,6 +3189,71 @@ namespace zmq {
       MessageReference* msgref_;
   };
 
+  /*
+   * The latest message for every topic seen by ConflateMessages, in the order
+   * the topics first showed up. A message replacing an older one with the
+   * same first part closes the older one's parts right away, so at most one
+   * message per topic is ever held.
+   */
+
+  class Socket::ConflatedMessages {
+    public:
+      typedef std::vector<zmq_msg_t*> Parts;
+
+      inline ConflatedMessages() : read(0), replaced(0) {}
+
+      inline ~ConflatedMessages() {
+        for (size_t i = 0; i < messages.size(); i++)
+          Close(messages[i]);
+      }
+
+      // takes ownership of the parts
+      inline void Put(Parts &parts) {
+        zmq_msg_t *topic = parts[0];
+        std::string key(static_cast<const char *>(zmq_msg_data(topic)), zmq_msg_size(topic));
+        std::map<std::string, size_t>::iterator slot = slots.find(key);
+
+        if (slot == slots.end()) {
+          slots.insert(std::make_pair(key, messages.size()));
+          messages.push_back(Parts());
+          messages.back().swap(parts);
+        } else {
+          Close(messages[slot->second]);
+          messages[slot->second].swap(parts);
+          replaced++;
+        }
+      }
+
+      // hands the part over to a Buffer, which closes it when collected
+      static inline Local<Value> ToBuffer(zmq_msg_t *msg) {
+        return Nan::NewBuffer(static_cast<char *>(zmq_msg_data(msg)), zmq_msg_size(msg),
+                              FreeCallback, msg).ToLocalChecked();
+      }
+
+      static inline void Close(Parts &parts) {
+        for (size_t i = 0; i < parts.size(); i++) {
+          if (parts[i] == NULL)
+            continue;
+          zmq_msg_close(parts[i]);
+          delete parts[i];
+        }
+        parts.clear();
+      }
+
+      std::vector<Parts> messages;
+      uint64_t read;
+      uint64_t replaced;
+
+    private:
+      static void FreeCallback(char* data, void* message) {
+        zmq_msg_t *msg = static_cast<zmq_msg_t*>(message);
+        zmq_msg_close(msg);
+        delete msg;
+      }
+
+      std::map<std::string, size_t> slots;
+  };
+
 #if ZMQ_CAN_MONITOR
   NAN_METHOD(Socket::Monitor) {
     int64_t timer_interval = 10; // default to 10ms interval
@@ -1046,13 +3276,28 @@ namespace zmq {
     }
 
     GET_SOCKET(info);
+    socket->Unmonitor();  // a second call starts over with the new interval
+
+    // closeAsync() leaves the sockets of a terminating context open
+    Context *context = socket->owner_;
+    if (context->context_ == NULL)
+      return Nan::ThrowError("Context is closed");
+
     char addr[255];
-    Context *context = Nan::ObjectWrap::Unwrap<Context>(Nan::New(socket->context_));
     sprintf(addr, "%s%d", "inproc://monitor.req.", monitors_count++);
 
     if(zmq_socket_monitor(socket->socket_, addr, ZMQ_EVENT_ALL) != -1) {
-      socket->monitor_socket_ = zmq_socket (context->context_, ZMQ_PAIR);
-      zmq_connect (socket->monitor_socket_, addr);
+      void *monitor = zmq_socket(context->context_, ZMQ_PAIR);
+      if (monitor == NULL || zmq_connect(monitor, addr) < 0) {
+        int err = zmq_errno();
+        if (monitor != NULL)
+          zmq_close(monitor);
+        zmq_socket_monitor(socket->socket_, NULL, ZMQ_EVENT_ALL);
+        errno = err;
+        return Nan::ThrowError(ErrorMessage());
+      }
+      context->sockets_++;
+      socket->monitor_socket_ = monitor;
       socket->timer_interval_ = timer_interval;
       socket->num_of_events_ = num_of_events;
       socket->monitor_handle_ = new uv_timer_t;
@@ -1078,6 +3323,7 @@ namespace zmq {
     // Close the monitor socket and stop timer
     if (zmq_close(this->monitor_socket_) < 0)
       throw std::runtime_error(ErrorMessage());
+    owner_->sockets_--;
     uv_timer_stop(this->monitor_handle_);
     this->monitor_handle_ = NULL;
     this->monitor_socket_ = NULL;
@@ -1093,32 +3339,73 @@ namespace zmq {
 
 #endif
 
-  NAN_METHOD(Socket::Readv) {
-    Socket* socket = GetSocket(info);
-    if (socket->state_ != STATE_READY)
-      return;
+  /*
+   * Receives a single part with whichever receive call the ØMQ version we
+   * were built against provides, retrying on EINTR.
+   */
+
+  int
+  Socket::RecvPart(zmq_msg_t *msg) {
+    int rc;
+    while (true) {
+    #if ZMQ_VERSION_MAJOR == 2
+      rc = zmq_recv(socket_, msg, 0);
+    #elif ZMQ_VERSION_MAJOR == 3
+      rc = zmq_recvmsg(socket_, msg, 0);
+    #else
+      rc = zmq_msg_recv(msg, socket_, 0);
+    #endif
+      if (rc < 0 && zmq_errno() == EINTR)
+        continue;
+      if (rc >= 0)
+        traffic_ += zmq_msg_size(msg);
+      return rc;
+    }
+  }
 
+  /*
+   * Receives one complete (possibly multipart) message, appending a Buffer
+   * for every part to `result`. Returns 1 when a message was read, 0 when
+   * none is ready and -1 on error, in which case zmq_errno() is set.
+   */
+
+  int
+  Socket::ReadMessage(Local<Array> result) {
     int events;
     size_t events_size = sizeof(events);
     bool checkPollIn = true;
 
     int rc = 0;
-    int flags = 0;
     int64_t more = 1;
     size_t more_size = sizeof(more);
     size_t index = 0;
-
-    Local<Array> result = Nan::New<Array>();
+    size_t bytes = 0;
+
+    if (HasHeld()) {
+      more = 0;
+      for (; index < held_->size(); index++) {
+        zmq_msg_t *part = (*held_)[index];
+        bytes += zmq_msg_size(part);
+        if (decode_ && index == held_->size() - 1) {
+          Nan::Set(result, index, DecodePart(part));
+          zmq_msg_close(part);
+          delete part;
+        } else {
+          Nan::Set(result, index, ConflatedMessages::ToBuffer(part));
+        }
+      }
+      held_->clear();
+    }
 
     while (more == 1) {
       if (checkPollIn) {
-        while (zmq_getsockopt(socket->socket_, ZMQ_EVENTS, &events, &events_size)) {
+        while (zmq_getsockopt(socket_, ZMQ_EVENTS, &events, &events_size)) {
           if (zmq_errno() != EINTR)
-            return Nan::ThrowError(ErrorMessage());
+            return -1;
         }
 
         if ((events & ZMQ_POLLIN) == 0)
-          return;
+          return 0;
       }
 
       IncomingMessage part;
@@ -1129,38 +3416,386 @@ namespace zmq {
           if (zmq_errno()==EINTR) {
             continue;
           }
-          return Nan::ThrowError(ErrorMessage());
+          return -1;
         }
         break;
       }
 
-      while (true) {
-      #if ZMQ_VERSION_MAJOR == 2
-        rc = zmq_recv(socket->socket_, part, flags);
-      #elif ZMQ_VERSION_MAJOR == 3
-        rc = zmq_recvmsg(socket->socket_, part, flags);
-      #else
-        rc = zmq_msg_recv(part, socket->socket_, flags);
-        checkPollIn = false;
-      #endif
+      if (RecvPart(part) < 0)
+        return -1;
 
-        if (rc < 0) {
-          if (zmq_errno() == EINTR)
-            continue;
-          return Nan::ThrowError(ErrorMessage());
+      if (index == 0 && Filtered(part)) {
+        checkPollIn = true;
+        continue;
+      }
+    #if ZMQ_VERSION_MAJOR >= 4
+      checkPollIn = false;
+    #endif
+
+    #if ZMQ_CAN_THREADSAFE
+      if (poller_ != NULL) {
+        // single frame, its routing id or group comes first
+        more = 0;
+        if (addressing_ == ADDRESS_ROUTING_ID) {
+          Nan::Set(result, index++, Nan::New<Uint32>(zmq_msg_routing_id(part)));
+        } else if (addressing_ == ADDRESS_GROUP) {
+          Nan::Set(result, index++, Nan::New(zmq_msg_group(part)).ToLocalChecked());
         }
+      } else
+    #endif
+      while (zmq_getsockopt(socket_, ZMQ_RCVMORE, &more, &more_size)) {
+        if (zmq_errno() != EINTR)
+          return -1;
+      }
+
+      bytes += zmq_msg_size(part);
+
+      if (trailer_ && more != 1 && ReadTrailer(part, result, index))
+        break;
 
+      if (decode_ && more != 1) {
+        Nan::Set(result, index++, DecodePart(part));
+      } else {
         Nan::Set(result, index++, part.GetBuffer());
+      }
+    }
+
+    if (timestamps_) {
+      Nan::Set(result, Nan::New(received_at_symbol),
+               Nan::New<Number>(static_cast<double>(uv_hrtime()) / 1e6));
+    }
+
+    ZMQ_PROBE3(recv, this, index, bytes);
+    ZMQ_TRACE('I', "recv", "parts", index, "bytes", bytes);
+    return 1;
+  }
+
+  /*
+   * Decodes a MessagePack encoded part straight from the zmq_msg_t. A part
+   * that doesn't decode yields an Error in place of the value.
+   */
+
+  Local<Value>
+  Socket::DecodePart(zmq_msg_t *msg) {
+    Unpacker unpacker(static_cast<const char *>(zmq_msg_data(msg)), zmq_msg_size(msg));
+    Local<Value> value = unpacker.Unpack();
+    if (value.IsEmpty())
+      return Nan::Error(unpacker.error());
+    return value;
+  }
+
+  /*
+   * Receives one complete message and copies its parts back to back into
+   * `data`, starting at `offset`, so nothing is allocated on the JS heap.
+   * For every part an [offset, length, more] triple is written to `index`.
+   * A part that does not fit in the remaining space is truncated, like
+   * zmq_recv() does, and its index entry still reports the full length. A
+   * timestamp trailer is recorded and left out, see TakeTrailer.
+   *
+   * A message with more parts than `index` has room for stays held by the
+   * socket, whose next read of any kind returns it first. Returns 1 when a
+   * message was copied, 2 when one is held, 0 when none is ready and -1 on
+   * error.
+   */
+
+  int
+  Socket::CopyMessage(char *data, size_t length, size_t &offset,
+                      uint32_t *index, size_t slots, uint32_t &frames) {
+    if (held_ == NULL)
+      held_ = new std::vector<zmq_msg_t*>();
+
+    if (held_->empty()) {
+      int rc = ReceiveParts(*held_);
+      if (rc <= 0)
+        return rc;
+    }
+
+    std::vector<zmq_msg_t*> &parts = *held_;
+    if ((frames + parts.size()) * 3 > slots)
+      return 2;
+
+    for (size_t i = 0; i < parts.size(); i++) {
+      size_t size = zmq_msg_size(parts[i]);
+      size_t copied = std::min(size, length - offset);
+      const char *dat = static_cast<const char *>(zmq_msg_data(parts[i]));
+      std::copy(dat, dat + copied, data + offset);
+
+      index[frames * 3] = static_cast<uint32_t>(offset);
+      index[frames * 3 + 1] = static_cast<uint32_t>(size);
+      index[frames * 3 + 2] = i < parts.size() - 1 ? 1 : 0;
+      frames++;
+      offset += copied;
+    }
+
+    ConflatedMessages::Close(parts);
+    return 1;
+  }
+
+  NAN_METHOD(Socket::Readv) {
+    Socket* socket = GetSocket(info);
+    if (socket->state_ != STATE_READY)
+      return;
+
+    Local<Array> result = Nan::New<Array>();
+
+    int rc = socket->ReadMessage(result);
+    if (rc < 0)
+      return Nan::ThrowError(ErrorMessage());
+    if (rc == 0)
+      return;
+
+    info.GetReturnValue().Set(result);
+  }
+
+  /*
+   * Reads up to `max` messages in a single call and returns them as an array
+   * of part arrays. Whatever is left stays queued inside ØMQ, so a consumer
+   * pulling with this method is bounded by ZMQ_RCVHWM rather than by a queue
+   * in JavaScript. An empty array means the socket ran dry, which also re-arms
+   * the edge-triggered ZMQ_FD watcher.
+   */
+
+  NAN_METHOD(Socket::ReadMany) {
+    if (info.Length() != 1 || !info[0]->IsNumber())
+      return Nan::ThrowTypeError("Must pass the maximum number of messages");
+    int64_t max = Nan::To<int64_t>(info[0]).FromJust();
+    if (max < 1)
+      return Nan::ThrowRangeError("Maximum number of messages must be positive");
+
+    Socket* socket = GetSocket(info);
+    if (socket->state_ != STATE_READY)
+      return;
+
+    Local<Array> messages = Nan::New<Array>();
+    uint32_t count = 0;
+
+    while (count < max) {
+      Local<Array> result = Nan::New<Array>();
+
+      int rc = socket->ReadMessage(result);
+      if (rc < 0)
+        return Nan::ThrowError(ErrorMessage());
+      if (rc == 0)
         break;
+
+      Nan::Set(messages, count++, result);
+    }
+
+    info.GetReturnValue().Set(messages);
+  }
+
+  /*
+   * Drains up to `max` messages, keeping only the latest one per topic in
+   * `messages`. Receive filters apply as usual. Returns the number of
+   * messages read from ØMQ, or -1 on error, in which case the messages read
+   * before it are still in `messages`.
+   */
+
+  int
+  Socket::ConflateMessages(ConflatedMessages &messages, int64_t max) {
+    int count = 0;
+
+    while (count < max) {
+      ConflatedMessages::Parts parts;
+      if (HasHeld()) {
+        parts.swap(*held_);
+      } else {
+        int rc = ReceiveParts(parts);
+        if (rc < 0)
+          return -1;
+        if (rc == 0)
+          break;
       }
 
-      while (zmq_getsockopt(socket->socket_, ZMQ_RCVMORE, &more, &more_size)) {
+      messages.Put(parts);
+      messages.read++;
+      count++;
+    }
+
+    return count;
+  }
+
+  /*
+   * Receives the next message that passes the filters into `parts`, which
+   * the caller owns and closes. A timestamp trailer is recorded and left
+   * out. Returns 1 when a message was received, 0 when none is ready and -1
+   * on error, with `parts` left empty.
+   */
+
+  int
+  Socket::ReceiveParts(std::vector<zmq_msg_t*> &parts) {
+    int events;
+    size_t events_size = sizeof(events);
+    int64_t more = 1;
+    size_t more_size = sizeof(more);
+
+    while (parts.empty()) {
+      while (zmq_getsockopt(socket_, ZMQ_EVENTS, &events, &events_size)) {
         if (zmq_errno() != EINTR)
-          return Nan::ThrowError(ErrorMessage());
+          return -1;
+      }
+
+      if ((events & ZMQ_POLLIN) == 0)
+        return 0;
+
+      more = 1;
+      while (more == 1) {
+        zmq_msg_t *part = new zmq_msg_t;
+        if (zmq_msg_init(part) < 0) {
+          delete part;
+          ConflatedMessages::Close(parts);
+          return -1;
+        }
+        parts.push_back(part);
+
+        if (RecvPart(part) < 0) {
+          int err = zmq_errno();
+          ConflatedMessages::Close(parts);
+          errno = err;
+          return -1;
+        }
+
+        // filtered messages don't count, the loop reads the next one
+        if (parts.size() == 1 && Filtered(part)) {
+          ConflatedMessages::Close(parts);
+          break;
+        }
+
+        while (zmq_getsockopt(socket_, ZMQ_RCVMORE, &more, &more_size)) {
+          if (zmq_errno() != EINTR) {
+            ConflatedMessages::Close(parts);
+            return -1;
+          }
+        }
+
+        if (trailer_ && more != 1 && TakeTrailer(part, parts.size() - 1)) {
+          zmq_msg_close(part);
+          delete part;
+          parts.pop_back();
+        }
       }
     }
 
-    info.GetReturnValue().Set(result);
+    return 1;
+  }
+
+  /*
+   * readConflated(max) reads up to `max` messages and returns an array of
+   * part arrays holding only the latest message for every distinct first
+   * part. During a burst a slow subscriber so gets one message per changed
+   * topic rather than every stale one in between. An empty array means the
+   * socket ran dry, which also re-arms the edge-triggered ZMQ_FD watcher.
+   * The array's `read` holds the number of messages read from ØMQ, and an
+   * error that cut the read short is its `error` rather than thrown.
+   */
+
+  NAN_METHOD(Socket::ReadConflated) {
+    if (info.Length() != 1 || !info[0]->IsNumber())
+      return Nan::ThrowTypeError("Must pass the maximum number of messages");
+    int64_t max = Nan::To<int64_t>(info[0]).FromJust();
+    if (max < 1)
+      return Nan::ThrowRangeError("Maximum number of messages must be positive");
+
+    Socket* socket = GetSocket(info);
+    if (socket->state_ != STATE_READY)
+      return;
+
+    // an error after some messages were read comes along with them
+    ConflatedMessages conflated;
+    Local<Value> error;
+    if (socket->ConflateMessages(conflated, max) < 0) {
+      if (conflated.messages.empty())
+        return Nan::ThrowError(ErrorMessage());
+      error = Nan::Error(ErrorMessage());
+    }
+
+    socket->conflated_ += conflated.replaced;
+
+    Local<Array> messages = Nan::New<Array>(static_cast<int>(conflated.messages.size()));
+
+    for (size_t i = 0; i < conflated.messages.size(); i++) {
+      ConflatedMessages::Parts &parts = conflated.messages[i];
+      Local<Array> message = Nan::New<Array>(static_cast<int>(parts.size()));
+
+      for (size_t j = 0; j < parts.size(); j++) {
+        if (socket->decode_ && j == parts.size() - 1) {
+          Nan::Set(message, j, DecodePart(parts[j]));
+          continue;
+        }
+        Nan::Set(message, j, ConflatedMessages::ToBuffer(parts[j]));
+        parts[j] = NULL;  // owned by the Buffer now
+      }
+
+      if (socket->timestamps_) {
+        Nan::Set(message, Nan::New(received_at_symbol),
+                 Nan::New<Number>(static_cast<double>(uv_hrtime()) / 1e6));
+      }
+      Nan::Set(messages, i, message);
+    }
+
+    Nan::Set(messages, Nan::New("read").ToLocalChecked(),
+             Nan::New<Number>(static_cast<double>(conflated.read)));
+    if (!error.IsEmpty())
+      Nan::Set(messages, Nan::New("error").ToLocalChecked(), error);
+    info.GetReturnValue().Set(messages);
+  }
+
+  /*
+   * recvInto(target, offset, index, max) copies up to `max` messages into
+   * the caller owned `target` buffer and describes every part in the `index`
+   * Uint32Array, see CopyMessage. Returns the number of parts described.
+   */
+
+  NAN_METHOD(Socket::RecvInto) {
+    if (info.Length() != 4)
+      return Nan::ThrowError("Must pass a target, an offset, an index and a maximum");
+    if (!Buffer::HasInstance(info[0]))
+      return Nan::ThrowTypeError("Target must be a Buffer or Uint8Array");
+    if (!info[1]->IsNumber())
+      return Nan::ThrowTypeError("Offset must be an integer");
+    if (!info[2]->IsUint32Array())
+      return Nan::ThrowTypeError("Index must be a Uint32Array");
+    if (!info[3]->IsNumber())
+      return Nan::ThrowTypeError("Maximum number of messages must be an integer");
+
+    Local<Object> target = info[0].As<Object>();
+    char *data = Buffer::Data(target);
+    size_t length = Buffer::Length(target);
+
+    int64_t start = Nan::To<int64_t>(info[1]).FromJust();
+    if (start < 0 || static_cast<uint64_t>(start) > length)
+      return Nan::ThrowRangeError("Offset is out of bounds");
+
+    int64_t max = Nan::To<int64_t>(info[3]).FromJust();
+    if (max < 1)
+      return Nan::ThrowRangeError("Maximum number of messages must be positive");
+
+    Nan::TypedArrayContents<uint32_t> index(info[2]);
+    if (index.length() < 3)
+      return Nan::ThrowRangeError("Index must have room for at least one part");
+
+    Socket* socket = GetSocket(info);
+    if (socket->state_ != STATE_READY)
+      return info.GetReturnValue().Set(0);
+
+    size_t offset = static_cast<size_t>(start);
+    uint32_t frames = 0;
+
+    for (int64_t messages = 0; messages < max; messages++) {
+      // a new message needs room for at least one part
+      if (messages > 0 && (offset >= length || (frames + 1) * 3 > index.length()))
+        break;
+
+      int rc = socket->CopyMessage(data, length, offset, *index, index.length(), frames);
+      if (rc < 0)
+        return Nan::ThrowError(ErrorMessage());
+      if (rc == 2 && frames == 0)
+        return Nan::ThrowRangeError("Index has no room for all parts of the next message");
+      if (rc != 1)
+        break;
+    }
+
+    info.GetReturnValue().Set(frames);
   }
 
   NAN_METHOD(Socket::Recv) {
@@ -1176,6 +3811,12 @@ namespace zmq {
 
     GET_SOCKET(info);
 
+    if (socket->HasHeld()) {
+      zmq_msg_t *part = socket->held_->front();
+      socket->held_->erase(socket->held_->begin());
+      return info.GetReturnValue().Set(ConflatedMessages::ToBuffer(part));
+    }
+
     IncomingMessage msg;
     while (true) {
       int rc;
@@ -1193,6 +3834,7 @@ namespace zmq {
         break;
       }
     }
+    socket->traffic_ += zmq_msg_size(msg);
     info.GetReturnValue().Set(msg.GetBuffer());
   }
 
@@ -1255,32 +3897,151 @@ namespace zmq {
     BufferReference* bufref_;
   };
 
-  NAN_METHOD(Socket::Sendv) {
-    Socket* socket = GetSocket(info);
-    if (socket->state_ != STATE_READY)
-      return info.GetReturnValue().Set(false);
+  /*
+   * Initialises `msg` with a copy of `part`, which is either a Buffer or an
+   * array of Buffers that are gathered into a single frame. A gathered frame
+   * is sized once and every piece is copied straight into it, so callers do
+   * not have to Buffer.concat() first.
+   */
+
+  static int
+  InitOutgoingMessage(zmq_msg_t *msg, Local<Value> part) {
+    if (!part->IsArray()) {
+      Local<Object> buf = part.As<Object>();
+      size_t len = Buffer::Length(buf);
+
+      if (zmq_msg_init_size(msg, len) != 0)
+        return -1;
+
+      char * cp = static_cast<char *>(zmq_msg_data(msg));
+      const char * dat = Buffer::Data(buf);
+      std::copy(dat, dat + len, cp);
+      return 0;
+    }
+
+    Local<Array> pieces = part.As<Array>();
+    uint32_t count = pieces->Length();
+    size_t len = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+      len += Buffer::Length(Nan::Get(pieces, i).ToLocalChecked().As<Object>());
+    }
+
+    if (zmq_msg_init_size(msg, len) != 0)
+      return -1;
 
+    char * cp = static_cast<char *>(zmq_msg_data(msg));
+    for (uint32_t i = 0; i < count; i++) {
+      Local<Object> piece = Nan::Get(pieces, i).ToLocalChecked().As<Object>();
+      const char * dat = Buffer::Data(piece);
+      size_t piece_len = Buffer::Length(piece);
+      std::copy(dat, dat + piece_len, cp);
+      cp += piece_len;
+    }
+    return 0;
+  }
+
+  static size_t
+  PartBytes(Local<Value> part) {
+    if (!part->IsArray())
+      return Buffer::Length(part.As<Object>());
+
+    Local<Array> pieces = part.As<Array>();
+    size_t len = 0;
+    for (uint32_t i = 0; i < pieces->Length(); i++) {
+      len += Buffer::Length(Nan::Get(pieces, i).ToLocalChecked().As<Object>());
+    }
+    return len;
+  }
+
+  // size of the message starting at `i` in a buf, flags, ... batch
+  static size_t
+  MessageBytes(Local<Array> batch, uint32_t i) {
+    uint32_t len = batch->Length();
+    size_t bytes = 0;
+
+    for (; i < len; i += 2) {
+      bytes += PartBytes(Nan::Get(batch, i).ToLocalChecked());
+      if ((Nan::To<int>(Nan::Get(batch, i + 1).ToLocalChecked()).FromJust() & ZMQ_SNDMORE) == 0)
+        break;
+    }
+    return bytes;
+  }
+
+#if ZMQ_CAN_THREADSAFE
+  // routes `msg` to the routing id or group in `address`
+  int
+  Socket::SetAddress(zmq_msg_t *msg, Local<Value> address) {
+    const unsigned char *data =
+      reinterpret_cast<const unsigned char *>(Buffer::Data(address.As<Object>()));
+    size_t len = Buffer::Length(address.As<Object>());
+
+    if (addressing_ == ADDRESS_ROUTING_ID) {
+      if (len != 4) {
+        errno = EINVAL;
+        return -1;
+      }
+      uint32_t id = data[0] | (data[1] << 8) | (data[2] << 16)
+                  | (static_cast<uint32_t>(data[3]) << 24);
+      return zmq_msg_set_routing_id(msg, id);
+    }
+
+    std::string group(reinterpret_cast<const char *>(data), len);
+    return zmq_msg_set_group(msg, group.c_str());
+  }
+#endif
+
+  /*
+   * Sends the buf, flags, buf, flags, ... pairs in `batch`, which may hold
+   * any number of complete messages. Room for the first message is checked
+   * with ZMQ_EVENTS. On ØMQ 4 every following message probes for room with
+   * ZMQ_DONTWAIT instead, so a whole queue goes out in one call without a
+   * getsockopt per message. `sent` receives the number of complete messages
+   * sent. Returns 1 when everything was sent, 0 when the socket stopped
+   * accepting messages and -1 on error.
+   *
+   * On SERVER and RADIO sockets a message is two parts, the routing id as
+   * a 4 byte little endian integer or the group, and the single frame that
+   * goes to it.
+   */
+
+  int
+  Socket::SendBatch(Local<Array> batch, uint32_t &sent) {
     int events;
     size_t events_size = sizeof(events);
     bool checkPollOut = true;
     bool readsReady = false;
+    bool messageStart = true;
 
     int rc;
+    uint32_t len = batch->Length();
+    size_t paced = 0;
+    size_t bytes = 0;
+
+    sent = 0;
+
+    for (uint32_t i = 0; i < len; i += 2) {
+      bool checked = checkPollOut;
+      uint32_t first = i;
+
+      if (pacer_ != NULL && messageStart) {
+        paced = MessageBytes(batch, i);
+        uint64_t wait = pacer_->Wait(paced);
+        if (wait > 0) {
+          SchedulePace(wait);
+          ZMQ_PROBE2(paced, this, wait);
+          ZMQ_TRACE('I', "paced", "sent", sent, "wait", wait);
+          if (readsReady) {
+            NotifyReadReady();
+          }
+          return 0;
+        }
+      }
 
-    Local<Array> batch = info[0].As<Array>();
-    size_t len = batch->Length();
-
-    if (len == 0)
-      return info.GetReturnValue().Set(true);
-
-    if (len % 2 != 0)
-      return Nan::ThrowTypeError("Batch length must be even!");
-
-    for (size_t i = 0; i < len; i += 2) {
       if (checkPollOut) {
-        while (zmq_getsockopt(socket->socket_, ZMQ_EVENTS, &events, &events_size)) {
+        while (zmq_getsockopt(socket_, ZMQ_EVENTS, &events, &events_size)) {
           if (zmq_errno() != EINTR)
-            return Nan::ThrowError(ErrorMessage());
+            return -1;
         }
 
         if ((events & ZMQ_POLLIN) != 0) {
@@ -1288,51 +4049,113 @@ namespace zmq {
         }
 
         if ((events & ZMQ_POLLOUT) == 0) {
+          ZMQ_PROBE3(blocked, this, sent, bytes);
+          ZMQ_TRACE('I', "blocked", "sent", sent, "bytes", bytes);
           if (readsReady) {
-            socket->NotifyReadReady();
+            NotifyReadReady();
           }
-          return info.GetReturnValue().Set(false);
+          return 0;
+        }
+      }
+
+    #if ZMQ_CAN_THREADSAFE
+      Local<Value> address;
+      if (addressing_ != ADDRESS_NONE && messageStart) {
+        address = Nan::Get(batch, i).ToLocalChecked();
+        i += 2;
+        if (i >= len) {
+          errno = EINVAL;
+          return -1;
         }
       }
+    #endif
 
-      Local<Object> buf = batch->Get(i).As<Object>();
-      Local<Number> flagsObj = batch->Get(i + 1).As<Number>();
+      Local<Value> part = Nan::Get(batch, i).ToLocalChecked();
+      Local<Value> flagsObj = Nan::Get(batch, i + 1).ToLocalChecked();
 
       int flags = Nan::To<int>(flagsObj).FromJust();
-      size_t len = Buffer::Length(buf);
+
+    #if ZMQ_VERSION_MAJOR >= 4
+      bool probe = messageStart && !checked;
+      if (probe) {
+        flags |= ZMQ_DONTWAIT;
+      }
+    #endif
+
+      // a timestamp trailer becomes the message's real last part
+      int send_flags = flags;
+      if (trailer_ && (flags & ZMQ_SNDMORE) == 0) {
+        send_flags |= ZMQ_SNDMORE;
+      }
 
       zmq_msg_t msg;
-      rc = zmq_msg_init_size(&msg, len);
+      rc = InitOutgoingMessage(&msg, part);
       if (rc != 0)
-        return Nan::ThrowError(ErrorMessage());
-
-      char * cp = static_cast<char *>(zmq_msg_data(&msg));
-      const char * dat = Buffer::Data(buf);
-      std::copy(dat, dat + len, cp);
+        return -1;
+      size_t size = zmq_msg_size(&msg);
+
+    #if ZMQ_CAN_THREADSAFE
+      if (!address.IsEmpty() && SetAddress(&msg, address) < 0) {
+        int err = zmq_errno();
+        zmq_msg_close(&msg);
+        errno = err;
+        return -1;
+      }
+    #endif
 
       while (true) {
-        int rc;
       #if ZMQ_VERSION_MAJOR == 2
-        rc = zmq_send(socket->socket_, &msg, flags);
+        rc = zmq_send(socket_, &msg, send_flags);
       #elif ZMQ_VERSION_MAJOR == 3
-        rc = zmq_sendmsg(socket->socket_, &msg, flags);
+        rc = zmq_sendmsg(socket_, &msg, send_flags);
       #else
-        rc = zmq_msg_send(&msg, socket->socket_, flags);
+        rc = zmq_msg_send(&msg, socket_, send_flags);
         checkPollOut = false;
       #endif
-        if (rc < 0){
+        if (rc < 0) {
           if (zmq_errno() == EINTR) {
             continue;
           }
-          return Nan::ThrowError(ErrorMessage());
+          int err = zmq_errno();
+          zmq_msg_close(&msg);
+        #if ZMQ_VERSION_MAJOR >= 4
+          if (err == EAGAIN && probe) {
+            // no room for this message, let ZMQ_EVENTS decide on the retry
+            break;
+          }
+        #endif
+          errno = err;
+          return -1;
         }
         break;
       }
+
+      if (rc < 0) {
+        checkPollOut = true;
+        i = first - 2;
+        continue;
+      }
+
+      if (send_flags != flags && SendTrailer(flags) < 0)
+        return -1;
+
+      bytes += size;
+      traffic_ += size;
+
+      messageStart = (flags & ZMQ_SNDMORE) == 0;
+      if (messageStart) {
+        sent++;
+        if (pacer_ != NULL)
+          pacer_->Consume(paced);
+      }
     }
 
-    while (zmq_getsockopt(socket->socket_, ZMQ_EVENTS, &events, &events_size)) {
+    ZMQ_PROBE3(send, this, sent, bytes);
+    ZMQ_TRACE('I', "send", "messages", sent, "bytes", bytes);
+
+    while (zmq_getsockopt(socket_, ZMQ_EVENTS, &events, &events_size)) {
       if (zmq_errno() != EINTR)
-        return Nan::ThrowError(ErrorMessage());
+        return -1;
     }
 
     if ((events & ZMQ_POLLIN) != 0) {
@@ -1340,10 +4163,59 @@ namespace zmq {
     }
 
     if (readsReady) {
-      socket->NotifyReadReady();
+      NotifyReadReady();
+    }
+
+    return 1;
+  }
+
+  NAN_METHOD(Socket::Sendv) {
+    Socket* socket = GetSocket(info);
+    if (socket->state_ != STATE_READY)
+      return info.GetReturnValue().Set(false);
+
+    Local<Array> batch = info[0].As<Array>();
+    uint32_t len = batch->Length();
+
+    if (len == 0)
+      return info.GetReturnValue().Set(true);
+
+    if (len % 2 != 0)
+      return Nan::ThrowTypeError("Batch length must be even!");
+
+    uint32_t sent;
+    int rc = socket->SendBatch(batch, sent);
+    if (rc < 0)
+      return Nan::ThrowError(ErrorMessage());
+
+    return info.GetReturnValue().Set(rc == 1);
+  }
+
+  /*
+   * Like sendv, but for a batch holding several complete messages. Returns
+   * the number of messages sent before the socket stopped accepting more.
+   * On error the thrown Error carries that number as `sent`.
+   */
+
+  NAN_METHOD(Socket::SendMany) {
+    Socket* socket = GetSocket(info);
+    if (socket->state_ != STATE_READY)
+      return info.GetReturnValue().Set(0);
+
+    Local<Array> batch = info[0].As<Array>();
+    uint32_t len = batch->Length();
+
+    if (len % 2 != 0)
+      return Nan::ThrowTypeError("Batch length must be even!");
+
+    uint32_t sent = 0;
+    if (len > 0 && socket->SendBatch(batch, sent) < 0) {
+      Local<Value> error = ExceptionFromError();
+      Nan::Set(error.As<Object>(), Nan::New("sent").ToLocalChecked(), Nan::New<Integer>(sent));
+      return Nan::ThrowError(error);
     }
 
-    return info.GetReturnValue().Set(true);
+    return info.GetReturnValue().Set(sent);
   }
 
   // WARNING: the buffer passed here will be kept alive
@@ -1399,6 +4271,7 @@ namespace zmq {
         break;
       }
     }
+    socket->traffic_ += len;
 #endif // zero copy / copying version
 
     return;
@@ -1414,18 +4287,36 @@ namespace zmq {
   void
   Socket::Close() {
     if (socket_) {
+    #if ZMQ_CAN_MONITOR
+      // the monitor socket would keep zmq_term waiting
+      Unmonitor();
+    #endif
+    #if ZMQ_CAN_THREADSAFE
+      if (poller_ != NULL)
+        zmq_poller_destroy(&poller_);
+    #endif
       if (zmq_close(socket_) < 0)
         throw std::runtime_error(ErrorMessage());
       socket_ = NULL;
       state_ = STATE_CLOSED;
+      owner_->sockets_--;
       context_.Reset();
 
       if (this->endpoints > 0)
         this->Unref();
       this->endpoints = 0;
 
+      if (held_ != NULL)
+        ConflatedMessages::Close(*held_);
+
       uv_poll_stop(poll_handle_);
       uv_close(reinterpret_cast<uv_handle_t*>(poll_handle_), on_uv_close);
+
+      if (pace_timer_ != NULL) {
+        uv_timer_stop(pace_timer_);
+        uv_close(reinterpret_cast<uv_handle_t*>(pace_timer_), on_uv_close);
+        pace_timer_ = NULL;
+      }
     }
   }
 
@@ -1435,6 +4326,592 @@ namespace zmq {
     return;
   }
 
+#if ZMQ_CAN_SHM
+  /*
+   * Ring of whole messages in a memory mapped file, shared by the processes
+   * on one host. Any number of writers claim the record at `head` by a
+   * compare and swap on its header word, which names the writer's pid and
+   * the record's size, then move `head` past it. Writers that find a claim
+   * at `head` move `head` on for its owner, so a writer that dies in
+   * between stops nobody. The owner copies the message in and commits it by
+   * swapping the header word last. The single reader consumes committed
+   * messages in claim order and marks the space free for the next lap
+   * around the ring. A claim that stays uncommitted because its owner died,
+   * or stalled for longer than STALE_NS, is skipped; a stalled writer that
+   * comes back finds its claim gone and writes the message again. Writers
+   * must share the reader's pid namespace. A message that would wrap is
+   * preceded by a pad record.
+   *
+   * The reader only sleeps after announcing it in `sleeping`; the writer
+   * that commits next takes the flag and writes a byte to a named pipe the
+   * reader polls, so a busy ring costs no system calls at all.
+   */
+
+  class SharedRing {
+    public:
+      static const uint32_t MAGIC = 0x7a6d7173;  // "zmqs"
+      static const size_t HEADER_SIZE = 256;
+      static const uint32_t COMMITTED = 1;
+      static const uint32_t PAD = 2;
+      static const uint32_t CLAIMED = 4;          // the owner's pid is in bits 8-31
+      static const uint64_t DEAD_CHECK_NS = 1000000;  // claim age before its owner is looked up
+      static const uint64_t STALE_NS = 1000000000;    // claim age before it is skipped anyway
+
+      struct Header {
+        uint32_t magic;
+        uint32_t closed;
+        uint64_t capacity;
+        char pad0[48];
+        volatile uint64_t head;      // claimed by writers
+        char pad1[56];
+        volatile uint64_t tail;      // consumed by the reader
+        volatile uint32_t sleeping;  // the reader waits for a wakeup
+        char pad2[52];
+      };
+
+      inline SharedRing()
+        : header_(NULL), data_(NULL), size_(0), fd_(-1), wake_fd_(-1),
+          mask_(0), shift_(0), pid_(0), owner_(false),
+          stalled_at_(~static_cast<uint64_t>(0)), stalled_since_(0) {}
+
+      inline ~SharedRing() { Close(); }
+
+      // returns 0 or an errno value
+      int Create(const char* path, const char* wake_path, uint64_t capacity) {
+        if (capacity < 4096 || (capacity & (capacity - 1)))
+          return EINVAL;
+
+        CloseStale(path);
+        unlink(path);
+        fd_ = open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd_ < 0 || ftruncate(fd_, HEADER_SIZE + capacity) < 0)
+          return Fail();
+        int rc = Map(HEADER_SIZE + capacity);
+        if (rc)
+          return rc;
+        path_ = path;
+
+        header_->closed = 0;
+        header_->capacity = capacity;
+        header_->head = 0;
+        header_->tail = 0;
+        header_->sleeping = 1;  // nothing read yet, the first write wakes us
+        __sync_synchronize();
+        header_->magic = MAGIC;
+        SetCapacity(capacity);
+
+        unlink(wake_path);
+        if (mkfifo(wake_path, 0600) < 0)
+          return Fail();
+        wake_path_ = wake_path;
+        owner_ = true;
+        // read and write, so the pipe never reports end of file
+        wake_fd_ = open(wake_path, O_RDWR | O_NONBLOCK);
+        return wake_fd_ < 0 ? Fail() : 0;
+      }
+
+      /*
+       * Marks a ring left behind by an earlier reader closed, so writers
+       * that still map it get ECONNRESET and reopen the path instead of
+       * filling a ring nobody reads.
+       */
+      static void CloseStale(const char* path) {
+        struct stat st;
+        int fd = open(path, O_RDWR);
+        if (fd < 0)
+          return;
+        if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) > HEADER_SIZE) {
+          void* at = mmap(NULL, HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+          if (at != MAP_FAILED) {
+            Header* header = static_cast<Header*>(at);
+            if (header->magic == MAGIC) {
+              header->closed = 1;
+              __sync_synchronize();
+            }
+            munmap(at, HEADER_SIZE);
+          }
+        }
+        close(fd);
+      }
+
+      int Open(const char* path, const char* wake_path) {
+        struct stat st;
+        fd_ = open(path, O_RDWR);
+        if (fd_ < 0 || fstat(fd_, &st) < 0)
+          return Fail();
+        if (static_cast<size_t>(st.st_size) <= HEADER_SIZE) {
+          Close();
+          return EPROTO;
+        }
+        int rc = Map(st.st_size);
+        if (rc)
+          return rc;
+        if (header_->magic != MAGIC || header_->capacity + HEADER_SIZE != size_) {
+          Close();
+          return EPROTO;
+        }
+        SetCapacity(header_->capacity);
+        pid_ = static_cast<uint32_t>(getpid());
+
+        wake_fd_ = open(wake_path, O_RDWR | O_NONBLOCK);
+        return wake_fd_ < 0 ? Fail() : 0;
+      }
+
+      void Close() {
+        // a reader that took over the path owns the files now
+        bool unlink_files = owner_ && StillAtPath();
+        if (header_ != NULL) {
+          if (owner_)
+            header_->closed = 1;
+          munmap(header_, size_);
+          header_ = NULL;
+        }
+        if (fd_ >= 0)
+          close(fd_);
+        if (wake_fd_ >= 0)
+          close(wake_fd_);
+        fd_ = wake_fd_ = -1;
+        if (unlink_files) {
+          unlink(path_.c_str());
+          unlink(wake_path_.c_str());
+        }
+        owner_ = false;
+      }
+
+      /*
+       * Copies `count` frames into the ring as one message. Returns 1 when
+       * it was committed, 0 when the ring is full and -1 when the reader
+       * went away.
+       */
+      int Write(const char* const* frames, const size_t* lens, size_t count) {
+        if (header_->closed)
+          return -1;
+
+        uint64_t body = 4;
+        for (size_t i = 0; i < count; i++)
+          body += 4 + lens[i];
+        uint64_t need = 8 + ((body + 7) & ~static_cast<uint64_t>(7));
+        uint64_t capacity = mask_ + 1;
+        uint64_t pos;
+
+        uint64_t claim = Word(CLAIMED | (pid_ & 0xffffff) << 8, static_cast<uint32_t>(need));
+
+        for (;;) {
+          uint64_t head = header_->head;
+          uint64_t tail = header_->tail;
+          uint64_t offset = head & mask_;
+          uint64_t size = need, word = claim;
+
+          if (offset + need > capacity) {
+            // the message doesn't fit before the end, pad it out first
+            size = capacity - offset;
+            word = Word(PAD | COMMITTED, 0);
+          }
+          if (head + size - tail > capacity)
+            return 0;
+
+          // pairs with the barrier in Consume
+          __sync_synchronize();
+          volatile uint64_t* at = reinterpret_cast<volatile uint64_t*>(data_ + offset);
+          uint64_t seen = *at;
+          if (seen != Free(head)) {
+            // claimed by a writer that hasn't moved head yet, or died first
+            if (seen >> 32)
+              __sync_bool_compare_and_swap(&header_->head, head, head + Size(seen, offset));
+            continue;
+          }
+          if (!__sync_bool_compare_and_swap(at, seen, word))
+            continue;
+          // unless another writer already did it for us
+          __sync_bool_compare_and_swap(&header_->head, head, head + size);
+          if (size == need) {
+            pos = offset;
+            break;
+          }
+        }
+
+        char* out = data_ + pos + 8;
+        uint32_t n = static_cast<uint32_t>(count);
+        memcpy(out, &n, 4);
+        out += 4;
+        for (size_t i = 0; i < count; i++) {
+          uint32_t len = static_cast<uint32_t>(lens[i]);
+          memcpy(out, &len, 4);
+          memcpy(out + 4, frames[i], lens[i]);
+          out += 4 + lens[i];
+        }
+        __sync_synchronize();
+        if (!__sync_bool_compare_and_swap(reinterpret_cast<volatile uint64_t*>(data_ + pos),
+              claim, Word(COMMITTED, static_cast<uint32_t>(body))))
+          return 0;  // stalled for so long the reader skipped it, try again
+
+        // pairs with the barrier in Sleep
+        __sync_synchronize();
+        if (header_->sleeping && __sync_bool_compare_and_swap(&header_->sleeping, 1, 0)) {
+          char c = 1;
+          while (write(wake_fd_, &c, 1) < 0 && errno == EINTR) {}
+        }
+        return 1;
+      }
+
+      // largest message body the ring can hold
+      inline uint64_t MaxBody() const { return mask_ + 1 - 16; }
+
+      // the next committed message body, NULL when there is none
+      const char* Peek(uint32_t* len) {
+        for (;;) {
+          uint64_t tail = header_->tail;
+          char* rec = data_ + (tail & mask_);
+          uint64_t word = *reinterpret_cast<volatile uint64_t*>(rec);
+          uint32_t flags = static_cast<uint32_t>(word >> 32);
+          if ((flags & COMMITTED) == 0) {
+            if ((flags & CLAIMED) == 0 || !Abandoned(tail, flags >> 8))
+              return NULL;
+            // take the claim away first, so a stalled owner can't commit it
+            if (__sync_bool_compare_and_swap(reinterpret_cast<volatile uint64_t*>(rec), word, 0))
+              Consume(static_cast<uint32_t>(word));
+            continue;
+          }
+          __sync_synchronize();
+          if ((flags & PAD) == 0) {
+            *len = static_cast<uint32_t>(word);
+            return rec + 8;
+          }
+          Consume(mask_ + 1 - (tail & mask_));
+        }
+      }
+
+      // consume the message Peek returned
+      inline void Release(uint32_t len) {
+        Consume(8 + ((static_cast<uint64_t>(len) + 7) & ~static_cast<uint64_t>(7)));
+      }
+
+      // announce the reader is going to wait, false if a message came in
+      bool Sleep() {
+        header_->sleeping = 1;
+        __sync_synchronize();
+        uint32_t len;
+        if (Peek(&len) == NULL)
+          return true;
+        header_->sleeping = 0;
+        return false;
+      }
+
+      // swallow the wakeups the pipe collected
+      void Drain() {
+        char buf[64];
+        while (read(wake_fd_, buf, sizeof(buf)) > 0) {}
+      }
+
+      inline uint64_t Used() const { return header_->head - header_->tail; }
+      inline int wake_fd() const { return wake_fd_; }
+
+    private:
+      bool StillAtPath() {
+        struct stat ours, current;
+        return fd_ >= 0 && fstat(fd_, &ours) == 0
+          && stat(path_.c_str(), &current) == 0
+          && ours.st_dev == current.st_dev && ours.st_ino == current.st_ino;
+      }
+
+      int Map(size_t size) {
+        void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (map == MAP_FAILED)
+          return Fail();
+        header_ = static_cast<Header*>(map);
+        data_ = static_cast<char*>(map) + HEADER_SIZE;
+        size_ = size;
+        return 0;
+      }
+
+      int Fail() {
+        int err = errno;
+        Close();
+        return err;
+      }
+
+      inline void SetCapacity(uint64_t capacity) {
+        mask_ = capacity - 1;
+        for (shift_ = 0; (static_cast<uint64_t>(1) << shift_) < capacity; shift_++) {}
+      }
+
+      static inline uint64_t Word(uint32_t flags, uint32_t len) {
+        return (static_cast<uint64_t>(flags) << 32) | len;
+      }
+
+      // a free header word holds the lap around the ring it is free for
+      inline uint64_t Free(uint64_t pos) const {
+        return static_cast<uint32_t>(pos >> shift_);
+      }
+
+      // bytes taken by the record whose header word is `word`
+      inline uint64_t Size(uint64_t word, uint64_t offset) const {
+        uint32_t flags = static_cast<uint32_t>(word >> 32);
+        if (flags & PAD)
+          return mask_ + 1 - offset;
+        if (flags & COMMITTED)
+          return 8 + ((static_cast<uint64_t>(static_cast<uint32_t>(word)) + 7) & ~static_cast<uint64_t>(7));
+        return static_cast<uint32_t>(word);
+      }
+
+      // whether the claim at `tail` will never be committed
+      bool Abandoned(uint64_t tail, uint32_t pid) {
+        uint64_t now = uv_hrtime();
+        if (stalled_at_ != tail) {
+          stalled_at_ = tail;
+          stalled_since_ = now;
+          return false;
+        }
+        uint64_t age = now - stalled_since_;
+        if (age >= STALE_NS)
+          return true;
+        return age >= DEAD_CHECK_NS && kill(static_cast<pid_t>(pid), 0) < 0 && errno == ESRCH;
+      }
+
+      inline void Consume(uint64_t size) {
+        uint64_t tail = header_->tail;
+        uint64_t* words = reinterpret_cast<uint64_t*>(data_ + (tail & mask_));
+        uint64_t free = Free(tail + mask_ + 1);
+        for (uint64_t i = 0; i < size / 8; i++)
+          words[i] = free;
+        __sync_synchronize();
+        header_->tail = tail + size;
+      }
+
+      Header* header_;
+      char* data_;
+      size_t size_;
+      int fd_;
+      int wake_fd_;
+      uint64_t mask_;
+      uint32_t shift_;
+      uint32_t pid_;
+      bool owner_;
+      uint64_t stalled_at_;     // tail the reader found an uncommitted claim at
+      uint64_t stalled_since_;
+      std::string path_;
+      std::string wake_path_;
+  };
+
+  /*
+   * JS side of a SharedRing. new ShmRing(path, wakePath, capacity) creates
+   * the ring and reads from it, calling onReadReady when writers wake it
+   * up. Without a capacity it opens an existing ring for writing.
+   */
+
+  class ShmRing : public Nan::ObjectWrap {
+    public:
+      static NAN_MODULE_INIT(Initialize);
+      virtual ~ShmRing();
+
+    private:
+      ShmRing();
+      void Close();
+      static NAN_METHOD(New);
+      static NAN_METHOD(Write);
+      static NAN_METHOD(ReadMany);
+      static NAN_METHOD(Close);
+      static NAN_METHOD(AttachToEventLoop);
+      static NAN_METHOD(DetachFromEventLoop);
+      static NAN_GETTER(GetUsed);
+      static void UV_PollCallback(uv_poll_t* handle, int status, int events);
+
+      SharedRing ring_;
+      uv_poll_t* poll_handle_;
+      bool open_;
+  };
+
+  NAN_MODULE_INIT(ShmRing::Initialize) {
+    Nan::HandleScope scope;
+
+    Local<FunctionTemplate> t = Nan::New<FunctionTemplate>(New);
+    t->InstanceTemplate()->SetInternalFieldCount(1);
+    Nan::SetAccessor(t->InstanceTemplate(),
+      Nan::New("used").ToLocalChecked(), GetUsed);
+
+    Nan::SetPrototypeMethod(t, "write", Write);
+    Nan::SetPrototypeMethod(t, "readMany", ReadMany);
+    Nan::SetPrototypeMethod(t, "close", Close);
+    Nan::SetPrototypeMethod(t, "ref", AttachToEventLoop);
+    Nan::SetPrototypeMethod(t, "unref", DetachFromEventLoop);
+
+    Nan::Set(target, Nan::New("ShmRing").ToLocalChecked(), Nan::GetFunction(t).ToLocalChecked());
+  }
+
+  ShmRing::ShmRing() : Nan::ObjectWrap(), poll_handle_(NULL), open_(false) {}
+
+  ShmRing::~ShmRing() {
+    Close();
+  }
+
+  void
+  ShmRing::Close() {
+    if (!open_)
+      return;
+    open_ = false;
+    if (poll_handle_ != NULL) {
+      uv_poll_stop(poll_handle_);
+      uv_close(reinterpret_cast<uv_handle_t*>(poll_handle_), on_uv_close);
+      poll_handle_ = NULL;
+      this->Unref();
+    }
+    ring_.Close();
+  }
+
+  #define GET_RING(info)                                                \
+    ShmRing* ring = Nan::ObjectWrap::Unwrap<ShmRing>(info.Holder());    \
+    if (!ring->open_)                                                   \
+      return Nan::ThrowTypeError("Ring is closed");
+
+  NAN_METHOD(ShmRing::New) {
+    assert(info.IsConstructCall());
+
+    if (!info[0]->IsString() || !info[1]->IsString())
+      return Nan::ThrowTypeError("Must pass the ring and wakeup paths");
+
+    Nan::Utf8String path(info[0]);
+    Nan::Utf8String wake_path(info[1]);
+    double capacity = info[2]->IsNumber() ? Nan::To<double>(info[2]).FromJust() : 0;
+
+    ShmRing* ring = new ShmRing();
+    ring->Wrap(info.This());
+
+    int rc = capacity > 0
+      ? ring->ring_.Create(*path, *wake_path, static_cast<uint64_t>(capacity))
+      : ring->ring_.Open(*path, *wake_path);
+    if (rc)
+      return Nan::ThrowError(Nan::ErrnoException(rc, "open", NULL, *path));
+    ring->open_ = true;
+
+    if (capacity > 0) {
+      ring->poll_handle_ = new uv_poll_t;
+      ring->poll_handle_->data = ring;
+      uv_poll_init(uv_default_loop(), ring->poll_handle_, ring->ring_.wake_fd());
+      uv_poll_start(ring->poll_handle_, UV_READABLE, ShmRing::UV_PollCallback);
+      ring->Ref();
+    }
+
+    info.GetReturnValue().Set(info.This());
+  }
+
+  void
+  ShmRing::UV_PollCallback(uv_poll_t* handle, int status, int events) {
+    if (status != 0)
+      return;
+    ShmRing* ring = static_cast<ShmRing*>(handle->data);
+    ring->ring_.Drain();
+
+    Nan::HandleScope scope;
+    Local<Value> callback_v = Nan::Get(ring->handle(), Nan::New(read_callback_symbol)).ToLocalChecked();
+    if (callback_v->IsFunction())
+      Nan::MakeCallback(ring->handle(), callback_v.As<Function>(), 0, NULL);
+  }
+
+  /*
+   * write(content) takes one message as a flat [buf, flags, ...] array like
+   * sendv and returns false when the ring is full.
+   */
+
+  NAN_METHOD(ShmRing::Write) {
+    GET_RING(info);
+
+    if (!info[0]->IsArray())
+      return Nan::ThrowTypeError("Must pass an Array");
+    Local<Array> content = info[0].As<Array>();
+    uint32_t count = content->Length() / 2;
+
+    std::vector<const char*> frames(count);
+    std::vector<size_t> lens(count);
+    uint64_t body = 4;
+    for (uint32_t i = 0; i < count; i++) {
+      Local<Value> buf = Nan::Get(content, i * 2).ToLocalChecked();
+      if (!Buffer::HasInstance(buf))
+        return Nan::ThrowTypeError("Message parts must be Buffers");
+      frames[i] = Buffer::Data(buf);
+      lens[i] = Buffer::Length(buf);
+      body += 4 + lens[i];
+    }
+    if (body > ring->ring_.MaxBody())
+      return Nan::ThrowRangeError("Message is larger than the ring");
+
+    int rc = ring->ring_.Write(count ? &frames[0] : NULL, count ? &lens[0] : NULL, count);
+    if (rc < 0)
+      return Nan::ThrowError(Nan::ErrnoException(ECONNRESET, "write", "Reader closed the ring"));
+    info.GetReturnValue().Set(Nan::New<Boolean>(rc > 0));
+  }
+
+  /*
+   * readMany(max, spin) returns up to `max` messages as arrays of Buffers.
+   * An empty ring is watched for up to `spin` microseconds before the
+   * reader goes to sleep, which trades a core for wakeup latency.
+   */
+
+  NAN_METHOD(ShmRing::ReadMany) {
+    GET_RING(info);
+
+    uint32_t max = info[0]->IsNumber() ? Nan::To<uint32_t>(info[0]).FromJust() : 0;
+    uint32_t spin = info[1]->IsNumber() ? Nan::To<uint32_t>(info[1]).FromJust() : 0;
+    if (max == 0)
+      max = 1000;
+
+    Local<Array> messages = Nan::New<Array>();
+    uint32_t n = 0, len;
+    uint64_t spin_until = 0;
+
+    while (n < max) {
+      const char* body = ring->ring_.Peek(&len);
+      if (body == NULL) {
+        if (n == 0 && spin > 0) {
+          uint64_t now = uv_hrtime();
+          if (spin_until == 0)
+            spin_until = now + static_cast<uint64_t>(spin) * 1000;
+          if (now < spin_until)
+            continue;
+        }
+        if (n > 0 || ring->ring_.Sleep())
+          break;
+        continue;
+      }
+
+      uint32_t count, frame_len;
+      memcpy(&count, body, 4);
+      const char* p = body + 4;
+      Local<Array> parts = Nan::New<Array>(count);
+      for (uint32_t i = 0; i < count; i++) {
+        memcpy(&frame_len, p, 4);
+        Nan::Set(parts, i, Nan::CopyBuffer(p + 4, frame_len).ToLocalChecked());
+        p += 4 + frame_len;
+      }
+      ring->ring_.Release(len);
+      Nan::Set(messages, n++, parts);
+    }
+
+    info.GetReturnValue().Set(messages);
+  }
+
+  NAN_METHOD(ShmRing::Close) {
+    GET_RING(info);
+    ring->Close();
+  }
+
+  NAN_METHOD(ShmRing::AttachToEventLoop) {
+    GET_RING(info);
+    if (ring->poll_handle_ != NULL)
+      uv_ref(reinterpret_cast<uv_handle_t*>(ring->poll_handle_));
+  }
+
+  NAN_METHOD(ShmRing::DetachFromEventLoop) {
+    GET_RING(info);
+    if (ring->poll_handle_ != NULL)
+      uv_unref(reinterpret_cast<uv_handle_t*>(ring->poll_handle_));
+  }
+
+  NAN_GETTER(ShmRing::GetUsed) {
+    GET_RING(info);
+    info.GetReturnValue().Set(Nan::New<Number>(static_cast<double>(ring->ring_.Used())));
+  }
+#endif
+
   // Make zeromq versions less than 2.1.3 work by defining
   // the new constants if they don't already exist
   #if (ZMQ_VERSION < 20103)
@@ -1456,6 +4933,91 @@ namespace zmq {
     info.GetReturnValue().Set(Nan::New<String>(version_info).ToLocalChecked());
   }
 
+  /*
+   * encode(value) returns the MessagePack encoding of `value` in a Buffer and
+   * decode(buffer) reverses it. Values are packed into a scratch area that is
+   * kept between calls, so encoding takes a single pass over the value and
+   * one copy into the result. Packing runs getters, which may call encode()
+   * again; such nested calls measure and pack into their own Buffer and
+   * leave the scratch area alone.
+   */
+
+  static const size_t ENCODE_SCRATCH_MAX = 1024 * 1024;
+  static char *encode_scratch = NULL;
+  static size_t encode_scratch_size = 0;
+  static bool encode_scratch_busy = false;
+
+  static bool
+  PackValue(Packer &packer, Local<Value> value) {
+    {
+      Nan::TryCatch tc;
+      if (packer.Pack(value))
+        return true;
+      if (tc.HasCaught()) {
+        tc.ReThrow();
+        return false;
+      }
+    }
+    Nan::ThrowTypeError(packer.error());
+    return false;
+  }
+
+  static NAN_METHOD(Encode) {
+    if (info.Length() != 1)
+      return Nan::ThrowError("Must pass a value to encode");
+
+    bool outer = !encode_scratch_busy;
+    size_t scratch_size = outer ? encode_scratch_size : 0;
+
+    Packer packer(outer ? encode_scratch : NULL, scratch_size);
+    encode_scratch_busy = true;
+    bool packed = PackValue(packer, info[0]);
+    if (outer)
+      encode_scratch_busy = false;
+    if (!packed)
+      return;
+
+    size_t size = packer.size();
+    if (size <= scratch_size) {
+      info.GetReturnValue().Set(Nan::CopyBuffer(encode_scratch, static_cast<uint32_t>(size)).ToLocalChecked());
+      return;
+    }
+
+    // didn't fit, pack again straight into a Buffer of the measured size
+    // and grow the scratch area for next time
+    Local<Object> buf = Nan::NewBuffer(static_cast<uint32_t>(size)).ToLocalChecked();
+    Packer second(Buffer::Data(buf), size);
+    if (!PackValue(second, info[0]))
+      return;
+    if (second.size() != size)
+      return Nan::ThrowError("Value changed while it was being encoded");
+
+    if (outer && size <= ENCODE_SCRATCH_MAX) {
+      size_t grown = encode_scratch_size > 0 ? encode_scratch_size : 256;
+      while (grown < size)
+        grown *= 2;
+      char *scratch = static_cast<char *>(realloc(encode_scratch, grown));
+      if (scratch != NULL) {
+        encode_scratch = scratch;
+        encode_scratch_size = grown;
+      }
+    }
+
+    info.GetReturnValue().Set(buf);
+  }
+
+  static NAN_METHOD(Decode) {
+    if (info.Length() != 1 || !Buffer::HasInstance(info[0]))
+      return Nan::ThrowTypeError("Must pass a Buffer to decode");
+
+    Unpacker unpacker(Buffer::Data(info[0]), Buffer::Length(info[0]));
+    Local<Value> value = unpacker.Unpack();
+    if (value.IsEmpty())
+      return Nan::ThrowError(unpacker.error());
+
+    info.GetReturnValue().Set(value);
+  }
+
 #if ZMQ_VERSION_MAJOR >= 4
    static NAN_METHOD(ZmqCurveKeypair) {
 
@@ -1478,80 +5040,28 @@ namespace zmq {
   static NAN_MODULE_INIT(Initialize) {
     Nan::HandleScope scope;
 
-    opts_int.insert(14); // ZMQ_FD
-    opts_int.insert(16); // ZMQ_TYPE
-    opts_int.insert(17); // ZMQ_LINGER
-    opts_int.insert(18); // ZMQ_RECONNECT_IVL
-    opts_int.insert(19); // ZMQ_BACKLOG
-    opts_int.insert(21); // ZMQ_RECONNECT_IVL_MAX
-    opts_int.insert(23); // ZMQ_SNDHWM
-    opts_int.insert(24); // ZMQ_RCVHWM
-    opts_int.insert(25); // ZMQ_MULTICAST_HOPS
-    opts_int.insert(27); // ZMQ_RCVTIMEO
-    opts_int.insert(28); // ZMQ_SNDTIMEO
-    opts_int.insert(29); // ZMQ_RCVLABEL
-    opts_int.insert(30); // ZMQ_RCVCMD
-    opts_int.insert(31); // ZMQ_IPV4ONLY
-    opts_int.insert(33); // ZMQ_ROUTER_MANDATORY
-    opts_int.insert(34); // ZMQ_TCP_KEEPALIVE
-    opts_int.insert(35); // ZMQ_TCP_KEEPALIVE_CNT
-    opts_int.insert(36); // ZMQ_TCP_KEEPALIVE_IDLE
-    opts_int.insert(37); // ZMQ_TCP_KEEPALIVE_INTVL
-    opts_int.insert(39); // ZMQ_DELAY_ATTACH_ON_CONNECT
-    opts_int.insert(40); // ZMQ_XPUB_VERBOSE
-    opts_int.insert(41); // ZMQ_ROUTER_RAW
-    opts_int.insert(42); // ZMQ_IPV6
-
-    opts_int64.insert(3); // ZMQ_SWAP
-    opts_int64.insert(8); // ZMQ_RATE
-    opts_int64.insert(10); // ZMQ_MCAST_LOOP
-    opts_int64.insert(20); // ZMQ_RECOVERY_IVL_MSEC
-    opts_int64.insert(22); // ZMQ_MAXMSGSIZE
-
-    opts_uint64.insert(1); // ZMQ_HWM
-    opts_uint64.insert(4); // ZMQ_AFFINITY
-
-    opts_binary.insert(5); // ZMQ_IDENTITY
-    opts_binary.insert(6); // ZMQ_SUBSCRIBE
-    opts_binary.insert(7); // ZMQ_UNSUBSCRIBE
-    opts_binary.insert(32); // ZMQ_LAST_ENDPOINT
-    opts_binary.insert(38); // ZMQ_TCP_ACCEPT_FILTER
-
-    // transition types
-    #if ZMQ_VERSION_MAJOR >= 3
-    opts_int.insert(15); // ZMQ_EVENTS 3.x int
-    opts_int.insert(8); // ZMQ_RATE 3.x int
-    opts_int.insert(9); // ZMQ_RECOVERY_IVL 3.x int
-    opts_int.insert(13); // ZMQ_RCVMORE 3.x int
-    opts_int.insert(11); // ZMQ_SNDBUF 3.x int
-    opts_int.insert(12); // ZMQ_RCVBUF 3.x int
-    #else
-    opts_uint32.insert(15); // ZMQ_EVENTS 2.x uint32_t
-    opts_int64.insert(8); // ZMQ_RATE 2.x int64_t
-    opts_int64.insert(9); // ZMQ_RECOVERY_IVL 2.x int64_t
-    opts_int64.insert(13); // ZMQ_RCVMORE 2.x int64_t
-    opts_uint64.insert(11); // ZMQ_SNDBUF 2.x uint64_t
-    opts_uint64.insert(12); // ZMQ_RCVBUF 2.x uint64_t
-    #endif
-
-    #if ZMQ_VERSION_MAJOR >= 4
-    opts_int.insert(43); // ZMQ_MECHANISM
-    opts_int.insert(44); // ZMQ_PLAIN_SERVER
-    opts_binary.insert(45); // ZMQ_PLAIN_USERNAME
-    opts_binary.insert(46); // ZMQ_PLAIN_PASSWORD
-    opts_int.insert(47); // ZMQ_CURVE_SERVER
-    opts_binary.insert(48); // ZMQ_CURVE_PUBLICKEY
-    opts_binary.insert(49); // ZMQ_CURVE_SECRETKEY
-    opts_binary.insert(50); // ZMQ_CURVE_SERVERKEY
-    opts_int.insert(51); //ZMQ_PROBE_ROUTER
-    opts_binary.insert(55); // ZMQ_ZAP_DOMAIN
-    opts_int.insert(66); //ZMQ_HANDSHAKE_IVL
-    #endif
+    InitTracing();
 
     NODE_DEFINE_CONSTANT(target, ZMQ_CAN_DISCONNECT);
     NODE_DEFINE_CONSTANT(target, ZMQ_CAN_UNBIND);
     NODE_DEFINE_CONSTANT(target, ZMQ_CAN_MONITOR);
     NODE_DEFINE_CONSTANT(target, ZMQ_CAN_SET_CTX);
+    NODE_DEFINE_CONSTANT(target, ZMQ_CAN_SHM);
+    NODE_DEFINE_CONSTANT(target, ZMQ_CAN_THREADSAFE);
+    // I/O thread placement, exported only where libzmq knows the option
+    #ifdef ZMQ_THREAD_PRIORITY
+    NODE_DEFINE_CONSTANT(target, ZMQ_THREAD_PRIORITY);
+    #endif
+    #ifdef ZMQ_THREAD_SCHED_POLICY
+    NODE_DEFINE_CONSTANT(target, ZMQ_THREAD_SCHED_POLICY);
+    #endif
+    #ifdef ZMQ_THREAD_AFFINITY_CPU_ADD
+    NODE_DEFINE_CONSTANT(target, ZMQ_THREAD_AFFINITY_CPU_ADD);
+    NODE_DEFINE_CONSTANT(target, ZMQ_THREAD_AFFINITY_CPU_REMOVE);
+    #endif
+    #ifdef ZMQ_THREAD_NAME_PREFIX
+    NODE_DEFINE_CONSTANT(target, ZMQ_THREAD_NAME_PREFIX);
+    #endif
     NODE_DEFINE_CONSTANT(target, ZMQ_PUB);
     NODE_DEFINE_CONSTANT(target, ZMQ_SUB);
     #if ZMQ_VERSION_MAJOR >= 3
@@ -1570,6 +5080,14 @@ namespace zmq {
     #if ZMQ_VERSION_MAJOR >= 4
     NODE_DEFINE_CONSTANT(target, ZMQ_STREAM);
     #endif
+    #if ZMQ_CAN_THREADSAFE
+    NODE_DEFINE_CONSTANT(target, ZMQ_SERVER);
+    NODE_DEFINE_CONSTANT(target, ZMQ_CLIENT);
+    NODE_DEFINE_CONSTANT(target, ZMQ_RADIO);
+    NODE_DEFINE_CONSTANT(target, ZMQ_DISH);
+    NODE_DEFINE_CONSTANT(target, ZMQ_SCATTER);
+    NODE_DEFINE_CONSTANT(target, ZMQ_GATHER);
+    #endif
 
     NODE_DEFINE_CONSTANT(target, ZMQ_POLLIN);
     NODE_DEFINE_CONSTANT(target, ZMQ_POLLOUT);
@@ -1585,12 +5103,17 @@ namespace zmq {
     NODE_DEFINE_CONSTANT(target, STATE_CLOSED);
 
     Nan::SetMethod(target, "zmqVersion", ZmqVersion);
+    Nan::SetMethod(target, "encode", Encode);
+    Nan::SetMethod(target, "decode", Decode);
     #if ZMQ_VERSION_MAJOR >= 4
     Nan::SetMethod(target, "zmqCurveKeypair", ZmqCurveKeypair);
     #endif
 
     Context::Initialize(target);
     Socket::Initialize(target);
+    #if ZMQ_CAN_SHM
+    ShmRing::Initialize(target);
+    #endif
   }
 } // namespace zmq
 
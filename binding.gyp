@@ -66,6 +66,10 @@
           'cflags': [
             '<!(pkg-config libzmq --cflags 2>/dev/null || echo "")',
           ],
+          # USDT probes when systemtap's sys/sdt.h is installed
+          'defines': [
+            '<!(test -f /usr/include/sys/sdt.h && echo ZMQ_HAVE_SDT || echo ZMQ_NO_SDT)',
+          ],
           'libraries': [
             '<!(pkg-config libzmq --libs 2>/dev/null || echo "")',
           ],
@@ -4,7 +4,10 @@
 
 var EventEmitter = require('events').EventEmitter
   , zmq = require('bindings')('zmq.node')
-  , util = require('util');
+  , fs = require('fs')
+  , os = require('os')
+  , util = require('util')
+  , zlib = require('zlib');
 
 /**
  * Expose bindings as the module.
@@ -43,6 +46,13 @@ var types = exports.types = {
   , router: zmq.ZMQ_ROUTER
   , pair: zmq.ZMQ_PAIR
   , stream: zmq.ZMQ_STREAM
+  // thread-safe draft types, undefined unless zmq.ZMQ_CAN_THREADSAFE
+  , server: zmq.ZMQ_SERVER
+  , client: zmq.ZMQ_CLIENT
+  , radio: zmq.ZMQ_RADIO
+  , dish: zmq.ZMQ_DISH
+  , scatter: zmq.ZMQ_SCATTER
+  , gather: zmq.ZMQ_GATHER
 };
 
 var longOptions = {
@@ -171,15 +181,36 @@ function defaultContext() {
     }
   }
 
-  ctx = new zmq.Context(io_threads);
-  process.on('exit', function(){
-    // ctx.close();
-    ctx = null;
-  });
+  var context = new zmq.Context(io_threads);
+
+  // a bad ZMQ_IO_CPUS fails socket creation, like setThreadOptions() would
+  if (process.env.ZMQ_IO_CPUS) {
+    var cpus = process.env.ZMQ_IO_CPUS;
+    try {
+      applyThreadOptions(context, { cpus: 'numa' == cpus ? cpus : cpus.split(',').map(Number) });
+    } catch (err) {
+      context.close();
+      err.message = 'ZMQ_IO_CPUS: ' + err.message;
+      throw err;
+    }
+  }
 
+  ctx = context;
   return ctx;
 };
 
+process.on('exit', function(){
+  // ctx.close(); blocks for the linger of every open socket, see
+  // Context.terminateAsync for a clean shutdown
+  ctx = null;
+
+  // spooled messages don't outlive the process
+  for (var id in spoolFiles) {
+    removeSpoolFiles(spoolFiles[id]);
+  }
+  spoolFiles = {};
+});
+
 /**
  * A batch consists of 1 or more message parts with their flags that need to be sent as one unit
  */
@@ -188,12 +219,19 @@ function OutBatch() {
   this.content = [];      // buf, flags, buf, flags, ...
   this.cbs = [];          // callbacks
   this.isClosed = false;  // true if the last message does not have SNDMORE in its flags, false otherwise
+  this.pending = 0;       // parts still being compressed
+  this.deadline = 0;      // Date.now() after which the batch is dropped, 0 for never
+  this.lane = 0;          // priority lane, see LaneList
   this.next = null;       // next batch (for linked list of batches)
 }
 
 OutBatch.prototype.append = function (buf, flags, cb) {
   if (!Buffer.isBuffer(buf)) {
-    buf = new Buffer(String(buf), 'utf8');
+    if (buf && Array.isArray(buf.gather)) {
+      buf = toBuffers(buf.gather);  // joined into one frame by the binding
+    } else {
+      buf = new Buffer(String(buf), 'utf8');
+    }
   }
 
   this.content.push(buf, flags);
@@ -226,14 +264,31 @@ OutBatch.prototype.invokeSent = function (socket) {
 };
 
 
+// the binding reads a SERVER message's routing id from its first part
+function routingId(id) {
+  var buf = new Buffer(4);
+  buf.writeUInt32LE(id, 0);
+  return buf;
+}
+
+function toBuffers(parts) {
+  var bufs = new Array(parts.length);
+  for (var i = 0; i < parts.length; i += 1) {
+    bufs[i] = Buffer.isBuffer(parts[i]) ? parts[i] : new Buffer(String(parts[i]), 'utf8');
+  }
+  return bufs;
+}
+
+
 function BatchList() {
   this.firstBatch = null;
   this.lastBatch = null;
   this.length = 0;
+  this.nextDeadline = Infinity;  // no batch expires before this
 }
 
 BatchList.prototype.canSend = function () {
-  return this.firstBatch ? this.firstBatch.isClosed : false;
+  return this.firstBatch ? this.firstBatch.isClosed && !this.firstBatch.pending : false;
 };
 
 BatchList.prototype.append = function (buf, flags, cb) {
@@ -260,7 +315,7 @@ BatchList.prototype.append = function (buf, flags, cb) {
 
 BatchList.prototype.fetch = function () {
   var batch = this.firstBatch;
-  if (batch && batch.isClosed) {
+  if (batch && batch.isClosed && !batch.pending) {
     this.firstBatch = batch.next;
     this.length -= 1;
     return batch;
@@ -268,501 +323,3008 @@ BatchList.prototype.fetch = function () {
   return undefined;
 };
 
+BatchList.prototype.fetchMany = function (max) {
+  var batches = [], batch;
+  while (batches.length < max && (batch = this.fetch())) {
+    batches.push(batch);
+  }
+  return batches;
+};
+
+// fetched batches keep their links, so restoring them last to first brings
+// them back in their original order
 BatchList.prototype.restore = function (batch) {
   this.firstBatch = batch;
   this.length += 1;
 };
 
+// links a batch taken from another list in at the end
+BatchList.prototype.push = function (batch) {
+  batch.next = null;
+  if (this.lastBatch) {
+    this.lastBatch.next = batch;
+  }
+  this.lastBatch = batch;
+  if (!this.firstBatch) {
+    this.firstBatch = batch;
+  }
+  this.length += 1;
+  if (batch.deadline && batch.deadline < this.nextDeadline) {
+    this.nextDeadline = batch.deadline;
+  }
+};
 
-/**
- * Create a new socket of the given `type`.
- *
- * @constructor
- * @param {String|Number} type
- * @api public
- */
+// callbacks of every queued batch, in order
+BatchList.prototype.callbacks = function () {
+  var cbs = [];
+  for (var batch = this.firstBatch; batch; batch = batch.next) {
+    cbs.push.apply(cbs, batch.cbs);
+  }
+  return cbs;
+};
 
-var Socket =
-exports.Socket = function (type) {
-  var self = this;
-  EventEmitter.call(this);
-  this.type = type;
-  this._zmq = new zmq.SocketBinding(defaultContext(), types[type]);
-  this._paused = false;
-  this._isFlushingReads = false;
-  this._isFlushingWrites = false;
-  this._outgoing = new BatchList();
+BatchList.prototype.setDeadline = function (deadline) {
+  if (!this.lastBatch || !this.lastBatch.isClosed) return;
+  this.lastBatch.deadline = deadline;
+  if (deadline < this.nextDeadline) {
+    this.nextDeadline = deadline;
+  }
+};
 
-  this._zmq.onReadReady = function () {
-    self._flushReads();
-  };
+// unlinks and returns every closed batch whose deadline passed
+BatchList.prototype.expire = function (now) {
+  var expired = []
+    , next = Infinity
+    , prev = null
+    , batch = this.firstBatch;
 
-  this._zmq.onSendReady = function () {
-    self._flushWrites();
-  };
-};
+  if (now < this.nextDeadline) {
+    return expired;
+  }
 
-/**
- * Inherit from `EventEmitter.prototype`.
- */
+  while (batch) {
+    if (batch.deadline && batch.isClosed && batch.deadline <= now) {
+      expired.push(batch);
+      this.length -= 1;
+      if (prev) {
+        prev.next = batch.next;
+      } else {
+        this.firstBatch = batch.next;
+      }
+      if (this.lastBatch === batch) {
+        this.lastBatch = prev;
+      }
+    } else {
+      if (batch.deadline && batch.deadline < next) {
+        next = batch.deadline;
+      }
+      prev = batch;
+    }
+    batch = batch.next;
+  }
 
-util.inherits(Socket, EventEmitter);
+  this.nextDeadline = next;
+  return expired;
+};
 
-/**
- * Set socket to pause mode
- * no data will be emit until resume() is called
- * all send() calls will be queued
- *
- * @api public
- */
+// the queue of every socket that hasn't sent anything yet, never appended to
+var NO_OUTGOING = new BatchList();
 
-Socket.prototype.pause = function() {
-  this._paused = true;
-}
 
 /**
- * Set a socket back to normal work mode
- *
- * @api public
+ * Outgoing queue with priority lanes, which replaces a socket's BatchList
+ * the first time a message is sent with a priority. Every lane is a
+ * BatchList of its own. fetch() takes from the highest lane that has a
+ * batch ready, but a lane gets at most `weights[lane]` batches per round
+ * while lower lanes are waiting, so those are never starved.
  */
 
-Socket.prototype.resume = function() {
-  this._paused = false;
-  this._flushReads();
-  this._flushWrites();
-}
+var PRIORITY_LANES = 4;
 
-Socket.prototype.ref = function() {
-  this._zmq.ref();
+function LaneList(first, weights) {
+  this.lanes = [first];
+  this.credits = [0];
+  for (var i = 1; i < PRIORITY_LANES; i += 1) {
+    this.lanes.push(new BatchList());
+    this.credits.push(0);
+  }
+  this.weights = weights;
+  this.lastBatch = first.lastBatch;
+  this.openLane = this.lastBatch && !this.lastBatch.isClosed ? 0 : -1;  // lane of an unfinished message
 }
 
-Socket.prototype.unref = function() {
-  this._zmq.unref();
-}
+Object.defineProperty(LaneList.prototype, 'length', {
+  get: function () {
+    var length = 0;
+    for (var i = 0; i < PRIORITY_LANES; i += 1) length += this.lanes[i].length;
+    return length;
+  }
+});
 
-Socket.prototype.read = function() {
-  var message = [], flags;
+Object.defineProperty(LaneList.prototype, 'nextDeadline', {
+  get: function () {
+    var next = Infinity;
+    for (var i = 0; i < PRIORITY_LANES; i += 1) next = Math.min(next, this.lanes[i].nextDeadline);
+    return next;
+  }
+});
 
-  if (this._zmq.state !== zmq.STATE_READY) {
-    return null;
+LaneList.prototype.canSend = function () {
+  for (var i = PRIORITY_LANES - 1; i >= 0; i -= 1) {
+    if (this.lanes[i].canSend()) return true;
   }
+  return false;
+};
 
-  flags = this._zmq.getsockopt(zmq.ZMQ_EVENTS);
+// the parts of a message all go to the lane its first part went to
+LaneList.prototype.append = function (buf, flags, cb, lane) {
+  lane = this.openLane >= 0 ? this.openLane : lane | 0;
 
-  if (flags & zmq.ZMQ_POLLIN) {
-    do {
-      message.push(this._zmq.recv());
-    } while (this._zmq.getsockopt(zmq.ZMQ_RCVMORE));
+  var list = this.lanes[lane];
+  list.append(buf, flags, cb);
+  this.lastBatch = list.lastBatch;
+  this.lastBatch.lane = lane;
+  this.openLane = this.lastBatch.isClosed ? -1 : lane;
+};
 
-    return message;
+LaneList.prototype.fetch = function () {
+  var ready = -1, i;
+
+  for (i = PRIORITY_LANES - 1; i >= 0; i -= 1) {
+    if (this.lanes[i].canSend()) {
+      if (this.credits[i] > 0) break;
+      if (ready < 0) ready = i;
+    }
   }
 
-  return null;
-}
+  if (i < 0) {
+    if (ready < 0) return undefined;
 
+    // every ready lane used up its share, start a new round
+    for (i = 0; i < PRIORITY_LANES; i += 1) {
+      this.credits[i] = Math.max(this.weights[i] | 0, 1);
+    }
+    i = ready;
+  }
 
-/**
- * Set `opt` to `val`.
- *
- * @param {String|Number} opt
- * @param {Mixed} val
- * @return {Socket} for chaining
- * @api public
- */
+  this.credits[i] -= 1;
+  return this.lanes[i].fetch();
+};
 
-Socket.prototype.setsockopt = function(opt, val){
-  this._zmq.setsockopt(opts[opt] || opt, val);
-  return this;
+LaneList.prototype.fetchMany = BatchList.prototype.fetchMany;
+
+// batches that could not be sent go back to their lane, and the next fetch
+// starts a new round so a retry picks them in the same order
+LaneList.prototype.restore = function (batch) {
+  for (var i = 0; i < PRIORITY_LANES; i += 1) this.credits[i] = 0;
+  this.lanes[batch.lane].restore(batch);
 };
 
-/**
- * Get socket `opt`.
- *
- * @param {String|Number} opt
- * @return {Mixed}
- * @api public
- */
+LaneList.prototype.setDeadline = function (deadline) {
+  if (this.lastBatch) this.lanes[this.lastBatch.lane].setDeadline(deadline);
+};
 
-Socket.prototype.getsockopt = function(opt){
-  return this._zmq.getsockopt(opts[opt] || opt);
+LaneList.prototype.expire = function (now) {
+  var expired = [];
+  for (var i = 0; i < PRIORITY_LANES; i += 1) {
+    expired.push.apply(expired, this.lanes[i].expire(now));
+  }
+  return expired;
+};
+
+LaneList.prototype.callbacks = function () {
+  var cbs = [];
+  for (var i = 0; i < PRIORITY_LANES; i += 1) {
+    cbs.push.apply(cbs, this.lanes[i].callbacks());
+  }
+  return cbs;
 };
 
+
 /**
- * Socket opt accessors allowing `sock.backlog = val`
- * instead of `sock.setsockopt('backlog', val)`.
+ * Outgoing queue that overflows to disk, see `Socket#spoolThreshold`. The
+ * oldest batches wait in memory in `head`, up to `threshold` of them. Once
+ * that is full, batches leave `tail` for the Spool as soon as they are
+ * complete and come back into `head` in order while it drains. New parts
+ * always go to `tail`, so compression and ttl work as usual.
  */
 
-Object.keys(opts).forEach(function(name){
-  Socket.prototype.__defineGetter__(name, function() {
-    return this._zmq.getsockopt(opts[name]);
-  });
+function SpoolList(head, socket) {
+  this.head = head;
+  this.tail = new BatchList();
+  this.socket = socket;  // spoolDir and spoolSegmentSize, read on first use
+  this.spool = null;
+}
 
-  Socket.prototype.__defineSetter__(name, function(val) {
-    if ('string' == typeof val) val = new Buffer(val, 'utf8');
-    return this._zmq.setsockopt(opts[name], val);
-  });
+Object.defineProperty(SpoolList.prototype, 'length', {
+  get: function () {
+    return this.head.length + (this.spool ? this.spool.count : 0) + this.tail.length;
+  }
 });
 
-/**
- * Async bind.
- *
- * Emits the "bind" event.
- *
- * @param {String} addr
- * @param {Function} cb
- * @return {Socket} for chaining
- * @api public
- */
+Object.defineProperty(SpoolList.prototype, 'nextDeadline', {
+  get: function () {
+    return Math.min(this.head.nextDeadline, this.tail.nextDeadline);
+  }
+});
 
-Socket.prototype.bind = function(addr, cb) {
-  var self = this;
-  this._zmq.bind(addr, function(err) {
-    if (err) {
-      return cb && cb(err);
+Object.defineProperty(SpoolList.prototype, 'lastBatch', {
+  get: function () {
+    return this.tail.lastBatch || this.head.lastBatch;
+  }
+});
+
+SpoolList.prototype.append = function (buf, flags, cb) {
+  this.tail.append(buf, flags, cb);
+};
+
+// takes the first batch of tail if it is complete
+SpoolList.prototype._takeTail = function () {
+  var batch = this.tail.fetch();
+  if (batch && this.tail.lastBatch === batch) {
+    this.tail.lastBatch = null;
+  }
+  return batch;
+};
+
+SpoolList.prototype._balance = function () {
+  var threshold = this.socket._spoolThreshold || Infinity  // turned off again
+    , spool = this.spool
+    , batch;
+
+  while (spool && spool.count && this.head.length < threshold) {
+    this.head.push(spool.shift());
+  }
+  if (!spool || !spool.count) {
+    while (this.head.length < threshold && (batch = this._takeTail())) {
+      this.head.push(batch);
+    }
+  }
+  while (this.head.length + this.tail.length > threshold && this.tail.canSend()) {
+    if (!this.spool) {
+      this.spool = new Spool(this.socket.spoolDir || os.tmpdir(), this.socket.spoolSegmentSize);
     }
+    this.spool.push(this._takeTail());
+  }
+};
 
-    self._flushReads();
-    self._flushWrites();
+SpoolList.prototype.canSend = function () {
+  this._balance();
+  return this.head.canSend();
+};
 
-    self.emit('bind', addr);
-    cb && cb();
-  });
-  return this;
+SpoolList.prototype.fetch = function () {
+  this._balance();
+  return this.head.fetch();
 };
 
-/**
- * Sync bind.
- *
- * @param {String} addr
- * @return {Socket} for chaining
- * @api public
- */
+// batches that can't be sent go back into head, so a send never takes
+// more than head holds, or the spool would drain into memory
+SpoolList.prototype.fetchMany = function (max) {
+  this._balance();
+  return this.head.fetchMany(max);
+};
 
-Socket.prototype.bindSync = function(addr) {
-  this._zmq.bindSync(addr);
+SpoolList.prototype.restore = function (batch) {
+  this.head.restore(batch);
+};
 
-  return this;
+SpoolList.prototype.setDeadline = function (deadline) {
+  this.tail.setDeadline(deadline);
+};
+
+// spooled batches expire once they are back in memory
+SpoolList.prototype.expire = function (now) {
+  return this.head.expire(now).concat(this.tail.expire(now));
+};
+
+SpoolList.prototype.callbacks = function () {
+  return this.head.callbacks()
+    .concat(this.spool ? this.spool.callbacks() : [])
+    .concat(this.tail.callbacks());
 };
 
+SpoolList.prototype.stats = function () {
+  var spool = this.spool;
+  return {
+    spooled: spool ? spool.count : 0,
+    spooledBytes: spool ? spool.bytes : 0,
+    segments: spool ? spool.segments.length : 0
+  };
+};
+
+SpoolList.prototype.close = function () {
+  if (this.spool) this.spool.close();
+  this.spool = null;
+};
+
+
 /**
- * Async unbind.
+ * Append-only segment files holding spooled batches. A record is
  *
- * Emits the "unbind" event.
+ *   size:u32 parts:u32 deadline:f64 (length:u32 flags:u32 data)*
  *
- * @param {String} addr
- * @param {Function} cb
- * @return {Socket} for chaining
- * @api public
+ * in little endian, written with one system call and read back through a
+ * read-ahead buffer; the page cache does the rest. Callbacks can't go to
+ * disk and wait in `cbs`. A segment that has been read completely is
+ * truncated and reused for writing, one spare is kept around.
  */
 
-Socket.prototype.unbind = function(addr, cb) {
-  if (zmq.ZMQ_CAN_UNBIND) {
-    var self = this;
-    this._zmq.unbind(addr, function(err) {
-      if (err) {
-        return cb && cb(err);
-      }
-      self.emit('unbind', addr);
+var SPOOL_READ_AHEAD = 256 * 1024;
+var lastSpoolId = 0;
+
+// segment files of every open spool by id, removed at exit; holds only
+// the files, a spool's socket can still be collected
+var spoolFiles = {};
+
+function Spool(dir, segmentSize) {
+  this.id = ++lastSpoolId;
+  this.dir = dir;
+  this.segmentSize = segmentSize;
+  this.prefix = 'zmq-spool-' + process.pid + '-' + this.id + '-';
+  this.segments = [];   // { path, fd, size, read }, oldest first
+  this.spare = null;
+  this.lastSegmentId = 0;
+  this.cbs = [];        // callbacks of every record, null for none
+  this.count = 0;       // records
+  this.bytes = 0;       // bytes in unread records
+  this.readBuf = null;
+  this.readSegment = null;
+  this.readStart = 0;
+  this.readLength = 0;
+}
 
-      self._flushReads();
-      self._flushWrites();
-      cb && cb();
-    });
+Spool.prototype._segment = function () {
+  var seg = this.segments[this.segments.length - 1];
+  if (seg && seg.size < this.segmentSize) return seg;
+
+  if (this.spare) {
+    seg = this.spare;
+    this.spare = null;
   } else {
-    cb && cb();
+    var path = this.dir + '/' + this.prefix + (++this.lastSegmentId);
+    seg = { path: path, fd: fs.openSync(path, 'w+', 384), size: 0, read: 0 };
+    (spoolFiles[this.id] = spoolFiles[this.id] || []).push(seg);
   }
-  return this;
+  this.segments.push(seg);
+  return seg;
 };
 
-/**
- * Sync unbind.
- *
- * @param {String} addr
- * @return {Socket} for chaining
- * @api public
- */
+Spool.prototype.push = function (batch) {
+  var content = batch.content
+    , parts = content.length / 2
+    , size = 16 + parts * 8
+    , bufs = new Array(parts)
+    , i, buf;
+
+  for (i = 0; i < parts; i += 1) {
+    buf = content[i * 2];
+    bufs[i] = Array.isArray(buf) ? Buffer.concat(buf) : buf;
+    size += bufs[i].length;
+  }
 
-Socket.prototype.unbindSync = function(addr) {
-  if (zmq.ZMQ_CAN_UNBIND) {
-    this._zmq.unbindSync(addr);
+  var record = new Buffer(size)
+    , offset = 16;
+  record.writeUInt32LE(size, 0);
+  record.writeUInt32LE(parts, 4);
+  record.writeDoubleLE(batch.deadline, 8);
+  for (i = 0; i < parts; i += 1) {
+    record.writeUInt32LE(bufs[i].length, offset);
+    record.writeUInt32LE(content[i * 2 + 1], offset + 4);
+    bufs[i].copy(record, offset + 8);
+    offset += 8 + bufs[i].length;
   }
-  return this;
-}
 
-/**
- * Connect to `addr`.
- *
- * @param {String} addr
- * @return {Socket} for chaining
- * @api public
- */
+  var seg = this._segment();
+  fs.writeSync(seg.fd, record, 0, size, seg.size);
+  seg.size += size;
+  this.cbs.push(batch.cbs.length ? batch.cbs : null);
+  this.count += 1;
+  this.bytes += size;
+};
 
-Socket.prototype.connect = function(addr) {
-  this._zmq.connect(addr);
-  return this;
+// makes `length` bytes at the read position of `seg` available in readBuf
+Spool.prototype._fill = function (seg, length) {
+  var end = this.readStart + this.readLength;
+  if (this.readSegment === seg && seg.read >= this.readStart && seg.read + length <= end) {
+    return seg.read - this.readStart;
+  }
+
+  var want = Math.min(Math.max(length, SPOOL_READ_AHEAD), seg.size - seg.read);
+  if (!this.readBuf || this.readBuf.length < want) {
+    this.readBuf = new Buffer(Math.max(want, SPOOL_READ_AHEAD));
+  }
+  this.readLength = fs.readSync(seg.fd, this.readBuf, 0, want, seg.read);
+  this.readSegment = seg;
+  this.readStart = seg.read;
+  return 0;
 };
 
-/**
+Spool.prototype.shift = function () {
+  var seg = this.segments[0]
+    , batch = new OutBatch();
+
+  var offset = this._fill(seg, 16)
+    , size = this.readBuf.readUInt32LE(offset)
+    , parts = this.readBuf.readUInt32LE(offset + 4);
+
+  batch.deadline = this.readBuf.readDoubleLE(offset + 8);
+  offset = this._fill(seg, size) + 16;
+  for (var i = 0; i < parts; i += 1) {
+    var length = this.readBuf.readUInt32LE(offset)
+      , buf = new Buffer(length);
+    this.readBuf.copy(buf, 0, offset + 8, offset + 8 + length);
+    batch.content.push(buf, this.readBuf.readUInt32LE(offset + 4));
+    offset += 8 + length;
+  }
+  batch.isClosed = true;
+  batch.cbs = this.cbs.shift() || [];
+
+  seg.read += size;
+  this.count -= 1;
+  this.bytes -= size;
+  if (seg.read === seg.size && (this.segments.length > 1 || !this.count)) {
+    this._recycle(this.segments.shift());
+  }
+  return batch;
+};
+
+Spool.prototype._recycle = function (seg) {
+  if (this.readSegment === seg) this.readSegment = null;
+  if (this.spare) {
+    var files = spoolFiles[this.id];
+    files.splice(files.indexOf(seg), 1);
+    removeSpoolFiles([seg]);
+    return;
+  }
+  fs.ftruncateSync(seg.fd, 0);
+  seg.size = seg.read = 0;
+  this.spare = seg;
+};
+
+Spool.prototype.callbacks = function () {
+  var cbs = [];
+  for (var i = 0; i < this.cbs.length; i += 1) {
+    if (this.cbs[i]) cbs.push.apply(cbs, this.cbs[i]);
+  }
+  return cbs;
+};
+
+Spool.prototype.close = function () {
+  removeSpoolFiles(spoolFiles[this.id] || []);
+  delete spoolFiles[this.id];
+  this.segments = [];
+  this.spare = null;
+  this.cbs = [];
+  this.count = this.bytes = 0;
+};
+
+function removeSpoolFiles(segs) {
+  for (var i = 0; i < segs.length; i += 1) {
+    fs.closeSync(segs[i].fd);
+    fs.unlinkSync(segs[i].path);
+  }
+}
+
+// upper bound for the number of batches handed to a single sendMany() call
+var MAX_BATCHES_PER_SEND = 1024;
+
+
+/**
+ * Frame compression, see `Socket#compression`. The last part of every
+ * message starts with a one byte header telling how the rest is encoded.
+ */
+
+var COMPRESSION_RAW = new Buffer([0])
+  , COMPRESSION_DEFLATE = new Buffer([1])
+  , EMPTY = new Buffer(0);
+
+// inbound messages waiting for inflation before reads stop
+var MAX_INFLATING = 64;
+
+function CompressionStats() {
+  this.compressed = 0;       // frames sent deflated
+  this.uncompressed = 0;     // frames sent as is, too small or incompressible
+  this.bytesIn = 0;          // size of the deflated frames before ...
+  this.bytesOut = 0;         // ... and after compression
+  this.compressTime = 0;     // ms spent waiting for deflate
+  this.inflated = 0;         // frames received deflated
+  this.inflateTime = 0;      // ms spent waiting for inflate
+  this.ratio = 0;            // bytesOut / bytesIn
+}
+
+function elapsed(start) {
+  var diff = process.hrtime(start);
+  return diff[0] * 1e3 + diff[1] / 1e6;
+}
+
+// ms on the monotonic clock the binding stamps received messages with
+function hrnow() {
+  var now = process.hrtime();
+  return now[0] * 1e3 + now[1] / 1e6;
+}
+
+
+/**
+ * Sockets that used up their read budget wait here for their next turn. They
+ * are served round-robin, one budget each, from a single setImmediate (a
+ * uv_check_t), so timers, other sockets and other I/O run in between.
+ */
+
+var readQueue = [];
+var readQueueScheduled = false;
+
+function scheduleRead(socket) {
+  if (socket._readScheduled) return;
+
+  socket._readScheduled = true;
+  readQueue.push(socket);
+
+  if (!readQueueScheduled) {
+    readQueueScheduled = true;
+    setImmediate(runReadQueue);
+  }
+}
+
+function runReadQueue() {
+  var queue = readQueue;
+
+  readQueue = [];
+  readQueueScheduled = false;
+
+  // sockets that still have work left schedule themselves into the next round
+  for (var i = 0; i < queue.length; i += 1) {
+    queue[i]._readScheduled = false;
+    queue[i]._flushReads();
+  }
+}
+
+function messageSize(message) {
+  var size = 0;
+  for (var i = 0; i < message.length; i += 1) {
+    if (Buffer.isBuffer(message[i])) size += message[i].length;
+  }
+  return size;
+}
+
+
+/**
+ * Pull based message iterator, see `Socket#messages()`.
+ */
+
+function MessageIterator(socket, batchSize) {
+  this._socket = socket;
+  this._batchSize = batchSize > 0 ? batchSize : 64;
+  this._batch = null;     // messages pulled by the last readMany() call
+  this._index = 0;        // next message to hand out from this._batch
+  this._waiting = [];     // pending next() calls as {resolve, reject}
+  this._done = false;
+}
+
+MessageIterator.prototype.next = function () {
+  var self = this;
+
+  if (!this._waiting.length) {
+    var message = this._shift();
+    if (message) {
+      return Promise.resolve({ value: message, done: false });
+    }
+    if (this._done) {
+      return Promise.resolve({ value: undefined, done: true });
+    }
+  }
+
+  return new Promise(function (resolve, reject) {
+    self._waiting.push({ resolve: resolve, reject: reject });
+    self._wake();
+  });
+};
+
+MessageIterator.prototype.return = function (value) {
+  this._finish();
+  return Promise.resolve({ value: value, done: true });
+};
+
+MessageIterator.prototype._shift = function () {
+  var batch = this._batch;
+  if (batch && this._index < batch.length) {
+    var message = batch[this._index];
+    batch[this._index++] = undefined;
+    return message;
+  }
+  this._batch = null;
+  return null;
+};
+
+MessageIterator.prototype._wake = function () {
+  var message, waiter;
+
+  while (this._waiting.length) {
+    message = this._shift();
+
+    if (!message && !this._done) {
+      // the batch ran dry, pull the next one; an empty batch re-arms the watcher
+      try {
+        this._batch = this._socket._zmq.readMany(this._batchSize) || null;
+        this._index = 0;
+      } catch (error) {
+        this._waiting.shift().reject(error);
+        continue;
+      }
+      message = this._shift();
+    }
+
+    if (message) {
+      this._waiting.shift().resolve({ value: message, done: false });
+    } else if (this._done) {
+      this._waiting.shift().resolve({ value: undefined, done: true });
+    } else {
+      return;
+    }
+  }
+};
+
+MessageIterator.prototype._finish = function () {
+  var socket = this._socket;
+  if (this._done) return;
+
+  // the rest of the batch was already taken out of libzmq
+  var rest = this._batch ? this._batch.slice(this._index) : [];
+  this._done = true;
+  this._batch = null;
+  this._wake();
+
+  if (socket._iterator === this) {
+    socket._iterator = null;
+  }
+
+  // hand whatever was pulled or is still queued to the 'message' listeners
+  for (var i = 0; i < rest.length; i += 1) {
+    socket._emitMessage(rest[i]);
+  }
+  if (!socket._iterator && socket._zmq.state !== zmq.STATE_CLOSED) {
+    socket._flushReads();
+  }
+};
+
+if (typeof Symbol === 'function' && Symbol.asyncIterator) {
+  MessageIterator.prototype[Symbol.asyncIterator] = function () {
+    return this;
+  };
+}
+
+/**
+ * Create a new socket of the given `type`.
+ *
+ * @constructor
+ * @param {String|Number} type
+ * @api public
+ */
+
+var Socket =
+exports.Socket = function (type) {
+  // also catches the draft types of a libzmq built without them
+  if (types[type] === undefined) {
+    throw new TypeError('Unknown socket type: ' + type);
+  }
+  EventEmitter.call(this);
+  this.type = type;
+  this._zmq = new zmq.SocketBinding(defaultContext(), types[type]);
+  this._zmq._socket = this;  // for the shared onReadReady/onSendReady
+  this._id = ++lastSocketId;
+  ioThreadsStarted = true;
+  if (shards) shards.add(this);  // sets _ioThread
+};
+
+/**
+ * Options and rarely used state default on the prototype, so an idle socket
+ * only carries what every socket needs. Deployments with 100k+ sockets per
+ * process pay for each instance property many times over.
+ */
+
+Socket.prototype.readBudget = 0;       // max messages per wakeup, 0 for no limit
+Socket.prototype.readBudgetBytes = 0;  // max bytes per wakeup, 0 for no limit
+Socket.prototype.conflate = false;     // keep only the latest message per topic
+Socket.prototype.conflateWindow = 10000;  // max messages collapsed per native call
+Socket.prototype.ttl = 0;              // ms a message may wait to be sent, 0 for no limit
+Socket.prototype.coalesce = false;     // cork automatically until the end of the tick
+Socket.prototype.corkMaxDelay = 0;     // max ms a corked message waits, 0 for no limit
+Socket.prototype._compress = false;    // deflate the last part of every message
+Socket.prototype.compressionThreshold = 1024;  // smaller parts are sent as is
+Socket.prototype.compressionLevel = null;      // zlib level, null for zlib's default
+Socket.prototype.receivedAt = 0;
+Socket.prototype._paused = false;
+Socket.prototype._isFlushingReads = false;
+Socket.prototype._isFlushingWrites = false;
+Socket.prototype._outgoing = NO_OUTGOING;  // replaced on first send
+Socket.prototype._decode = false;
+Socket.prototype._timestamps = false;
+Socket.prototype._readScheduled = false;
+Socket.prototype._corked = 0;
+Socket.prototype._tickCorked = false;
+Socket.prototype._iterator = null;
+Socket.prototype._expired = 0;
+Socket.prototype._expiryTimer = null;
+Socket.prototype._expiryAt = Infinity;
+Socket.prototype._corkTimer = null;
+Socket.prototype._busy = false;  // a bind or attach job owns the native socket
+Socket.prototype._compressionStats = null;  // created on first use
+Socket.prototype._inflating = null;         // created on first use
+Socket.prototype._priorityWeights = null;   // created on first use
+Socket.prototype._spoolThreshold = 0;
+Socket.prototype._spoolList = null;
+Socket.prototype.spoolDir = null;          // os.tmpdir() by default
+Socket.prototype.spoolSegmentSize = 64 * 1024 * 1024;
+
+/**
+ * Deflate the last part of every message. A compressed message is decoded
+ * for 'object' listeners after it was inflated, not by the binding.
+ */
+
+Socket.prototype.__defineGetter__('compression', function() {
+  return this._compress;
+});
+
+Socket.prototype.__defineSetter__('compression', function(on) {
+  this._compress = !!on;
+  this._zmq.decode = this._decode && !this._compress;
+});
+
+// batches per round for every priority lane
+Socket.prototype.__defineGetter__('priorityWeights', function() {
+  return this._priorityWeights || (this._priorityWeights = [1, 2, 4, 8]);
+});
+
+Socket.prototype.__defineSetter__('priorityWeights', function(weights) {
+  this._priorityWeights = weights;
+});
+
+/**
+ * Messages kept in memory before the outgoing queue overflows to segment
+ * files in `spoolDir`, 0 (the default) for no spool. Priority lanes other
+ * than 0 always stay in memory.
+ */
+
+Socket.prototype.__defineGetter__('spoolThreshold', function() {
+  return this._spoolThreshold;
+});
+
+Socket.prototype.__defineSetter__('spoolThreshold', function(threshold) {
+  if (!(threshold >= 0) || threshold % 1) {
+    throw new RangeError('spoolThreshold must be a non-negative integer');
+  }
+  this._spoolThreshold = threshold;
+  if (!threshold || this._spoolList) return;
+
+  var outgoing = this._queue()
+    , lanes = outgoing instanceof LaneList;
+  this._spoolList = new SpoolList(lanes ? outgoing.lanes[0] : outgoing, this);
+  if (lanes) {
+    outgoing.lanes[0] = this._spoolList;
+  } else {
+    this._outgoing = this._spoolList;
+  }
+});
+
+/**
+ * Readiness callbacks invoked by the binding, shared by all sockets instead
+ * of two closures per socket.
+ */
+
+zmq.SocketBinding.prototype.onReadReady = function () {
+  this._socket._flushReads();
+};
+
+zmq.SocketBinding.prototype.onSendReady = function () {
+  this._socket._flushWrites();
+};
+
+/**
+ * Inherit from `EventEmitter.prototype`.
+ */
+
+util.inherits(Socket, EventEmitter);
+
+/**
+ * While a socket has 'object' listeners the binding decodes the last part of
+ * every message, see `Socket#sendObject()`. The listener methods are
+ * wrapped rather than watched with 'newListener', so a socket carries no
+ * listeners of its own until it is given some.
+ */
+
+function watchObjectListeners(socket) {
+  var decode = socket.listeners('object').length > 0;
+  if (decode !== socket._decode) {
+    socket._decode = decode;
+    socket._zmq.decode = decode && !socket._compress;
+  }
+}
+
+Socket.prototype.on =
+Socket.prototype.addListener = function(event, listener) {
+  EventEmitter.prototype.addListener.call(this, event, listener);
+  if (event === 'object') watchObjectListeners(this);
+  return this;
+};
+
+if (EventEmitter.prototype.prependListener) {
+  Socket.prototype.prependListener = function(event, listener) {
+    EventEmitter.prototype.prependListener.call(this, event, listener);
+    if (event === 'object') watchObjectListeners(this);
+    return this;
+  };
+}
+
+Socket.prototype.off =
+Socket.prototype.removeListener = function(event, listener) {
+  EventEmitter.prototype.removeListener.call(this, event, listener);
+  if (event === 'object') watchObjectListeners(this);
+  return this;
+};
+
+Socket.prototype.removeAllListeners = function(event) {
+  EventEmitter.prototype.removeAllListeners.apply(this, arguments);
+  if (event === undefined || event === 'object') watchObjectListeners(this);
+  return this;
+};
+
+/**
+ * Set socket to pause mode
+ * no data will be emit until resume() is called
+ * all send() calls will be queued
+ *
+ * @api public
+ */
+
+Socket.prototype.pause = function() {
+  this._paused = true;
+}
+
+/**
+ * Set a socket back to normal work mode
+ *
+ * @api public
+ */
+
+Socket.prototype.resume = function() {
+  this._paused = false;
+  this._flushReads();
+  this._flushWrites();
+}
+
+/**
+ * Busy poll time in microseconds.
+ *
+ * After a wakeup the binding keeps spinning on ZMQ_EVENTS for this long
+ * before it falls back to the event loop watcher, which saves the wakeup
+ * latency on busy request/reply links at the cost of CPU. 0 (the default)
+ * disables spinning.
+ */
+
+Socket.prototype.__defineGetter__('busyPoll', function() {
+  return this._zmq.busyPoll;
+});
+
+Socket.prototype.__defineSetter__('busyPoll', function(val) {
+  this._zmq.busyPoll = val;
+});
+
+/**
+ * Busy poll counters: `hits` counts work that showed up while spinning, so
+ * wakeups saved, `misses` counts spin windows that ran out and fell back to
+ * the watcher.
+ *
+ * @return {Object}
+ * @api public
+ */
+
+Socket.prototype.busyPollStats = function() {
+  return this._zmq.busyPollStats();
+};
+
+/**
+ * Record when messages are received. While a 'message' handler runs,
+ * `receivedAt` holds the time in ms, on the clock `process.hrtime()` uses,
+ * at which the binding read the message. How long messages waited for their
+ * handlers and how long those took is kept in `latencyStats()`.
+ */
+
+Socket.prototype.__defineGetter__('timestamps', function() {
+  return this._zmq.timestamps;
+});
+
+Socket.prototype.__defineSetter__('timestamps', function(val) {
+  this._zmq.timestamps = val;
+  this._timestamps = val;
+});
+
+/**
+ * Add the wall clock send time to every message as an extra last part, and
+ * strip it from received messages to record their one-way latency. Both
+ * peers have to set it, and their clocks have to be in sync.
+ */
+
+Socket.prototype.__defineGetter__('timestampTrailer', function() {
+  return this._zmq.timestampTrailer;
+});
+
+Socket.prototype.__defineSetter__('timestampTrailer', function(val) {
+  this._zmq.timestampTrailer = val;
+});
+
+/**
+ * Latency histograms, see `timestamps` and `timestampTrailer`: `dwell` from
+ * receipt to the handlers, `handler` time spent in them and one-way
+ * `latency`. Each has the `count`, `min`, `max`, `mean`, `p50`, `p90`,
+ * `p99` and `p999` in ms. Pass `true` to reset them after the snapshot.
+ *
+ * @param {Boolean} [reset]
+ * @return {Object}
+ * @api public
+ */
+
+Socket.prototype.latencyStats = function(reset) {
+  return this._zmq.latencyStats(!!reset);
+};
+
+/**
+ * Install a receive filter that is evaluated natively on the first part of
+ * every incoming message, before any Buffer is created. Messages that don't
+ * pass are dropped without reaching JavaScript. Pass `null` to remove it.
+ *
+ *   - `minSize`, `maxSize` bounds on the first part's length
+ *   - `bytes` rules `{offset, value, [mask], [negate]}` that must all hold
+ *   - `allow` prefixes, one of which must match when given
+ *   - `deny` prefixes, none of which may match
+ *
+ * Prefixes are strings or Buffers.
+ *
+ * @param {Object} filter
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.setFilter = function(filter) {
+  this._zmq.setFilter(filter || null);
+  return this;
+};
+
+/**
+ * Filter counters: `filtered` messages and `filteredBytes` dropped so far.
+ *
+ * @return {Object}
+ * @api public
+ */
+
+Socket.prototype.filterStats = function() {
+  return this._zmq.filterStats();
+};
+
+/**
+ * Conflation counter: `conflated` messages dropped because a newer message
+ * with the same topic replaced them, see `Socket#conflate`.
+ *
+ * @return {Object}
+ * @api public
+ */
+
+Socket.prototype.conflateStats = function() {
+  return { conflated: this._zmq.conflated };
+};
+
+/**
+ * Pace sends with token buckets kept in the binding. Messages over the rate
+ * stay queued and go out as tokens come back, timed natively. Pass `null`
+ * to stop pacing.
+ *
+ *   - `messages` messages per second
+ *   - `bytes` bytes per second
+ *   - `burstMessages`, `burstBytes` bucket sizes, a hundredth of a second's
+ *     worth by default
+ *
+ * @param {Object} rate
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.setRate = function(rate) {
+  this._zmq.setRate(rate || null);
+  return this;
+};
+
+/**
+ * Pacing counters: `sent` messages and `sentBytes`, the current
+ * `messageRate` and `byteRate` per second, how often sends were `throttled`
+ * and the `throttledTime` in ms spent waiting.
+ *
+ * @return {Object}
+ * @api public
+ */
+
+Socket.prototype.rateStats = function() {
+  return this._zmq.rateStats();
+};
+
+/**
+ * Cork the socket: messages passed to `send()` are queued until `uncork()`
+ * and then go out together in a single native call. Calls nest. With
+ * `corkMaxDelay` set, queued messages are flushed after that many
+ * milliseconds even while the socket is still corked.
+ *
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.cork = function() {
+  this._corked += 1;
+  return this;
+};
+
+/**
+ * Undo one `cork()`, flushing the queue once the last one is undone.
+ *
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.uncork = function() {
+  if (this._corked > 0 && --this._corked === 0) {
+    if (this._corkTimer) {
+      clearTimeout(this._corkTimer);
+      this._corkTimer = null;
+    }
+    this._flushWrites();
+  }
+  return this;
+};
+
+Socket.prototype._startCorkTimer = function() {
+  var self = this;
+  if (this._corkTimer || !(this.corkMaxDelay > 0)) return;
+
+  this._corkTimer = setTimeout(function () {
+    self._corkTimer = null;
+    self._flushWrites(true);
+  }, this.corkMaxDelay);
+};
+
+Socket.prototype.ref = function() {
+  this._zmq.ref();
+}
+
+Socket.prototype.unref = function() {
+  this._zmq.unref();
+}
+
+/**
+ * Iterate over incoming messages with `for await`.
+ *
+ * Messages are pulled from the socket `batchSize` at a time (default 64) and
+ * only when the consumer asks for them, so unread messages stay queued inside
+ * ØMQ and are bounded by its receive high water mark. Each message is yielded
+ * as an array of Buffers, like `read()`. No 'message' events are emitted while
+ * an iterator is active.
+ *
+ * @param {Number} [batchSize]
+ * @return {MessageIterator}
+ * @api public
+ */
+
+Socket.prototype.messages = function(batchSize) {
+  if (typeof Promise !== 'function') {
+    throw new Error('Async iteration requires Promise support');
+  }
+  if (this._iterator) {
+    throw new Error('Socket is already being iterated');
+  }
+  this._iterator = new MessageIterator(this, batchSize);
+  return this._iterator;
+};
+
+if (typeof Symbol === 'function' && Symbol.asyncIterator) {
+  Socket.prototype[Symbol.asyncIterator] = function() {
+    return this.messages();
+  };
+}
+
+Socket.prototype.read = function() {
+  var message = [], flags;
+
+  if (this._zmq.state !== zmq.STATE_READY) {
+    return null;
+  }
+
+  flags = this._zmq.events;
+
+  if (flags & zmq.ZMQ_POLLIN) {
+    do {
+      message.push(this._zmq.recv());
+    } while (this._zmq.more);
+
+    return message;
+  }
+
+  return null;
+}
+
+/**
+ * Copy the next message into the caller owned `target` buffer, starting at
+ * `offset`, without allocating any Buffers. For every part an
+ * `[offset, length, more]` triple is written to the `index` Uint32Array.
+ * A part that does not fit is truncated, its triple still holds the full
+ * length. Like `read()`, this is meant for paused sockets.
+ *
+ * Returns the number of parts copied, 0 when no message is waiting. Throws
+ * a RangeError when `index` can't describe every part of the message, which
+ * is then kept for the next read.
+ *
+ * @param {Buffer} target
+ * @param {Number} offset
+ * @param {Uint32Array} index
+ * @return {Number}
+ * @api public
+ */
+
+Socket.prototype.recvInto = function(target, offset, index) {
+  return this._zmq.recvInto(target, offset || 0, index, 1);
+};
+
+/**
+ * Like `recvInto()`, but copies up to `max` messages back to back, stopping
+ * early when `target` or `index` is full. A message is only copied when the
+ * rest of `index` can describe all of its parts. Messages are told apart by
+ * the `more` flag of their last part.
+ *
+ * @param {Buffer} target
+ * @param {Number} offset
+ * @param {Uint32Array} index
+ * @param {Number} [max]
+ * @return {Number}
+ * @api public
+ */
+
+Socket.prototype.recvManyInto = function(target, offset, index, max) {
+  return this._zmq.recvInto(target, offset || 0, index, max || index.length);
+};
+
+
+/**
+ * Set `opt` to `val`.
+ *
+ * @param {String|Number} opt
+ * @param {Mixed} val
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.setsockopt = function(opt, val){
+  this._zmq.setsockopt(opts[opt] || opt, val);
+  return this;
+};
+
+/**
+ * Get socket `opt`.
+ *
+ * @param {String|Number} opt
+ * @return {Mixed}
+ * @api public
+ */
+
+Socket.prototype.getsockopt = function(opt){
+  return this._zmq.getsockopt(opts[opt] || opt);
+};
+
+/**
+ * Apply `options` at once. Socket options (see `exports.options`) are set
+ * in a single native call, in order, any other key is assigned to the
+ * socket as a property.
+ *
+ * @param {Object} options
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.configure = function(options){
+  var pairs = [];
+  for (var key in options) {
+    var val = options[key];
+    if (opts.hasOwnProperty(key)) {
+      if ('string' == typeof val) val = new Buffer(val, 'utf8');
+      pairs.push(opts[key], val);
+    } else {
+      this[key] = val;
+    }
+  }
+  if (pairs.length) this._zmq.configure(pairs);
+  return this;
+};
+
+/**
+ * Socket opt accessors allowing `sock.backlog = val`
+ * instead of `sock.setsockopt('backlog', val)`.
+ */
+
+Object.keys(opts).forEach(function(name){
+  Socket.prototype.__defineGetter__(name, function() {
+    return this._zmq.getsockopt(opts[name]);
+  });
+
+  Socket.prototype.__defineSetter__(name, function(val) {
+    if ('string' == typeof val) val = new Buffer(val, 'utf8');
+    return this._zmq.setsockopt(opts[name], val);
+  });
+});
+
+/**
+ * Async bind.
+ *
+ * Emits the "bind" event.
+ *
+ * @param {String} addr
+ * @param {Function} cb
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.bind = function(addr, cb) {
+  var self = this;
+  this._zmq.bind(addr, function(err) {
+    self._busy = false;
+    track(self);
+    // wakeups were dropped while busy, whatever came in meanwhile is read now
+    self._flushReads();
+    self._flushWrites();
+    if (err) {
+      return cb && cb(err);
+    }
+
+    self.emit('bind', addr);
+    cb && cb();
+  });
+  this._busy = true;
+  return this;
+};
+
+/**
+ * Async bind to every address in `addrs` in one threadpool job.
+ *
+ * Messages sent meanwhile are queued and go out once the job is done.
+ * Emits "bind" for every address bound. `cb(err, errors)` gets the first
+ * failure and an array with an Error, or undefined, per address. Every
+ * Error has the `address` it belongs to.
+ *
+ * @param {Array} addrs
+ * @param {Function} cb
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.bindMany = function(addrs, cb) {
+  return this._attachMany('bindMany', addrs, cb);
+};
+
+/**
+ * Connect to every address in `addrs` in one threadpool job, see
+ * `bindMany()`. Host names are resolved off the main thread.
+ *
+ * @param {Array} addrs
+ * @param {Function} cb
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.connectMany = function(addrs, cb) {
+  return this._attachMany('connectMany', addrs, cb);
+};
+
+Socket.prototype._attachMany = function(method, addrs, cb) {
+  var self = this;
+  this._zmq[method](addrs, function(errors) {
+    var failed = null;
+    self._busy = false;
+    track(self);
+
+    errors.forEach(function(err, i) {
+      if (err) {
+        err.address = addrs[i];
+        failed = failed || err;
+      } else if (method == 'bindMany') {
+        self.emit('bind', addrs[i]);
+      }
+    });
+
+    self._flushReads();
+    self._flushWrites();
+    cb && cb(failed, errors);
+  });
+  this._busy = true;
+  return this;
+};
+
+/**
+ * Sync bind.
+ *
+ * @param {String} addr
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.bindSync = function(addr) {
+  this._zmq.bindSync(addr);
+  track(this);
+
+  return this;
+};
+
+/**
+ * Async unbind.
+ *
+ * Emits the "unbind" event.
+ *
+ * @param {String} addr
+ * @param {Function} cb
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.unbind = function(addr, cb) {
+  if (zmq.ZMQ_CAN_UNBIND) {
+    var self = this;
+    this._zmq.unbind(addr, function(err) {
+      self._busy = false;
+      track(self);
+      self._flushReads();
+      self._flushWrites();
+      if (err) {
+        return cb && cb(err);
+      }
+      self.emit('unbind', addr);
+      cb && cb();
+    });
+    this._busy = true;
+  } else {
+    cb && cb();
+  }
+  return this;
+};
+
+/**
+ * Sync unbind.
+ *
+ * @param {String} addr
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.unbindSync = function(addr) {
+  if (zmq.ZMQ_CAN_UNBIND) {
+    this._zmq.unbindSync(addr);
+    track(this);
+  }
+  return this;
+}
+
+/**
+ * Connect to `addr`.
+ *
+ * @param {String} addr
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.connect = function(addr) {
+  this._zmq.connect(addr);
+  track(this);
+  return this;
+};
+
+/**
  * Disconnect from `addr`.
  *
- * @param {String} addr
- * @return {Socket} for chaining
+ * @param {String} addr
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.disconnect = function(addr) {
+  if (zmq.ZMQ_CAN_DISCONNECT) {
+    this._zmq.disconnect(addr);
+    track(this);
+  }
+  return this;
+};
+
+/**
+ * Join the RADIO `group` on a DISH socket. Requires a libzmq built with
+ * draft APIs, see `zmq.ZMQ_CAN_THREADSAFE`.
+ *
+ * @param {String} group
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.join = function(group) {
+  this._zmq.join(group);
+  return this;
+};
+
+/**
+ * Leave the RADIO `group` on a DISH socket.
+ *
+ * @param {String} group
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.leave = function(group) {
+  this._zmq.leave(group);
+  return this;
+};
+
+/**
+ * Enable monitoring of a Socket
+ *
+ * @param {Number} timer interval in ms > 0 or Undefined for default
+ * @param {Number} The maximum number of events to read on each interval, default is 1, use 0 for reading all events
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.monitor = function(interval, numOfEvents) {
+  if (zmq.ZMQ_CAN_MONITOR) {
+    var self = this;
+
+    self._zmq.onMonitorEvent = function(event_id, event_value, event_endpoint_addr, ex) {
+      self.emit(events[event_id], event_value, event_endpoint_addr, ex);
+    }
+
+    self._zmq.onMonitorError = function(error) {
+      self.emit('monitor_error', error);
+    }
+
+    this._zmq.monitor(interval, numOfEvents);
+  } else {
+    throw new Error('Monitoring support disabled check zmq version is > 3.2.1 and recompile this addon');
+  }
+  return this;
+};
+
+/**
+ * Disable monitoring of a Socket release idle handler
+ * and close the socket
+ *
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.unmonitor = function() {
+  if (zmq.ZMQ_CAN_MONITOR) {
+    this._zmq.unmonitor();
+  }
+  return this;
+};
+
+
+/**
+ * Subscribe with the given `filter`.
+ *
+ * @param {String} filter
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.subscribe = function(filter) {
+  this._subscribe = filter;
+  return this;
+};
+
+/**
+ * Unsubscribe with the given `filter`.
+ *
+ * @param {String} filter
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.unsubscribe = function(filter) {
+  this._unsubscribe = filter;
+  return this;
+};
+
+
+/**
+ * Send `value` encoded as MessagePack by `zmq.encode()`. Plain objects,
+ * arrays, numbers, strings, booleans, null, Buffers, typed arrays and Dates
+ * are supported, anything else throws. To put frames in front of it, e.g. a
+ * routing envelope, send `zmq.encode(value)` as the last part of a multipart
+ * message instead.
+ *
+ * Receivers get the value back as an 'object' event.
+ *
+ * @param {Mixed} value
+ * @param {Number} [flags]
+ * @param {Function} [cb]
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.sendObject = function(value, flags, cb) {
+  return this.send(zmq.encode(value), flags, cb);
+};
+
+/**
+ * Send the given `msg`.
+ *
+ * A part may also be given as `{gather: [buf1, buf2, ...]}`, which sends the
+ * pieces joined together as a single frame without concatenating them in
+ * JavaScript first.
+ *
+ * Instead of `flags` an options object `{flags, ttl, priority}` may be
+ * given. A message still queued `ttl` milliseconds later (default
+ * `Socket#ttl`) is dropped, and its callback gets an ETIMEDOUT error. Queued
+ * messages with a higher `priority` (0 to 3, default 0) are sent first,
+ * weighted by `Socket#priorityWeights`.
+ *
+ * @param {String|Buffer|Array|Object} msg
+ * @param {Number|Object} [flags]
+ * @param {Function} [cb]
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.send = function(msg, flags, cb) {
+  var self = this
+    , ttl = this.ttl
+    , lane = 0;
+
+  if (flags && typeof flags === 'object') {
+    if (flags.ttl !== undefined) ttl = flags.ttl;
+    if (flags.priority) lane = this._lane(flags.priority);
+    flags = flags.flags;
+  }
+  flags = flags | 0;
+
+  if (this.coalesce && !this._tickCorked) {
+    // everything sent during this tick goes out in one native call
+    this._tickCorked = true;
+    this.cork();
+    process.nextTick(function () {
+      self._tickCorked = false;
+      self.uncork();
+    });
+  }
+
+  if (Array.isArray(msg)) {
+    if (this.type === 'server' && typeof msg[0] === 'number') {
+      msg = [routingId(msg[0])].concat(msg.slice(1));
+    }
+
+    for (var i = 0, len = msg.length; i < len; i++) {
+      var isLast = i === len - 1;
+      var msgFlags = isLast ? flags : flags | zmq.ZMQ_SNDMORE;
+      var callback = isLast ? cb : undefined;
+
+      this._append(msg[i], msgFlags, callback, lane);
+    }
+  } else {
+    this._append(msg, flags, cb, lane);
+  }
+
+  if (ttl > 0 && (flags & zmq.ZMQ_SNDMORE) === 0) {
+    this._outgoing.setDeadline(Date.now() + ttl);
+    this._startExpiryTimer();
+  }
+
+  this._kickWrites();
+  return this;
+};
+
+/**
+ * Drop every queued message whose ttl ran out. Only walks the queue once
+ * the earliest deadline has passed. Every expired message's callbacks run
+ * even when one throws; the first error is rethrown afterwards.
+ */
+
+Socket.prototype._expireWrites = function () {
+  var expired = this._outgoing.expire(Date.now())
+    , failure = null
+    , error, i, j, cbs;
+
+  this._expired += expired.length;
+
+  for (i = 0; i < expired.length; i += 1) {
+    cbs = expired[i].cbs;
+    for (j = 0; j < cbs.length; j += 1) {
+      error = new Error('Message expired before it could be sent');
+      error.code = 'ETIMEDOUT';
+      try {
+        cbs[j].call(this, error);
+      } catch (err) {
+        if (!failure) failure = err;
+      }
+    }
+  }
+
+  if (failure) throw failure;
+};
+
+/**
+ * Expire queued messages at the earliest deadline without waiting for the
+ * next send. The timer does not keep the process alive on its own.
+ */
+
+Socket.prototype._startExpiryTimer = function () {
+  var self = this
+    , deadline = this._outgoing.nextDeadline;
+
+  if (deadline >= this._expiryAt) return;
+  if (this._expiryTimer) clearTimeout(this._expiryTimer);
+
+  this._expiryAt = deadline;
+  this._expiryTimer = setTimeout(function () {
+    self._expiryTimer = null;
+    self._expiryAt = Infinity;
+    try {
+      self._expireWrites();
+    } catch (error) {
+      self.emit('error', error); // can throw
+    } finally {
+      if (self._outgoing.length) {
+        self._startExpiryTimer();
+      }
+    }
+  }, Math.max(deadline - Date.now(), 0));
+  if (this._expiryTimer.unref) this._expiryTimer.unref();
+};
+
+/**
+ * Expiry counter: `expired` messages dropped because their ttl ran out.
+ *
+ * @return {Object}
+ * @api public
+ */
+
+Socket.prototype.expiryStats = function() {
+  return { expired: this._expired };
+};
+
+/**
+ * Spool counters: `spooled` messages and `spooledBytes` waiting on disk in
+ * `segments` files, see `spoolThreshold`.
+ *
+ * @return {Object}
+ * @api public
+ */
+
+Socket.prototype.spoolStats = function() {
+  return this._spoolList
+    ? this._spoolList.stats()
+    : { spooled: 0, spooledBytes: 0, segments: 0 };
+};
+
+// the outgoing queue, created when the socket first needs one
+Socket.prototype._queue = function () {
+  if (this._outgoing === NO_OUTGOING) {
+    this._outgoing = new BatchList();
+  }
+  return this._outgoing;
+};
+
+Socket.prototype._append = function (part, flags, cb, lane) {
+  var outgoing = this._queue();
+  if (this.compression && (flags & zmq.ZMQ_SNDMORE) === 0) {
+    this._appendCompressed(part, flags, cb, lane);
+  } else {
+    outgoing.append(part, flags, cb, lane);
+  }
+};
+
+// switches the socket to a LaneList on first use and returns the lane
+Socket.prototype._lane = function (priority) {
+  if (priority !== (priority | 0) || priority < 0 || priority >= PRIORITY_LANES) {
+    throw new RangeError('Priority must be an integer from 0 to ' + (PRIORITY_LANES - 1));
+  }
+
+  if (!(this._outgoing instanceof LaneList)) {
+    this._outgoing = new LaneList(this._queue(), this.priorityWeights);
+  }
+  this._outgoing.weights = this.priorityWeights;
+  return priority;
+};
+
+Socket.prototype._kickWrites = function () {
+  if (this._outgoing.canSend()) {
+    if (this._corked) {
+      this._startCorkTimer();
+    } else {
+      this._zmq.pending = true;
+      this._flushWrites();
+    }
+  } else {
+    this._zmq.pending = false;
+  }
+};
+
+/**
+ * Queue the last part of a message behind a compression header. Parts over
+ * the threshold are deflated on the threadpool. Their batch stays in the
+ * queue, holding back everything queued after it, until deflate is done.
+ */
+
+Socket.prototype._appendCompressed = function (part, flags, cb, lane) {
+  var self = this
+    , stats = this._compression()
+    , buf, batch, index, start, options;
+
+  if (Buffer.isBuffer(part)) {
+    buf = part;
+  } else if (part && Array.isArray(part.gather)) {
+    buf = Buffer.concat(toBuffers(part.gather));
+  } else {
+    buf = new Buffer(String(part), 'utf8');
+  }
+
+  if (buf.length < this.compressionThreshold) {
+    stats.uncompressed += 1;
+    this._outgoing.append({ gather: [COMPRESSION_RAW, buf] }, flags, cb, lane);
+    return;
+  }
+
+  this._outgoing.append(EMPTY, flags, cb, lane);
+  batch = this._outgoing.lastBatch;
+  index = batch.content.length - 2;
+  batch.pending += 1;
+  start = process.hrtime();
+
+  function done(error, deflated) {
+    batch.pending -= 1;
+    stats.compressTime += elapsed(start);
+
+    if (error || deflated.length + 1 >= buf.length) {
+      stats.uncompressed += 1;
+      batch.content[index] = [COMPRESSION_RAW, buf];
+    } else {
+      stats.compressed += 1;
+      stats.bytesIn += buf.length;
+      stats.bytesOut += deflated.length + 1;
+      batch.content[index] = [COMPRESSION_DEFLATE, deflated];
+    }
+
+    if (!batch.pending && self._zmq.state !== zmq.STATE_CLOSED) {
+      self._kickWrites();
+    }
+  }
+
+  // zlib in node 0.10 takes no options
+  if (this.compressionLevel === null) {
+    zlib.deflateRaw(buf, done);
+  } else {
+    options = { level: this.compressionLevel };
+    zlib.deflateRaw(buf, options, done);
+  }
+};
+
+Socket.prototype._compression = function () {
+  return this._compressionStats || (this._compressionStats = new CompressionStats());
+};
+
+/**
+ * Compression counters, see `CompressionStats`.
+ *
+ * @return {Object}
+ * @api public
+ */
+
+Socket.prototype.compressionStats = function() {
+  var stats = this._compression();
+  stats.ratio = stats.bytesIn ? stats.bytesOut / stats.bytesIn : 0;
+  return stats;
+};
+
+Socket.prototype._emitMessage = function (message) {
+  if (this.compression) {
+    return this._receiveCompressed(message);
+  }
+
+  if (this._decode) {
+    return this._emitObject(message);
+  }
+
+  if (message.length === 1) {
+    // hot path
+    this.emit('message', message[0]);
+  } else {
+    this.emit.apply(this, ['message'].concat(message));
+  }
+}
+
+/**
+ * Strip the compression header of an incoming message. Deflated parts are
+ * inflated on the threadpool; messages are still emitted in the order they
+ * arrived. Reading stops while MAX_INFLATING messages wait.
+ */
+
+Socket.prototype._receiveCompressed = function (message) {
+  var self = this
+    , last = message.length - 1
+    , part = message[last]
+    , entry, start;
+
+  if (!Buffer.isBuffer(part) || !part.length || part[0] > 1) {
+    this.emit('error', new Error('Received a part without a valid compression header'));
+    return;
+  }
+
+  message[last] = part.slice(1);
+
+  if (part[0] === 0 && !(this._inflating && this._inflating.length)) {
+    return this._emitDecompressed(message);
+  }
+
+  entry = { message: message, error: null, done: part[0] === 0 };
+  (this._inflating || (this._inflating = [])).push(entry);
+
+  if (!entry.done) {
+    start = process.hrtime();
+    zlib.inflateRaw(message[last], function (error, inflated) {
+      var stats = self._compression();
+      stats.inflateTime += elapsed(start);
+      stats.inflated += 1;
+      entry.done = true;
+      entry.error = error;
+      message[last] = inflated;
+      self._flushInflated();
+    });
+  }
+};
+
+Socket.prototype._flushInflated = function () {
+  var wasFull = this._inflating.length >= MAX_INFLATING
+    , entry;
+
+  while (this._inflating.length && this._inflating[0].done) {
+    entry = this._inflating.shift();
+    if (entry.error) {
+      this.emit('error', entry.error);
+    } else {
+      this._emitDecompressed(entry.message);
+    }
+  }
+
+  if (wasFull && this._inflating.length < MAX_INFLATING) {
+    this._flushReads();
+  }
+};
+
+Socket.prototype._emitDecompressed = function (message) {
+  if (this._decode) {
+    var last = message.length - 1;
+    try {
+      message[last] = zmq.decode(message[last]);
+    } catch (error) {
+      message[last] = error;
+    }
+    return this._emitObject(message);
+  }
+
+  if (message.length === 1) {
+    this.emit('message', message[0]);
+  } else {
+    this.emit.apply(this, ['message'].concat(message));
+  }
+};
+
+Socket.prototype._emitTimed = function (message) {
+  var start = hrnow()
+    , receivedAt = message.receivedAt;
+
+  this.receivedAt = receivedAt;
+  try {
+    this._emitMessage(message);
+  } finally {
+    this._zmq.recordHandling(start - receivedAt, hrnow() - start);
+  }
+};
+
+Socket.prototype._emitObject = function (message) {
+  var value = message[message.length - 1];
+  if (value instanceof Error) {
+    this.emit('error', value);
+  } else if (message.length === 1) {
+    this.emit('object', value);
+  } else {
+    this.emit.apply(this, ['object'].concat(message));
+  }
+};
+
+Socket.prototype._flushRead = function () {
+  try {
+    var message = this._zmq.readv(); // can throw
+    if (!message) {
+      return false;
+    }
+    // Handle received message immediately to prevent memory leak in driver
+    if (this._timestamps) {
+      this._emitTimed(message);
+    } else {
+      this._emitMessage(message)
+    }
+    return message;
+  } catch (error) {
+    this.emit('error', error); // can throw
+  }
+  return true;
+};
+
+Socket.prototype._flushWrite = function () {
+  var batch = this._outgoing.fetch();
+  if (!batch) {
+    this._zmq.pending = false;
+    return false;
+  }
+
+  try {
+    if (this._zmq.sendv(batch.content)) {
+      this._zmq.pending = this._outgoing.canSend();
+      batch.invokeSent(this);
+      return true;
+    }
+
+    this._outgoing.restore(batch);
+    this._zmq.pending = true;
+    return false;
+  } catch (sendError) {
+    this._zmq.pending = this._outgoing.canSend();
+    batch.invokeError(this, sendError); // can throw
+    return false;
+  }
+};
+
+Socket.prototype._flushWriteMany = function () {
+  var batches = this._outgoing.fetchMany(MAX_BATCHES_PER_SEND)
+    , content = []
+    , sendError = null
+    , sent, i;
+
+  if (!batches.length) {
+    this._zmq.pending = false;
+    return false;
+  }
+
+  for (i = 0; i < batches.length; i += 1) {
+    content.push.apply(content, batches[i].content);
+  }
+
+  try {
+    sent = this._zmq.sendMany(content);
+  } catch (error) {
+    sendError = error;
+    sent = error.sent | 0;
+  }
+
+  // the batch that failed is dropped, anything after it goes back in the queue
+  var unsent = sendError ? sent + 1 : sent;
+  for (i = batches.length - 1; i >= unsent; i -= 1) {
+    this._outgoing.restore(batches[i]);
+  }
+  this._zmq.pending = sendError ? this._outgoing.canSend() : true;
+
+  for (i = 0; i < sent; i += 1) {
+    batches[i].invokeSent(this);
+  }
+
+  if (sendError) {
+    if (sent === batches.length) {
+      throw sendError; // everything went out, the error came after
+    }
+    batches[sent].invokeError(this, sendError); // can throw
+    return false;
+  }
+
+  if (sent < batches.length) {
+    return false;
+  }
+
+  this._zmq.pending = this._outgoing.canSend();
+  return true;
+};
+
+
+Socket.prototype._flushReads = function() {
+  if (this._iterator) {
+    // pull mode: the iterator reads on demand, we only wake it up
+    this._iterator._wake();
+    this._flushWrites();
+    return;
+  }
+
+  // a socket waiting for its turn in the read queue does not jump ahead
+  if (this._paused || this._isFlushingReads || this._readScheduled || this._busy) return;
+
+  // too many messages waiting for inflate, the rest stays in ØMQ for now;
+  // _flushInflated() reads again once there is room
+  if (this._inflatingFull()) return;
+
+  this._isFlushingReads = true;
+
+  if (this.conflate) {
+    this._flushConflated();
+  } else if (this.readBudget > 0 || this.readBudgetBytes > 0) {
+    this._flushReadsWithBudget();
+  } else {
+    while (this._flushRead() && !this._inflatingFull());
+  }
+
+  this._isFlushingReads = false;
+
+  // if many sends happened, but ended up in the queue (eg. in a req/rep scenario where each send must be followed by a
+  // response), we can try to send again now
+
+  this._flushWrites();
+};
+
+Socket.prototype._inflatingFull = function() {
+  return this._inflating !== null && this._inflating.length >= MAX_INFLATING;
+};
+
+Socket.prototype._flushReadsWithBudget = function() {
+  var budget = this.readBudget
+    , byteBudget = this.readBudgetBytes
+    , messages = 0
+    , bytes = 0
+    , message;
+
+  while ((message = this._flushRead())) {
+    if (this._inflatingFull()) return;
+
+    if (byteBudget > 0 && message !== true) {
+      bytes += messageSize(message);
+    }
+
+    if ((budget > 0 && ++messages >= budget) || (byteBudget > 0 && bytes >= byteBudget)) {
+      // the rest stays in ØMQ until this socket's next turn
+      scheduleRead(this);
+      return;
+    }
+  }
+};
+
+/**
+ * Drain the socket through the binding's per topic conflation. Every call
+ * collapses up to `conflateWindow` queued messages down to the latest one
+ * for each distinct first part. `readBudget` and `readBudgetBytes` apply as
+ * usual, counting the messages read from ØMQ and the bytes emitted.
+ *
+ * Errors, from the binding or a listener, are emitted once every message
+ * already collected has been.
+ */
+
+Socket.prototype._flushConflated = function() {
+  var budget = this.readBudget
+    , byteBudget = this.readBudgetBytes
+    , messages = 0
+    , bytes = 0
+    , window
+    , batch
+    , errors;
+
+  do {
+    window = this.conflateWindow;
+    if (budget > 0) window = Math.min(window, budget - messages);
+
+    try {
+      batch = this._zmq.readConflated(window); // can throw
+    } catch (error) {
+      this.emit('error', error); // can throw
+      return;
+    }
+
+    if (!batch) return;
+
+    errors = batch.error ? [batch.error] : [];
+    for (var i = 0; i < batch.length; i += 1) {
+      if (byteBudget > 0) bytes += messageSize(batch[i]);
+      try {
+        if (this._timestamps) {
+          this._emitTimed(batch[i]);
+        } else {
+          this._emitMessage(batch[i]);
+        }
+      } catch (error) {
+        errors.push(error);
+      }
+    }
+    messages += batch.read;
+
+    for (i = 0; i < errors.length; i += 1) {
+      this.emit('error', errors[i]); // can throw
+    }
+    if (errors.length) return;
+
+    if (batch.length && ((budget > 0 && messages >= budget) || (byteBudget > 0 && bytes >= byteBudget))) {
+      // the rest stays in ØMQ until this socket's next turn
+      scheduleRead(this);
+      return;
+    }
+  } while (batch.length && !this._inflatingFull());
+};
+
+Socket.prototype._flushWrites = function(force) {
+  if (this._paused || this._isFlushingWrites || this._busy) return;
+  if (this._corked && !force) return;
+
+  this._isFlushingWrites = true;
+
+  var sent;
+
+  try {
+    this._expireWrites();
+  } catch (error) {
+    this._isFlushingWrites = false;
+    this.emit('error', error); // can throw
+    return;
+  }
+
+  do {
+    try {
+      // a backlog of batches goes out in one native call
+      sent = this._outgoing.length > 1 ? this._flushWriteMany() : this._flushWrite();
+    } catch (error) {
+      this._isFlushingWrites = false;
+      this.emit('error', error); // can throw
+      return;
+    }
+  } while (sent);
+
+  this._isFlushingWrites = false;
+};
+
+/**
+ * Close the socket.
+ *
+ * @return {Socket} for chaining
+ * @api public
+ */
+
+Socket.prototype.close = function() {
+  if (this._corkTimer) {
+    clearTimeout(this._corkTimer);
+    this._corkTimer = null;
+  }
+  if (this._expiryTimer) {
+    clearTimeout(this._expiryTimer);
+    this._expiryTimer = null;
+    this._expiryAt = Infinity;
+  }
+  if (shards) shards.remove(this);
+  if (this._spoolList) this._spoolList.close();
+  this._zmq.close();
+  delete liveSockets[this._id];
+  if (this._iterator) {
+    this._iterator._finish();
+  }
+  return this;
+};
+
+/**
+ * Close the socket without holding up the event loop. Queued messages are
+ * flushed until `options.timeout` ms (1000 by default) have passed; the
+ * rest are dropped and their callbacks get an `ECLOSED` error. Whatever is
+ * left of the deadline becomes the socket's linger, so `Context.terminateAsync`
+ * never waits longer than that for libzmq to deliver.
+ *
+ * `cb(null, { flushed, dropped })` counts messages, a promise is returned
+ * instead when no callback is given.
+ *
+ * @param {Object} options
+ * @param {Function} cb
+ * @return {Socket|Promise}
+ * @api public
+ */
+
+Socket.prototype.closeAsync = function(options, cb) {
+  if ('function' == typeof options) cb = options, options = null;
+  var self = this
+    , timeout = options && options.timeout !== undefined ? options.timeout : 1000
+    , deadline = Date.now() + timeout
+    , queued = this._outgoing.length
+    , promise;
+
+  if (!cb && typeof Promise === 'function') {
+    promise = new Promise(function (resolve, reject) {
+      cb = function (err, result) { err ? reject(err) : resolve(result); };
+    });
+  }
+
+  function drain() {
+    self._flushWrites(true);
+    // a bind job owns the native socket until it calls back, and may not
+    // be interrupted
+    if (self._busy || (self._outgoing.length && Date.now() < deadline)) {
+      return setTimeout(drain, Math.max(0, Math.min(5, deadline - Date.now())));
+    }
+    finish();
+  }
+
+  function finish() {
+    var dropped = self._outgoing.length
+      , cbs = self._outgoing.callbacks()
+      , error = new Error('Socket closed before the message was sent');
+    error.code = 'ECLOSED';
+
+    self._outgoing = NO_OUTGOING;
+
+    try {
+      self._zmq.setsockopt(zmq.ZMQ_LINGER, Math.max(0, deadline - Date.now()));
+      self.close();
+    } catch (err) {
+      if (cb) return cb(err);
+      throw err;
+    }
+    for (var i = 0; i < cbs.length; i += 1) {
+      cbs[i].call(self, error);
+    }
+    if (cb) cb(null, { flushed: Math.max(0, queued - dropped), dropped: dropped });
+  }
+
+  drain();
+  return promise || this;
+};
+
+/**
+ * Create a `type` socket with the given `options`.
+ *
+ * @param {String} type
+ * @param {Object} options
+ * @return {Socket}
+ * @api public
+ */
+
+exports.socket =
+exports.createSocket = function(type, options) {
+  var sock = new Socket(type);
+  if (options) sock.configure(options);
+  return sock;
+};
+
+exports.Context.setMaxThreads = function(value) {
+  if (!zmq.ZMQ_CAN_SET_CTX) {
+    throw new Error('Setting of context options disabled, check zmq version is >= 3.2.1 and recompile this addon');
+  }
+  var defaultCtx = defaultContext();
+  defaultCtx.setOpt(zmq.ZMQ_IO_THREADS, value);
+};
+
+exports.Context.getMaxThreads = function() {
+  if (!zmq.ZMQ_CAN_SET_CTX) {
+    throw new Error('Getting of context options disabled, check zmq version is >= 3.2.1 and recompile this addon');
+  }
+  var defaultCtx = defaultContext();
+  return defaultCtx.getOpt(zmq.ZMQ_IO_THREADS);
+};
+
+exports.Context.setMaxSockets = function(value) {
+  if (!zmq.ZMQ_CAN_SET_CTX) {
+    throw new Error('Setting of context options disabled, check zmq version is >= 3.2.1 and recompile this addon');
+  }
+  var defaultCtx = defaultContext();
+  defaultCtx.setOpt(zmq.ZMQ_MAX_SOCKETS, value);
+};
+
+exports.Context.getMaxSockets = function() {
+  if (!zmq.ZMQ_CAN_SET_CTX) {
+    throw new Error('Getting of context options disabled, check zmq version is >= 3.2.1 and recompile this addon');
+  }
+  var defaultCtx = defaultContext();
+  return defaultCtx.getOpt(zmq.ZMQ_MAX_SOCKETS);
+};
+
+/**
+ * Linux scheduling policies accepted by `setThreadOptions()`.
+ */
+
+var schedPolicies = exports.schedPolicies = {
+    other: 0
+  , fifo: 1
+  , rr: 2
+  , batch: 3
+  , idle: 5
+};
+
+// libzmq starts the I/O threads with the first socket, after which thread
+// options no longer apply.
+var ioThreadsStarted = false;
+
+// sockets of the default context with endpoints by id, for terminateAsync.
+// The binding holds on to those anyway, so this keeps nothing alive; an
+// unused socket can still be collected.
+var liveSockets = {}
+  , lastSocketId = 0;
+
+function track(sock) {
+  if (sock._zmq.endpoints > 0) {
+    liveSockets[sock._id] = sock;
+  } else {
+    delete liveSockets[sock._id];
+  }
+}
+
+function requireCtxOption(name) {
+  if (zmq[name] === undefined) {
+    throw new Error(name + ' is not supported, check zmq version is >= 4.3 and recompile this addon');
+  }
+}
+
+function applyThreadOptions(context, options) {
+  if (!zmq.ZMQ_CAN_SET_CTX) {
+    throw new Error('Setting of context options disabled, check zmq version is >= 3.2.1 and recompile this addon');
+  }
+
+  var cpus = options.cpus
+    , policy = options.schedPolicy;
+
+  if ('numa' == cpus) {
+    cpus = exports.numaCpus(context.getOpt(zmq.ZMQ_IO_THREADS), options.numaNode);
+  }
+  if (cpus !== undefined) {
+    if (!Array.isArray(cpus) || !cpus.every(function(cpu){ return cpu >= 0 && cpu % 1 === 0; })) {
+      throw new TypeError('cpus must be an array of cpu numbers or "numa"');
+    }
+    requireCtxOption('ZMQ_THREAD_AFFINITY_CPU_ADD');
+    cpus.forEach(function(cpu){
+      context.setOpt(zmq.ZMQ_THREAD_AFFINITY_CPU_ADD, cpu);
+    });
+  }
+
+  if ('string' == typeof policy) {
+    if (!schedPolicies.hasOwnProperty(policy)) {
+      throw new TypeError('Unknown scheduling policy: ' + policy);
+    }
+    policy = schedPolicies[policy];
+  }
+  if (policy !== undefined) {
+    requireCtxOption('ZMQ_THREAD_SCHED_POLICY');
+    context.setOpt(zmq.ZMQ_THREAD_SCHED_POLICY, policy);
+  }
+
+  if (options.priority !== undefined) {
+    requireCtxOption('ZMQ_THREAD_PRIORITY');
+    context.setOpt(zmq.ZMQ_THREAD_PRIORITY, options.priority);
+  }
+
+  if (options.namePrefix !== undefined) {
+    requireCtxOption('ZMQ_THREAD_NAME_PREFIX');
+    context.setOpt(zmq.ZMQ_THREAD_NAME_PREFIX, options.namePrefix);
+  }
+}
+
+/**
+ * Place and schedule the I/O threads of the default context. Must be
+ * called before the first socket is created.
+ *
+ *  - `cpus` cpu numbers the I/O threads may run on, or `'numa'` for
+ *    `numaCpus(io_threads, numaNode)`
+ *  - `numaNode` node used for `cpus: 'numa'`, defaults to 0
+ *  - `schedPolicy` one of `schedPolicies` or its number
+ *  - `priority` scheduling priority, 1-99 for `fifo` and `rr`
+ *  - `namePrefix` number prepended to the I/O thread names
+ *
+ * @param {Object} options
+ * @api public
+ */
+
+exports.Context.setThreadOptions = function(options) {
+  if (ioThreadsStarted) {
+    throw new Error('Thread options must be set before the first socket is created');
+  }
+  applyThreadOptions(defaultContext(), options || {});
+};
+
+/**
+ * Pick `count` cpus on NUMA `node` (0 by default) for the I/O threads. The
+ * last cpus of the node are used and its first cpu is left for the main
+ * thread. Falls back to all cpus where /sys has no NUMA topology.
+ *
+ * @param {Number} count
+ * @param {Number} node
+ * @return {Array}
+ * @api public
+ */
+
+exports.numaCpus = function(count, node) {
+  var cpus = nodeCpus(node || 0);
+  count = count || 1;
+  if (cpus.length > count) cpus = cpus.slice(1);
+  return cpus.slice(-count);
+};
+
+function nodeCpus(node) {
+  var list, cpus = [];
+  try {
+    list = fs.readFileSync('/sys/devices/system/node/node' + node + '/cpulist', 'utf8');
+  } catch (err) {
+    if (fs.existsSync('/sys/devices/system/node/node0')) throw new RangeError('No NUMA node ' + node);
+    return os.cpus().map(function(cpu, i){ return i; });
+  }
+  list.trim().split(',').forEach(function(range){
+    if (!range) return;
+    var bounds = range.split('-').map(Number);
+    for (var cpu = bounds[0]; cpu <= bounds[bounds.length - 1]; cpu++) cpus.push(cpu);
+  });
+  return cpus;
+}
+
+/**
+ * Spreads the sockets of the default context over its I/O threads by
+ * setting their ZMQ_AFFINITY, see `Context.setSharding()`.
+ */
+
+var shards = null;
+
+var shardPolicies = ['round-robin', 'least-loaded', 'key'];
+
+function IoShards(threads, policy) {
+  this.threads = threads;
+  this.policy = policy;
+  this.next = 0;                // next thread for round-robin
+  this.sockets = [];
+  this.sampledAt = Date.now();
+}
+
+IoShards.prototype.add = function(sock) {
+  var thread = 'least-loaded' == this.policy
+    ? this.leastLoaded()
+    : this.next++ % this.threads;
+  sock._shardTraffic = sock._zmq.traffic;
+  sock._shardRate = 0;
+  this.sockets.push(sock);
+  this.assign(sock, thread);
+};
+
+IoShards.prototype.remove = function(sock) {
+  var i = this.sockets.indexOf(sock);
+  if (i !== -1) this.sockets.splice(i, 1);
+};
+
+IoShards.prototype.assign = function(sock, thread) {
+  sock._zmq.setsockopt(zmq.ZMQ_AFFINITY, Math.pow(2, thread));
+  sock._ioThread = thread;
+};
+
+IoShards.prototype.keyThread = function(key) {
+  if ('number' == typeof key) return Math.abs(Math.floor(key)) % this.threads;
+  var hash = 5381;
+  key = String(key);
+  for (var i = 0; i < key.length; i++) {
+    hash = ((hash << 5) + hash + key.charCodeAt(i)) | 0;
+  }
+  return (hash >>> 0) % this.threads;
+};
+
+// byte rates are averaged since the previous sample, at most every 100ms
+IoShards.prototype.sample = function() {
+  var now = Date.now()
+    , elapsed = (now - this.sampledAt) / 1000;
+  if (elapsed < 0.1) return;
+  this.sampledAt = now;
+  this.sockets.forEach(function(sock){
+    var traffic = sock._zmq.traffic;
+    sock._shardRate = (traffic - sock._shardTraffic) / elapsed;
+    sock._shardTraffic = traffic;
+  });
+};
+
+IoShards.prototype.load = function() {
+  var load = [];
+  this.sample();
+  for (var i = 0; i < this.threads; i++) {
+    load.push({ sockets: 0, traffic: 0, byteRate: 0 });
+  }
+  this.sockets.forEach(function(sock){
+    var thread = load[sock._ioThread];
+    thread.sockets++;
+    thread.traffic += sock._zmq.traffic;
+    thread.byteRate += sock._shardRate;
+  });
+  return load;
+};
+
+IoShards.prototype.leastLoaded = function() {
+  var load = this.load()
+    , best = 0;
+  for (var i = 1; i < load.length; i++) {
+    if (load[i].byteRate < load[best].byteRate ||
+        (load[i].byteRate == load[best].byteRate && load[i].sockets < load[best].sockets)) {
+      best = i;
+    }
+  }
+  return best;
+};
+
+/**
+ * Size the default context's I/O threads and spread new sockets over them.
+ * Must be called before the first socket is created.
+ *
+ *  - `ioThreads` number of I/O threads, `'auto'` (the default) uses half
+ *    the cores, at most 64
+ *  - `policy` `'round-robin'` (the default), `'least-loaded'` by byte rate,
+ *    or `'key'` to place sockets by their `shardKey`
+ *
+ * @param {Object} options
  * @api public
  */
 
-Socket.prototype.disconnect = function(addr) {
-  if (zmq.ZMQ_CAN_DISCONNECT) {
-    this._zmq.disconnect(addr);
+exports.Context.setSharding = function(options) {
+  options = options || {};
+  if (ioThreadsStarted) {
+    throw new Error('Sharding must be set up before the first socket is created');
   }
-  return this;
+
+  var policy = options.policy || 'round-robin'
+    , threads = options.ioThreads;
+  if (shardPolicies.indexOf(policy) === -1) {
+    throw new TypeError('Unknown sharding policy: ' + policy);
+  }
+  if (threads === undefined || 'auto' == threads) {
+    threads = Math.max(1, Math.min(64, os.cpus().length >> 1));
+  }
+  if (!(threads >= 1 && threads <= 64) || threads % 1) {
+    throw new RangeError('ioThreads must be an integer from 1 to 64');
+  }
+
+  exports.Context.setMaxThreads(threads);
+  shards = new IoShards(threads, policy);
 };
 
 /**
- * Enable monitoring of a Socket
+ * Load of every I/O thread of a sharded default context, as
+ * `{ sockets, traffic, byteRate }` with traffic in bytes and the byte
+ * rate per second.
  *
- * @param {Number} timer interval in ms > 0 or Undefined for default
- * @param {Number} The maximum number of events to read on each interval, default is 1, use 0 for reading all events
- * @return {Socket} for chaining
+ * @return {Array}
  * @api public
  */
 
-Socket.prototype.monitor = function(interval, numOfEvents) {
-  if (zmq.ZMQ_CAN_MONITOR) {
-    var self = this;
+exports.Context.ioThreadLoad = function() {
+  return shards ? shards.load() : [];
+};
 
-    self._zmq.onMonitorEvent = function(event_id, event_value, event_endpoint_addr, ex) {
-      self.emit(events[event_id], event_value, event_endpoint_addr, ex);
-    }
+/**
+ * Terminate the default context without blocking the event loop: every
+ * bound or connected socket is closed with `closeAsync(options)`, then
+ * `zmq_term` runs on the threadpool. Sockets created afterwards get a fresh
+ * context. Other open sockets of the default context make it fail right
+ * away, without closing anything, since `zmq_term` would wait for them.
+ *
+ * `cb(err, { flushed, dropped })` sums the sockets' counts, a promise is
+ * returned instead when no callback is given.
+ *
+ * @param {Object} options
+ * @param {Function} cb
+ * @return {Promise}
+ * @api public
+ */
 
-    self._zmq.onMonitorError = function(error) {
-      self.emit('monitor_error', error);
+exports.Context.terminateAsync = function(options, cb) {
+  if ('function' == typeof options) cb = options, options = null;
+  var promise;
+
+  if (!cb && typeof Promise === 'function') {
+    promise = new Promise(function (resolve, reject) {
+      cb = function (err, result) { err ? reject(err) : resolve(result); };
+    });
+  }
+
+  var context = ctx
+    , sockets = liveSockets
+    , ids = Object.keys(sockets)
+    , pending = ids.length + 1
+    , totals = { flushed: 0, dropped: 0 }
+    , firstErr = null
+    , untracked = context ? context.sockets - ids.length : 0;
+
+  // zmq_term would wait forever for sockets we can't close, such as ones
+  // never bound or connected, so nothing is touched while there are any
+  if (untracked > 0) {
+    var error = new Error(untracked + ' socket(s) without endpoints are still open, close them first');
+    process.nextTick(function () {
+      if (cb) cb(error, totals);
+    });
+    return promise;
+  }
+
+  function done(err, result) {
+    if (err && !firstErr) firstErr = err;
+    if (result) {
+      totals.flushed += result.flushed;
+      totals.dropped += result.dropped;
+    }
+    if (--pending) return;
+    if (!context) return cb && cb(firstErr, totals);
+    try {
+      context.closeAsync(function (err) {
+        if (cb) cb(firstErr || err || null, totals);
+      });
+    } catch (err) {
+      // a socket that failed to close keeps the context open
+      if (cb) cb(firstErr || err, totals);
     }
+  }
 
-    this._zmq.monitor(interval, numOfEvents);
-  } else {
-    throw new Error('Monitoring support disabled check zmq version is > 3.2.1 and recompile this addon');
+  ctx = null;
+  shards = null;
+  ioThreadsStarted = false;
+  liveSockets = {};
+
+  for (var i = 0; i < ids.length; i += 1) {
+    sockets[ids[i]].closeAsync(options, done);
   }
-  return this;
+  done();
+  return promise;
 };
 
 /**
- * Disable monitoring of a Socket release idle handler
- * and close the socket
+ * The I/O thread a socket was placed on, undefined without sharding.
+ */
+
+Socket.prototype.__defineGetter__('ioThread', function() {
+  return this._ioThread;
+});
+
+/**
+ * Place the socket on the I/O thread `shardKey` hashes to. Set it before
+ * bind or connect, for instance as a `createSocket` option.
+ */
+
+Socket.prototype.__defineGetter__('shardKey', function() {
+  return this._shardKey;
+});
+
+Socket.prototype.__defineSetter__('shardKey', function(key) {
+  if (!shards) throw new Error('Sharding is not enabled, see Context.setSharding()');
+  this._shardKey = key;
+  shards.assign(this, shards.keyThread(key));
+});
+
+/**
+ * Create a `type` socket on a shared memory ring, for processes on the
+ * same host. `shm://name` endpoints skip the kernel socket buffers and
+ * libzmq's stream engine: a message is copied into a memory mapped ring and
+ * out again. PULL sockets bind and any number of PUSH sockets connect; a
+ * PAIR socket binds or connects to one other PAIR socket, with a ring in
+ * each direction.
  *
- * @return {Socket} for chaining
+ * @constructor
+ * @param {String} type
  * @api public
  */
 
-Socket.prototype.unmonitor = function() {
-  if (zmq.ZMQ_CAN_MONITOR) {
-    this._zmq.unmonitor();
+var ShmSocket =
+exports.ShmSocket = function (type) {
+  if (!zmq.ZMQ_CAN_SHM) {
+    throw new Error('shm:// sockets are not supported on this platform');
   }
-  return this;
+  if (!shmTypes[type]) {
+    throw new TypeError('shm:// sockets are push, pull or pair, not ' + type);
+  }
+  EventEmitter.call(this);
+  this.type = type;
+  this._reader = null;  // ring we read from, created by bind or connect
+  this._writer = null;  // ring we write to, opened on first send
+  this._peer = null;    // paths of the ring we write to
+  this._outgoing = new BatchList();
+  this._paused = false;
+  this._isFlushingReads = false;
 };
 
+util.inherits(ShmSocket, EventEmitter);
+
+var shmTypes = { push: true, pull: true, pair: true };
+
+ShmSocket.prototype.capacity = 4 * 1024 * 1024;  // bytes in the ring we read from
+ShmSocket.prototype.readBudget = 0;  // max messages per wakeup, 0 for no limit
+ShmSocket.prototype.busyPoll = 0;    // usecs to watch an empty ring before sleeping
+ShmSocket.prototype.sendTimeout = 30000;  // ms a full ring may hold sends, 0 for no limit
+ShmSocket.prototype._retryTimer = null;
+ShmSocket.prototype._retryDelay = 1;
+ShmSocket.prototype._fullSince = 0;
+ShmSocket.prototype._stallTimer = null;
+
+// rings live in /dev/shm where there is one, `side` tells the two rings
+// of a PAIR apart
+function shmPaths(addr, side) {
+  var match = /^shm:\/\/([\w.-]+)$/.exec(addr);
+  if (!match) throw new TypeError('Invalid shm:// address: ' + addr);
+  var base = (fs.existsSync('/dev/shm') ? '/dev/shm' : os.tmpdir())
+    + '/zmq-' + match[1] + (side === undefined ? '' : '.' + side);
+  return { ring: base + '.ring', wake: base + '.wake' };
+}
 
 /**
- * Subscribe with the given `filter`.
+ * Create the ring behind `addr` and read from it. Like ipc:// a stale ring
+ * left behind by a dead process is replaced.
  *
- * @param {String} filter
- * @return {Socket} for chaining
+ * @param {String} addr
+ * @param {Function} cb
+ * @return {ShmSocket} for chaining
  * @api public
  */
 
-Socket.prototype.subscribe = function(filter) {
-  this._subscribe = filter;
+ShmSocket.prototype.bind = function(addr, cb) {
+  if ('push' == this.type) {
+    throw new Error('shm:// push sockets connect to a bound pull socket');
+  }
+  if ('pair' == this.type) {
+    this._listen(shmPaths(addr, 0));
+    this._peer = shmPaths(addr, 1);
+  } else {
+    this._listen(shmPaths(addr));
+  }
+  if (cb) process.nextTick(cb);
   return this;
 };
 
+ShmSocket.prototype.bindSync = ShmSocket.prototype.bind;
+
 /**
- * Unsubscribe with the given `filter`.
+ * Write to the ring behind `addr`. Messages queue until it has been bound.
  *
- * @param {String} filter
- * @return {Socket} for chaining
+ * @param {String} addr
+ * @return {ShmSocket} for chaining
  * @api public
  */
 
-Socket.prototype.unsubscribe = function(filter) {
-  this._unsubscribe = filter;
+ShmSocket.prototype.connect = function(addr) {
+  if ('pull' == this.type) {
+    throw new Error('shm:// pull sockets bind, push sockets connect to them');
+  }
+  if ('pair' == this.type) {
+    this._listen(shmPaths(addr, 1));
+    this._peer = shmPaths(addr, 0);
+  } else {
+    this._peer = shmPaths(addr);
+  }
+  this._flushWrites();
   return this;
 };
 
+ShmSocket.prototype._listen = function(paths) {
+  if (this._reader) throw new Error('Socket is already bound or connected');
+  var capacity = 4096;
+  while (capacity < this.capacity) capacity *= 2;
+  this._reader = new zmq.ShmRing(paths.ring, paths.wake, capacity);
+  this._reader._socket = this;
+  this._reader.onReadReady = onShmReadReady;
+};
+
+function onShmReadReady() {
+  this._socket._flushReads();
+}
 
 /**
- * Send the given `msg`.
+ * Send the given `msg`, see `Socket#send`. Only SNDMORE is understood
+ * in `flags`.
  *
  * @param {String|Buffer|Array} msg
- * @param {Number} [flags]
- * @param {Function} [cb]
- * @return {Socket} for chaining
+ * @param {Number} flags
+ * @param {Function} cb
+ * @return {ShmSocket} for chaining
  * @api public
  */
 
-Socket.prototype.send = function(msg, flags, cb) {
+ShmSocket.prototype.send = function(msg, flags, cb) {
   flags = flags | 0;
-
   if (Array.isArray(msg)) {
     for (var i = 0, len = msg.length; i < len; i++) {
       var isLast = i === len - 1;
-      var msgFlags = isLast ? flags : flags | zmq.ZMQ_SNDMORE;
-      var callback = isLast ? cb : undefined;
-
-      this._outgoing.append(msg[i], msgFlags, callback);
+      this._outgoing.append(msg[i], isLast ? flags : flags | zmq.ZMQ_SNDMORE, isLast ? cb : undefined);
     }
   } else {
     this._outgoing.append(msg, flags, cb);
   }
-
-  if (this._outgoing.canSend()) {
-    this._zmq.pending = true;
-    this._flushWrites();
-  } else {
-    this._zmq.pending = false;
-  }
-
+  this._flushWrites();
   return this;
 };
 
-Socket.prototype._emitMessage = function (message) {
-  if (message.length === 1) {
-    // hot path
-    this.emit('message', message[0]);
-  } else {
-    this.emit.apply(this, ['message'].concat(message));
+ShmSocket.prototype._flushWrites = function() {
+  var batch, written;
+  if (!this._peer || !this._outgoing.canSend()) return;
+
+  if (!this._writer) {
+    try {
+      this._writer = new zmq.ShmRing(this._peer.ring, this._peer.wake);
+    } catch (err) {
+      // not bound yet, or still being set up
+      if ('ENOENT' != err.code && 'EPROTO' != err.code) throw err;
+      return this._retryWrites();
+    }
   }
-}
 
-Socket.prototype._flushRead = function () {
-  try {
-    var message = this._zmq.readv(); // can throw
-    if (!message) {
-      return false;
+  while ((batch = this._outgoing.fetch())) {
+    try {
+      written = this._writer.write(batch.content);
+    } catch (err) {
+      if ('ECONNRESET' == err.code) {
+        // the reader went away, wait for it to bind again
+        this._writer.close();
+        this._writer = null;
+        this._outgoing.restore(batch);
+        return this._retryWrites();
+      }
+      batch.invokeError(this, err); // can throw
+      continue;
     }
-    // Handle received message immediately to prevent memory leak in driver
-    this._emitMessage(message)
-  } catch (error) {
-    this.emit('error', error); // can throw
+    if (!written) {
+      // full, the ring doesn't tell writers when it drains
+      this._outgoing.restore(batch);
+      if (!this._fullSince) {
+        this._fullSince = Date.now();
+      } else if (this.sendTimeout > 0 && Date.now() - this._fullSince >= this.sendTimeout) {
+        this._fullSince = 0;
+        return this._failWrites();
+      }
+      return this._retryWrites();
+    }
+    this._fullSince = 0;
+    this._retryDelay = 1;
+    batch.invokeSent(this);
   }
-  return true;
 };
 
-Socket.prototype._flushWrite = function () {
-  var batch = this._outgoing.fetch();
-  if (!batch) {
-    this._zmq.pending = false;
-    return false;
-  }
+// backs off from 1ms to 16ms while the ring stays full or unbound
+ShmSocket.prototype._retryWrites = function() {
+  var self = this;
+  if (this._retryTimer) return;
+  this._retryTimer = setTimeout(function() {
+    self._retryTimer = null;
+    self._flushWrites();
+  }, this._retryDelay);
+  this._retryDelay = Math.min(this._retryDelay * 2, 16);
+};
 
-  try {
-    if (this._zmq.sendv(batch.content)) {
-      this._zmq.pending = this._outgoing.canSend();
-      batch.invokeSent(this);
-      return true;
-    }
+/**
+ * Drop every queued message once the ring took none for `sendTimeout`
+ * milliseconds; their callbacks get an ETIMEDOUT error. Every callback
+ * runs even when one throws, the first error is rethrown afterwards.
+ */
 
-    this._outgoing.restore(batch);
-    return false;
-  } catch (sendError) {
-    this._zmq.pending = this._outgoing.canSend();
-    batch.invokeError(this, sendError); // can throw
-    return false;
+ShmSocket.prototype._failWrites = function() {
+  var failure = null
+    , batch, error, i;
+
+  while ((batch = this._outgoing.fetch())) {
+    for (i = 0; i < batch.cbs.length; i += 1) {
+      error = new Error('shm:// ring stayed full for ' + this.sendTimeout + 'ms');
+      error.code = 'ETIMEDOUT';
+      try {
+        batch.cbs[i].call(this, error);
+      } catch (err) {
+        if (!failure) failure = err;
+      }
+    }
   }
-};
-
 
-Socket.prototype._flushReads = function() {
-  if (this._paused || this._isFlushingReads) return;
+  if (failure) throw failure;
+};
 
+ShmSocket.prototype._flushReads = function() {
+  if (this._paused || this._isFlushingReads || !this._reader) return;
   this._isFlushingReads = true;
 
-  while (this._flushRead());
-
-  this._isFlushingReads = false;
+  var self = this
+    , budget = this.readBudget
+    , messages;
 
-  // if many sends happened, but ended up in the queue (eg. in a req/rep scenario where each send must be followed by a
-  // response), we can try to send again now
+  try {
+    do {
+      // the ring only sleeps once a read comes back empty
+      messages = this._reader.readMany(budget || 1000, this.busyPoll);
+      for (var i = 0; i < messages.length; i += 1) {
+        if (messages[i].length === 1) {
+          this.emit('message', messages[i][0]);
+        } else {
+          this.emit.apply(this, ['message'].concat(messages[i]));
+        }
+      }
+    } while (messages.length && !budget && !this._paused && this._reader);
+  } finally {
+    this._isFlushingReads = false;
+  }
 
-  this._flushWrites();
+  if (budget && messages.length && this._reader) {
+    setImmediate(function() { self._flushReads(); });
+  } else if (!messages.length && this._reader && this._reader.used && !this._stallTimer) {
+    // a writer claimed space but hasn't committed it, and nobody wakes us
+    // when the ring gives up on a writer that died
+    this._stallTimer = setTimeout(function() {
+      self._stallTimer = null;
+      self._flushReads();
+    }, 10);
+    if (this._stallTimer.unref) this._stallTimer.unref();
+  }
 };
 
-Socket.prototype._flushWrites = function() {
-  if (this._paused || this._isFlushingWrites) return;
-
-  this._isFlushingWrites = true;
+ShmSocket.prototype.pause = function() {
+  this._paused = true;
+};
 
-  var sent;
+ShmSocket.prototype.resume = function() {
+  this._paused = false;
+  this._flushReads();
+};
 
-  do {
-    try {
-      sent = this._flushWrite();
-    } catch (error) {
-      this._isFlushingWrites = false;
-      this.emit('error', error); // can throw
-      return;
-    }
-  } while (sent);
+ShmSocket.prototype.ref = function() {
+  if (this._reader) this._reader.ref();
+  return this;
+};
 
-  this._isFlushingWrites = false;
+ShmSocket.prototype.unref = function() {
+  if (this._reader) this._reader.unref();
+  return this;
 };
 
 /**
- * Close the socket.
+ * Close the socket. A bound ring is removed, messages still queued for the
+ * peer are dropped.
  *
- * @return {Socket} for chaining
+ * @return {ShmSocket} for chaining
  * @api public
  */
 
-Socket.prototype.close = function() {
-  this._zmq.close();
+ShmSocket.prototype.close = function() {
+  if (this._retryTimer) {
+    clearTimeout(this._retryTimer);
+    this._retryTimer = null;
+  }
+  if (this._stallTimer) {
+    clearTimeout(this._stallTimer);
+    this._stallTimer = null;
+  }
+  if (this._reader) this._reader.close();
+  if (this._writer) this._writer.close();
+  this._reader = this._writer = this._peer = null;
+  this._outgoing = new BatchList();
   return this;
 };
 
 /**
- * Create a `type` socket with the given `options`.
+ * Create a `type` shared memory socket with the given `options`, see
+ * `ShmSocket`.
  *
  * @param {String} type
  * @param {Object} options
- * @return {Socket}
+ * @return {ShmSocket}
  * @api public
  */
 
-exports.socket =
-exports.createSocket = function(type, options) {
-  var sock = new Socket(type);
+exports.shmSocket = function(type, options) {
+  var sock = new ShmSocket(type);
   for (var key in options) sock[key] = options[key];
   return sock;
 };
 
-exports.Context.setMaxThreads = function(value) {
-  if (!zmq.ZMQ_CAN_SET_CTX) {
-    throw new Error('Setting of context options disabled, check zmq version is >= 3.2.1 and recompile this addon');
-  }
-  var defaultCtx = defaultContext();
-  defaultCtx.setOpt(zmq.ZMQ_IO_THREADS, value);
-};
-
-exports.Context.getMaxThreads = function() {
-  if (!zmq.ZMQ_CAN_SET_CTX) {
-    throw new Error('Getting of context options disabled, check zmq version is >= 3.2.1 and recompile this addon');
-  }
-  var defaultCtx = defaultContext();
-  return defaultCtx.getOpt(zmq.ZMQ_IO_THREADS);
-};
-
-exports.Context.setMaxSockets = function(value) {
-  if (!zmq.ZMQ_CAN_SET_CTX) {
-    throw new Error('Setting of context options disabled, check zmq version is >= 3.2.1 and recompile this addon');
-  }
-  var defaultCtx = defaultContext();
-  defaultCtx.setOpt(zmq.ZMQ_MAX_SOCKETS, value);
-};
+/**
+ * Hand the messages of `sock` to a pool of worker threads, see
+ * lib/worker_pool.js.
+ *
+ *  - `script` module the workers load, exporting a function that is called
+ *    with one Buffer per part
+ *  - `workers` number of threads, one per core by default
+ *  - `affinity` `'round-robin'` (the default), or `'key'` to send every
+ *    message with the same key to the same worker
+ *  - `key` function returning the key of a message's parts, its first part
+ *    by default
+ *  - `queueBytes` size of every worker's queue, 1MB by default
+ *
+ * @param {Socket} sock
+ * @param {Object} options
+ * @return {WorkerPool}
+ * @api public
+ */
 
-exports.Context.getMaxSockets = function() {
-  if (!zmq.ZMQ_CAN_SET_CTX) {
-    throw new Error('Getting of context options disabled, check zmq version is >= 3.2.1 and recompile this addon');
-  }
-  var defaultCtx = defaultContext();
-  return defaultCtx.getOpt(zmq.ZMQ_MAX_SOCKETS);
+exports.workerPool = function(sock, options) {
+  var WorkerPool = require('./worker_pool').WorkerPool;
+  return new WorkerPool(sock, options);
 };
 
 /**
@@ -0,0 +1,432 @@
+/**
+ * Spreads the messages of one socket over a pool of worker threads. This
+ * file is also what every worker runs, so it must not load the binding,
+ * which can only live in the main thread.
+ */
+
+var EventEmitter = require('events').EventEmitter
+  , os = require('os')
+  , path = require('path')
+  , util = require('util')
+  , wt;
+
+try {
+  wt = require('worker_threads');
+} catch (err) {
+  wt = null;
+}
+
+/**
+ * Every worker has a single producer, single consumer ring in a
+ * SharedArrayBuffer. The main thread appends whole messages as
+ *
+ *   size:u32 parts:u32 (length:u32 data, padded to 4 bytes)*
+ *
+ * and publishes them by moving `head`; the worker hands out views of the
+ * ring and moves `tail` once its handler returned. A record with PAD parts
+ * skips to the end of the ring, one with POSTED parts stands for a message
+ * too large for the ring, which follows through postMessage instead.
+ *
+ * A side that runs out of work announces it in the header before it goes
+ * idle, and only then does the other side send it a message to wake it, so
+ * a busy pool costs no message passing at all.
+ */
+
+var HEAD = 0          // bytes written, wraps at 2^32
+  , TAIL = 1          // bytes consumed
+  , SLEEPING = 2      // the worker waits for a 'wake' message
+  , BLOCKED = 3       // the main thread waits for a 'drained' message
+  , DISPATCHED = 4    // messages written
+  , CONSUMED = 5      // messages handled
+  , HEADER = 64       // bytes before the ring
+  , PAD = 0xffffffff
+  , POSTED = 0xfffffffe;
+
+// messages a worker handles before it lets its event loop run
+var WORKER_BATCH = 1024;
+
+function Ring(buffer) {
+  this.ctl = new Int32Array(buffer, 0, HEADER / 4);
+  this.data = Buffer.from(buffer, HEADER);
+  this.capacity = this.data.length;
+  this.mask = this.capacity - 1;
+}
+
+Ring.prototype.used = function () {
+  return (Atomics.load(this.ctl, HEAD) - Atomics.load(this.ctl, TAIL)) >>> 0;
+};
+
+// writes `parts` as one record, false when there is no room
+Ring.prototype.write = function (parts) {
+  var size = 8, i, len;
+  for (i = 0; i < parts.length; i += 1) {
+    size += 4 + ((parts[i].length + 3) & ~3);
+  }
+  size = (size + 7) & ~7;  // leaves room for a pad record at the end
+  if (size > this.capacity >>> 1) {
+    return this._record(8, POSTED) !== false && 'posted';
+  }
+
+  var pos = this._record(size, parts.length);
+  if (pos === false) return false;
+
+  var data = this.data;
+  pos += 8;
+  for (i = 0; i < parts.length; i += 1) {
+    len = parts[i].length;
+    data.writeUInt32LE(len, pos);
+    parts[i].copy(data, pos + 4);
+    pos += 4 + ((len + 3) & ~3);
+  }
+  this._publish(size);
+  return true;
+};
+
+// reserves a record after a pad where needed, returns its offset
+Ring.prototype._record = function (size, parts) {
+  var head = Atomics.load(this.ctl, HEAD)
+    , offset = head & this.mask
+    , pad = offset + size > this.capacity ? this.capacity - offset : 0;
+
+  if (this.used() + pad + size > this.capacity) return false;
+  if (pad) {
+    this.data.writeUInt32LE(pad, offset);
+    this.data.writeUInt32LE(PAD, offset + 4);
+    this._publish(pad);
+    offset = 0;
+  }
+  this.data.writeUInt32LE(size, offset);
+  this.data.writeUInt32LE(parts, offset + 4);
+  if (parts === POSTED) this._publish(size);
+  return offset;
+};
+
+Ring.prototype._publish = function (size) {
+  Atomics.store(this.ctl, HEAD, (Atomics.load(this.ctl, HEAD) + size) | 0);
+};
+
+
+/**
+ * Main thread side, see `zmq.workerPool()`.
+ *
+ * @constructor
+ * @param {Socket} sock
+ * @param {Object} options
+ * @api public
+ */
+
+function WorkerPool(sock, options) {
+  if (!wt || typeof SharedArrayBuffer !== 'function') {
+    throw new Error('workerPool requires worker_threads and SharedArrayBuffer');
+  }
+  options = options || {};
+  if (!options.script) throw new TypeError('workerPool needs a script');
+
+  var affinity = options.affinity || 'round-robin'
+    , count = options.workers || os.cpus().length
+    , bytes = 4096
+    , self = this;
+
+  if (affinity != 'round-robin' && affinity != 'key') {
+    throw new TypeError('Unknown worker affinity: ' + affinity);
+  }
+  while (bytes < (options.queueBytes || 1024 * 1024)) bytes *= 2;
+
+  EventEmitter.call(this);
+  this.socket = sock;
+  this.affinity = affinity;
+  this.key = options.key || firstFrame;
+  this.workers = [];
+  this.next = 0;          // round-robin position
+  this.held = [];         // messages waiting for room, in order
+  this.paused = false;    // the socket was paused by the pool
+  this.closing = false;
+  this.closed = false;
+  this.dropped = 0;       // messages lost with workers that died
+
+  for (var i = 0; i < count; i += 1) {
+    this.workers.push(this._spawn(path.resolve(options.script), bytes));
+  }
+
+  this._onMessage = function () {
+    self._dispatch(Array.prototype.slice.call(arguments));
+  };
+  sock.on('message', this._onMessage);
+}
+
+util.inherits(WorkerPool, EventEmitter);
+
+function firstFrame(parts) {
+  return parts[0];
+}
+
+WorkerPool.prototype._spawn = function (script, bytes) {
+  var self = this
+    , ring = new Ring(new SharedArrayBuffer(HEADER + bytes))
+    , worker = new wt.Worker(__filename, {
+        workerData: { zmqWorkerPool: true, script: script, ring: ring.ctl.buffer }
+      });
+
+  worker.ring = ring;
+  worker.on('message', function (msg) {
+    // anything else is the script reporting back through parentPort
+    if ('drained' == msg) {
+      self._drained();
+    } else {
+      self.emit('message', msg);
+    }
+  });
+  worker.on('error', function (err) {
+    self._lost(worker);
+    self.emit('error', err);
+  });
+  worker.on('exit', function () {
+    worker.exited = true;
+    self._lost(worker);
+    if (self.closing && self.workers.every(function (w) { return w.exited; })) {
+      self._closed();
+    }
+  });
+  return worker;
+};
+
+/**
+ * A worker whose handler threw, or that exited on its own, takes the
+ * messages still in its ring with it; they count as `dropped`. Handing
+ * them to another worker could well kill that one too. The others take
+ * over its share and the messages held back for it.
+ */
+
+WorkerPool.prototype._lost = function (worker) {
+  var i = this.workers.indexOf(worker);
+  if (i === -1 || this.closing) return;
+
+  var ctl = worker.ring.ctl;
+  this.dropped += Atomics.load(ctl, DISPATCHED) - Atomics.load(ctl, CONSUMED);
+  this.workers.splice(i, 1);
+
+  if (this.workers.length) {
+    this.next %= this.workers.length;
+    this._drained();
+    return;
+  }
+
+  // nobody left to hand messages to
+  this.dropped += this.held.length;
+  this.held = [];
+  this.close();
+};
+
+WorkerPool.prototype._pick = function (parts) {
+  var workers = this.workers;
+  if (this.affinity == 'key') {
+    return workers[hash(this.key(parts)) % workers.length];
+  }
+  var worker = workers[this.next];
+  this.next = (this.next + 1) % workers.length;
+  return worker;
+};
+
+WorkerPool.prototype._dispatch = function (parts) {
+  // the rest of a read batch still comes in after the socket was paused
+  if (this.held.length || !this._send(parts)) {
+    this.held.push(parts);
+    if (!this.paused) {
+      this.paused = true;
+      this.socket.pause();  // libzmq queues up to the HWM, then pushes back
+    }
+  }
+};
+
+// round-robin skips workers that are full
+WorkerPool.prototype._send = function (parts) {
+  var tries = this.affinity == 'key' ? 1 : this.workers.length;
+  while (tries--) {
+    if (this._write(this._pick(parts), parts)) return true;
+  }
+  return false;
+};
+
+WorkerPool.prototype._write = function (worker, parts) {
+  var ring = worker.ring
+    , written = ring.write(parts);
+
+  if (!written) {
+    Atomics.store(ring.ctl, BLOCKED, 1);
+    // the worker may have drained in between
+    written = ring.write(parts);
+    if (!written) return false;
+    Atomics.store(ring.ctl, BLOCKED, 0);
+  }
+
+  Atomics.add(ring.ctl, DISPATCHED, 1);
+  if ('posted' == written) worker.postMessage(parts);
+  if (Atomics.compareExchange(ring.ctl, SLEEPING, 1, 0) === 1) {
+    worker.postMessage('wake');
+  }
+  return true;
+};
+
+WorkerPool.prototype._drained = function () {
+  while (this.held.length && this._send(this.held[0])) {
+    this.held.shift();
+  }
+  if (!this.held.length && this.paused) {
+    this.paused = false;
+    this.socket.resume();
+  }
+};
+
+/**
+ * Queue depth of every worker: `queued` messages and the `bytes` they take
+ * in its ring, plus the `dispatched` and `handled` totals.
+ *
+ * @return {Array}
+ * @api public
+ */
+
+WorkerPool.prototype.stats = function () {
+  return this.workers.map(function (worker) {
+    var ctl = worker.ring.ctl
+      , dispatched = Atomics.load(ctl, DISPATCHED)
+      , handled = Atomics.load(ctl, CONSUMED);
+    return {
+      queued: dispatched - handled,
+      bytes: worker.ring.used(),
+      dispatched: dispatched,
+      handled: handled
+    };
+  });
+};
+
+/**
+ * Stop taking messages from the socket. Workers exit once they handled
+ * what they were given, then `cb` is called. The pool closes by itself
+ * when its last worker died.
+ *
+ * @param {Function} cb
+ * @api public
+ */
+
+WorkerPool.prototype.close = function (cb) {
+  var self = this;
+  if (this.closing) return;
+  this.closing = true;
+  if (cb) this.once('close', cb);
+  this.socket.removeListener('message', this._onMessage);
+  if (this.paused) this.socket.resume();
+  this.workers.forEach(function (worker) {
+    worker.postMessage('close');
+  });
+  if (!this.workers.length) {
+    setImmediate(function () { self._closed(); });
+  }
+};
+
+WorkerPool.prototype._closed = function () {
+  if (this.closed) return;
+  this.closed = true;
+  this.emit('close');
+};
+
+// djb2, like the shard keys of lib/index.js
+function hash(key) {
+  var h = 5381, i;
+  if ('number' == typeof key) return Math.abs(Math.floor(key));
+  if (!Buffer.isBuffer(key)) key = Buffer.from(String(key), 'utf8');
+  for (i = 0; i < key.length; i += 1) {
+    h = ((h << 5) + h + key[i]) | 0;
+  }
+  return h >>> 0;
+}
+
+exports.WorkerPool = WorkerPool;
+
+
+/**
+ * Worker side: hands every message to the function the script exports,
+ * with one Buffer argument per part. The Buffers are views of the ring and
+ * only valid until the handler returns; copy what you keep.
+ */
+
+function runWorker(data) {
+  var handler = require(data.script)
+    , ring = new Ring(data.ring)
+    , ctl = ring.ctl
+    , buf = ring.data
+    , posted = []
+    , closing = false
+    , scheduled = false;
+
+  if (typeof handler !== 'function') {
+    throw new TypeError(data.script + ' must export a function');
+  }
+
+  wt.parentPort.on('message', function (msg) {
+    if ('close' == msg) {
+      closing = true;
+    } else if ('wake' != msg) {
+      posted.push(msg);
+    }
+    run();
+  });
+
+  function run() {
+    scheduled = false;
+    var handled = 0, tail, size, parts, args, pos, len, i;
+
+    while (handled < WORKER_BATCH) {
+      tail = Atomics.load(ctl, TAIL);
+      if (tail === Atomics.load(ctl, HEAD)) {
+        Atomics.store(ctl, SLEEPING, 1);
+        if (tail !== Atomics.load(ctl, HEAD)) {
+          Atomics.store(ctl, SLEEPING, 0);
+          continue;
+        }
+        if (closing) process.exit(0);
+        return;
+      }
+
+      pos = tail & ring.mask;
+      size = buf.readUInt32LE(pos);
+      parts = buf.readUInt32LE(pos + 4);
+
+      if (parts === POSTED) {
+        if (!posted.length) return;  // comes with the next port message
+        args = posted.shift().map(function (part) {
+          return Buffer.from(part.buffer, part.byteOffset, part.length);
+        });
+      } else if (parts !== PAD) {
+        args = new Array(parts);
+        pos += 8;
+        for (i = 0; i < parts; i += 1) {
+          len = buf.readUInt32LE(pos);
+          args[i] = buf.slice(pos + 4, pos + 4 + len);
+          pos += 4 + ((len + 3) & ~3);
+        }
+      }
+
+      if (parts !== PAD) {
+        handler.apply(null, args);
+        Atomics.add(ctl, CONSUMED, 1);
+        handled += 1;
+      }
+      Atomics.store(ctl, TAIL, (tail + size) | 0);
+      if (Atomics.compareExchange(ctl, BLOCKED, 1, 0) === 1) {
+        wt.parentPort.postMessage('drained');
+      }
+    }
+
+    // a long backlog still lets timers and I/O of the worker run
+    if (!scheduled) {
+      scheduled = true;
+      setImmediate(run);
+    }
+  }
+
+  run();
+}
+
+if (wt && !wt.isMainThread && wt.workerData && wt.workerData.zmqWorkerPool) {
+  runWorker(wt.workerData);
+}
@@ -0,0 +1,79 @@
+var zmq = require('../');
+var assert = require('assert');
+
+if (process.argv.length != 3 && process.argv.length != 4) {
+  console.log('usage: codec <message-count> [inproc-address]');
+  process.exit(1);
+}
+
+var message_count = Number(process.argv[2]);
+var address = process.argv[3] || 'inproc://codec';
+
+var sample = {
+  id: 123456,
+  type: 'order',
+  price: 101.25,
+  quantity: 300,
+  flags: [true, false, null],
+  venue: { name: 'XNAS', region: 'us-east' },
+  fills: [{ price: 101.2, size: 100 }, { price: 101.3, size: 200 }]
+};
+
+function report(name, time) {
+  var sec = time[0] + (time[1] / 1000000000);
+  console.log('%s: %d [msg/s]', name, (message_count / sec).toFixed(0));
+}
+
+function codec(name, encode, decode) {
+  console.log('%s size: %d [B]', name, encode(sample).length);
+  var timer = process.hrtime();
+  for (var i = 0; i < message_count; i++) {
+    decode(encode(sample));
+  }
+  report(name + ' encode+decode', process.hrtime(timer));
+}
+
+codec('json', function (value) {
+  return new Buffer(JSON.stringify(value), 'utf8');
+}, function (buf) {
+  return JSON.parse(buf.toString());
+});
+
+codec('msgpack', zmq.encode, zmq.decode);
+
+// the same comparison over a socket, where sendObject() encodes straight
+// into the outgoing message and 'object' events decode straight out of it
+
+function transfer(name, send, event, done) {
+  var push = zmq.socket('push')
+    , pull = zmq.socket('pull')
+    , received = 0
+    , timer;
+
+  pull.bindSync(address + '-' + name);
+  push.connect(address + '-' + name);
+
+  pull.on(event, function (value) {
+    if (event === 'message') value = JSON.parse(value.toString());
+    assert.equal(value.id, sample.id);
+    if (++received === message_count) {
+      report(name + ' push/pull', process.hrtime(timer));
+      push.close();
+      pull.close();
+      done();
+    }
+  });
+
+  timer = process.hrtime();
+  for (var i = 0; i < message_count; i++) {
+    send(push);
+  }
+}
+
+transfer('json', function (sock) {
+  sock.send(JSON.stringify(sample));
+}, 'message', function () {
+  transfer('msgpack', function (sock) {
+    sock.sendObject(sample);
+  }, 'object', function () {});
+});
@@ -0,0 +1,44 @@
+var zmq = require('../');
+
+if (process.argv.length != 3 && process.argv.length != 4) {
+  console.log('usage: footprint <socket-count> [socket-type]');
+  process.exit(1);
+}
+
+var socket_count = Number(process.argv[2]);
+var socket_type = process.argv[3] || 'dealer';
+var sockets = new Array(socket_count);
+
+if (!global.gc) {
+  console.log('run with --expose-gc for stable numbers');
+}
+
+// every ØMQ socket holds a file descriptor, raise `ulimit -n` to match
+if (zmq.ZMQ_CAN_SET_CTX) {
+  zmq.Context.setMaxSockets(socket_count + 16);
+}
+
+function usage() {
+  if (global.gc) global.gc();
+  return process.memoryUsage();
+}
+
+var before = usage();
+var timer = process.hrtime();
+
+for (var i = 0; i < socket_count; i++) {
+  sockets[i] = zmq.socket(socket_type);
+}
+
+var duration = process.hrtime(timer);
+var after = usage();
+var secs = duration[0] + duration[1] / 1e9;
+
+console.log('socket count: %d', socket_count);
+console.log('creation rate: %d [sockets/s]', Math.round(socket_count / secs));
+console.log('rss per idle socket: %d [B]', Math.round((after.rss - before.rss) / socket_count));
+console.log('heap per idle socket: %d [B]', Math.round((after.heapUsed - before.heapUsed) / socket_count));
+
+sockets.forEach(function (sock) {
+  sock.close();
+});
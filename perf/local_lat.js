@@ -1,17 +1,20 @@
 var zmq = require('../');
 var assert = require('assert');
 
-if (process.argv.length != 5) {
-  console.log('usage: local_lat <bind-to> <message-size> <roundtrip-count>');
+if (process.argv.length != 5 && process.argv.length != 6) {
+  console.log('usage: local_lat <bind-to> <message-size> <roundtrip-count> [busy-poll-usecs]');
   process.exit(1);
 }
 
 var bind_to = process.argv[2];
 var message_size = Number(process.argv[3]);
 var roundtrip_count = Number(process.argv[4]);
+var busy_poll = Number(process.argv[5] || 0);
 var counter = 0;
 
-var rep = zmq.socket('rep');
+// shm:// endpoints only pair up
+var rep = /^shm:/.test(bind_to) ? zmq.shmSocket('pair') : zmq.socket('rep');
+rep.busyPoll = busy_poll;
 rep.bindSync(bind_to);
 
 rep.on('message', function (data) {
@@ -19,6 +22,10 @@ rep.on('message', function (data) {
   rep.send(data);
   if (++counter === roundtrip_count){ 
     setTimeout( function(){ 
+      if (busy_poll && rep.busyPollStats) {
+        var stats = rep.busyPollStats();
+        console.log('busy poll: %d [usecs], %d hits, %d misses', busy_poll, stats.hits, stats.misses);
+      }
       rep.close();
     }, 1000); 
   }
@@ -11,7 +11,7 @@ var message_size = Number(process.argv[3]);
 var message_count = Number(process.argv[4]);
 var counter = 0;
 
-var sock = zmq.socket('pull');
+var sock = /^shm:/.test(bind_to) ? zmq.shmSocket('pull') : zmq.socket('pull');
 sock.bindSync(bind_to);
 
 var timer;
@@ -1,20 +1,28 @@
 var zmq = require('../');
 var assert = require('assert');
 
-if (process.argv.length != 5) {
-  console.log('usage: remote_lat <connect-to> <message-size> <roundtrip-count>');
+if (process.argv.length != 5 && process.argv.length != 6) {
+  console.log('usage: remote_lat <connect-to> <message-size> <roundtrip-count> [io-cpus]');
   process.exit(1);
 }
 
 var connect_to = process.argv[2];
 var message_size = Number(process.argv[3]);
 var roundtrip_count = Number(process.argv[4]);
+var io_cpus = process.argv[5];
 var message = new Buffer(message_size);
 message.fill('h');
 
 var recvCounter = 0;
+var samples = [];
+var sent;
 
-var req = zmq.socket('req');
+// 'numa' or a comma separated cpu list for the I/O thread
+if (io_cpus) {
+  zmq.Context.setThreadOptions({ cpus: io_cpus == 'numa' ? io_cpus : io_cpus.split(',').map(Number) });
+}
+
+var req = /^shm:/.test(connect_to) ? zmq.shmSocket('pair') : zmq.socket('req');
 req.connect(connect_to);
 
 var timer;
@@ -27,6 +35,9 @@ req.on('message', function (data) {
 
   assert.equal(data.length, message_size, 'message-size did not match');
 
+  var rtt = process.hrtime(sent);
+  samples.push(rtt[0] * 1e6 + rtt[1] / 1e3);
+
   if (++recvCounter === roundtrip_count) {
     finish();
   } else {
@@ -41,11 +52,21 @@ function finish() {
   console.log('message size: %d [B]', message_size);
   console.log('roundtrip count: %d', roundtrip_count);
   console.log('mean latency: %d [msecs]', millis / (roundtrip_count * 2));
+
+  // jitter shows in the tail, one-way is half a roundtrip
+  samples.sort(function (a, b) { return a - b; });
+  [0.5, 0.99, 0.999].forEach(function (q) {
+    var i = Math.min(samples.length - 1, Math.floor(samples.length * q));
+    console.log('p%d latency: %d [usecs]', q * 100, samples[i] / 2);
+  });
+  console.log('max latency: %d [usecs]', samples[samples.length - 1] / 2);
+  if (io_cpus) console.log('io cpus: %s', io_cpus);
   console.log('overall time: %d secs and %d nanoseconds', duration[0], duration[1]);
   req.close()
 }
 
 function send() {
+  sent = process.hrtime();
   req.send(message);
 }
 
@@ -14,7 +14,7 @@ message.fill('h')
 
 var counter = 0
 
-var sock = zmq.socket('push')
+var sock = /^shm:/.test(connect_to) ? zmq.shmSocket('push') : zmq.socket('push')
 //sock.setsockopt(zmq.ZMQ_SNDHWM, message_count);
 sock.connect(connect_to)
 
@@ -0,0 +1,79 @@
+var zmq = require('../');
+var assert = require('assert');
+var fork = require('child_process').fork;
+
+// Compares hop latency over inproc://, ipc:// and shm://. inproc:// echoes
+// in this process, the others in a child process on the same host.
+
+if (process.argv[2] === 'echo') {
+  var addr = process.argv[3];
+  var echo = /^shm:/.test(addr) ? zmq.shmSocket('pair') : zmq.socket('pair');
+  echo.bindSync(addr);
+  echo.on('message', function (msg) { echo.send(msg); });
+  process.on('message', function () { echo.close(); process.exit(); });
+  process.send('ready');
+  return;
+}
+
+var message_size = Number(process.argv[2] || 64);
+var roundtrip_count = Number(process.argv[3] || 20000);
+var message = new Buffer(message_size);
+message.fill('h');
+
+var transports = [
+  { addr: 'inproc://perf-transports' },
+  { addr: 'ipc:///tmp/zmq-perf-transports', child: true },
+  { addr: 'shm://perf-transports', child: true }
+];
+
+function run(transport, cb) {
+  var child, echo;
+
+  if (transport.child) {
+    child = fork(__filename, ['echo', transport.addr]);
+    child.once('message', measure);
+  } else {
+    echo = zmq.socket('pair');
+    echo.bindSync(transport.addr);
+    echo.on('message', function (msg) { echo.send(msg); });
+    measure();
+  }
+
+  function measure() {
+    var sock = /^shm:/.test(transport.addr) ? zmq.shmSocket('pair') : zmq.socket('pair')
+      , samples = []
+      , sent;
+
+    sock.connect(transport.addr);
+    sock.on('message', function (data) {
+      assert.equal(data.length, message_size, 'message-size did not match');
+      var rtt = process.hrtime(sent);
+      samples.push(rtt[0] * 1e6 + rtt[1] / 1e3);
+      if (samples.length < roundtrip_count) return send();
+
+      sock.close();
+      if (child) child.send('exit');
+      if (echo) echo.close();
+      report(transport.addr, samples);
+      cb();
+    });
+
+    function send() {
+      sent = process.hrtime();
+      sock.send(message);
+    }
+    send();
+  }
+}
+
+function report(addr, samples) {
+  // one-way is half a roundtrip
+  samples.sort(function (a, b) { return a - b; });
+  function q(p) { return (samples[Math.min(samples.length - 1, Math.floor(samples.length * p))] / 2).toFixed(1); }
+  console.log('%s: p50 %d, p99 %d, p99.9 %d [usecs]', addr, q(0.5), q(0.99), q(0.999));
+}
+
+console.log('message size: %d [B], roundtrip count: %d', message_size, roundtrip_count);
+(function next(i) {
+  if (i < transports.length) run(transports[i], function () { next(i + 1); });
+})(0);
@@ -1,6 +1,8 @@
 var zmq = require('..')
   , should = require('should')
   , semver = require('semver')
+  , execFile = require('child_process').execFile
+  , path = require('path')
 
 describe('context', function() {
 
@@ -29,4 +31,116 @@ describe('context', function() {
     done();
   });
 
+  it('should pick io thread cpus from a numa node', function() {
+    var cpus = zmq.numaCpus(2);
+    cpus.should.be.an.Array;
+    cpus.length.should.be.within(1, 2);
+    cpus.forEach(function(cpu) { cpu.should.be.a.Number; });
+  });
+
+  it('should refuse thread options once sockets exist', function() {
+    var sock = zmq.socket('req');
+    (function() {
+      zmq.Context.setThreadOptions({ schedPolicy: 'fifo', priority: 10 });
+    }).should.throw(/before the first socket/);
+    sock.close();
+  });
+
+  it('should refuse sharding once sockets exist', function() {
+    var sock = zmq.socket('req');
+    (function() {
+      zmq.Context.setSharding({ policy: 'round-robin' });
+    }).should.throw(/before the first socket/);
+    zmq.Context.ioThreadLoad().should.eql([]);
+    should.not.exist(sock.ioThread);
+    (function() {
+      sock.shardKey = 'a';
+    }).should.throw(/not enabled/);
+    sock.close();
+  });
+
+  it('should terminate the context without blocking', function(done) {
+    var push = zmq.socket('push');
+    push.bindSync('inproc://terminate-async');
+    push.send('lost', 0, function (err) {
+      err.code.should.equal('ECLOSED');
+    });
+
+    zmq.Context.terminateAsync({ timeout: 10 }, function (err, result) {
+      should.not.exist(err);
+      result.should.eql({ flushed: 0, dropped: 1 });
+
+      // the next socket gets a fresh context
+      var sock = zmq.socket('push');
+      sock.close();
+      done();
+    });
+  });
+
+  it('should refuse to terminate with sockets it cannot close', function(done) {
+    var fixture = path.join(__dirname, 'fixtures', 'terminate.js');
+    execFile(process.execPath, [fixture], { timeout: 5000 }, function (error, stdout) {
+      if (error) return done(error);
+      var lines = stdout.trim().split('\n');
+      lines.length.should.equal(2);
+      lines[0].should.match(/1 socket\(s\) without endpoints/);
+      lines[1].should.equal('terminated');
+      done();
+    });
+  });
+
+  it('should not hold on to sockets without endpoints', function(done) {
+    if (typeof gc !== 'function' || typeof WeakRef !== 'function') return done();
+
+    var ref = new WeakRef(zmq.socket('push'));
+    setImmediate(function () {
+      gc();
+      should.not.exist(ref.deref());
+      done();
+    });
+  });
+
+  function shard(options, keys, cb) {
+    var fixture = path.join(__dirname, 'fixtures', 'sharding.js');
+    execFile(process.execPath, [fixture, JSON.stringify(options), JSON.stringify(keys)],
+      function (error, stdout) {
+        if (error) return cb(error);
+        cb(null, JSON.parse(stdout));
+      });
+  }
+
+  it('should spread sockets over the I/O threads', function(done) {
+    shard({ ioThreads: 3 }, [null, null, null, null], function (error, result) {
+      if (error) return done(error);
+      result.threads.should.eql([0, 1, 2, 0]);
+      result.affinity.should.eql(['1', '2', '4', '1']);
+      result.load.should.eql([2, 1, 1]);
+      done();
+    });
+  });
+
+  it('should place sockets by shard key up to the 64th thread', function(done) {
+    shard({ ioThreads: 64, policy: 'key' }, [1, 'a', 63], function (error, result) {
+      if (error) return done(error);
+      result.threads[0].should.equal(1);
+      result.threads[2].should.equal(63);
+      result.affinity[2].should.equal(String(Math.pow(2, 63)));
+      result.load.length.should.equal(64);
+      done();
+    });
+  });
+
+  it('should refuse sockets when ZMQ_IO_CPUS is invalid', function(done) {
+    var fixture = path.join(__dirname, 'fixtures', 'io-cpus.js')
+      , env = {};
+    for (var key in process.env) env[key] = process.env[key];
+    env.ZMQ_IO_CPUS = '2,x';
+
+    execFile(process.execPath, [fixture], { env: env }, function (error, stdout) {
+      if (error) return done(error);
+      stdout.should.match(/^ZMQ_IO_CPUS: /);
+      done();
+    });
+  });
+
 });
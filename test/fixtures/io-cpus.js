@@ -0,0 +1,10 @@
+// ZMQ_IO_CPUS is read when the default context is created, so the first
+// socket of a fresh process has to see it.
+var zmq = require('../..');
+
+try {
+  zmq.socket('dealer').close();
+  process.stdout.write('created');
+} catch (err) {
+  process.stdout.write(err.message);
+}
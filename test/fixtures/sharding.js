@@ -0,0 +1,21 @@
+// Sharding has to be set up before the first socket, which a mocha process
+// running the other tests is long past, so this runs in a child of its own.
+var zmq = require('../..')
+  , options = JSON.parse(process.argv[2])
+  , keys = JSON.parse(process.argv[3]);
+
+zmq.Context.setSharding(options);
+
+var socks = keys.map(function (key) {
+  var sock = zmq.socket('dealer');
+  if (key !== null) sock.shardKey = key;
+  return sock;
+});
+
+process.stdout.write(JSON.stringify({
+  threads: socks.map(function (sock) { return sock.ioThread; }),
+  affinity: socks.map(function (sock) { return String(sock.getsockopt('affinity')); }),
+  load: zmq.Context.ioThreadLoad().map(function (thread) { return thread.sockets; })
+}));
+
+socks.forEach(function (sock) { sock.close(); });
@@ -0,0 +1,20 @@
+// Claims the record at the head of the shm ring at argv[2] the way a writer
+// does, then exits without committing it, like a writer killed mid-write.
+var fs = require('fs')
+  , fd = fs.openSync(process.argv[2], 'r+')
+  , header = new Buffer(256)
+  , size = 64;
+
+fs.readSync(fd, header, 0, 256, 0);
+var capacity = header.readUInt32LE(8)
+  , head = header.readUInt32LE(64)  // a fresh ring, the high word is 0
+  , claim = new Buffer(8);
+
+// size in the low word, CLAIMED and our pid in the high word
+claim.writeUInt32LE(size, 0);
+claim.writeUInt32LE((4 | process.pid << 8) >>> 0, 4);
+fs.writeSync(fd, claim, 0, 8, 256 + head % capacity);
+
+header.writeUInt32LE(head + size, 64);
+fs.writeSync(fd, header, 64, 4, 64);
+fs.closeSync(fd);
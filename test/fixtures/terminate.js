@@ -0,0 +1,17 @@
+// Terminates the default context with a socket that was never bound or
+// connected, which must fail fast rather than leave zmq_term waiting.
+var zmq = require('../..')
+  , idle = zmq.socket('dealer')
+  , bound = zmq.socket('push');
+
+bound.bindSync('inproc://terminate-fixture');
+
+zmq.Context.terminateAsync({ timeout: 10 }, function (err) {
+  process.stdout.write((err ? err.message : 'terminated') + '\n');
+  if (!err) return;
+
+  idle.close();
+  zmq.Context.terminateAsync({ timeout: 10 }, function (err) {
+    process.stdout.write((err ? err.message : 'terminated') + '\n');
+  });
+});
@@ -0,0 +1,7 @@
+var parentPort = require('worker_threads').parentPort
+  , threadId = require('worker_threads').threadId;
+
+module.exports = function (key, body) {
+  if (body.toString() == 'throw') throw new Error('handler failed');
+  parentPort.postMessage({ key: key.toString(), body: body.toString(), thread: threadId });
+};
@@ -0,0 +1,153 @@
+var zmq = require('..')
+  , should = require('should');
+
+describe('socket.async-iterator', function(){
+  var push, pull;
+
+  if (typeof Symbol !== 'function' || !Symbol.asyncIterator) {
+    return it('requires Symbol.asyncIterator (skipping)');
+  }
+
+  beforeEach(function(){
+    push = zmq.socket('push');
+    pull = zmq.socket('pull');
+  });
+
+  it('should iterate over messages', function(done){
+    var iterator = pull[Symbol.asyncIterator]()
+      , received = [];
+
+    function next() {
+      iterator.next().then(function (result) {
+        result.done.should.be.false;
+        result.value.should.be.an.instanceof(Array);
+        received.push(result.value[0].toString());
+        if (received.length < 3) return next();
+
+        received.should.eql(['foo', 'bar', 'baz']);
+        return iterator.return().then(function () {
+          push.close();
+          pull.close();
+          done();
+        });
+      }).catch(done);
+    }
+
+    pull.bind('inproc://stuff_ai', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_ai');
+      next();
+      push.send('foo');
+      push.send('bar');
+      push.send('baz');
+    });
+  });
+
+  it('should yield multipart messages as arrays', function(done){
+    var iterator = pull.messages(2);
+
+    pull.bind('inproc://stuff_aimm', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_aimm');
+      push.send(['hello', 'world']);
+
+      iterator.next().then(function (result) {
+        result.value.length.should.equal(2);
+        result.value[0].toString().should.equal('hello');
+        result.value[1].toString().should.equal('world');
+        push.close();
+        pull.close();
+        done();
+      }).catch(done);
+    });
+  });
+
+  it('should not emit messages while iterating', function(done){
+    var iterator = pull.messages();
+
+    pull.on('message', function () {
+      throw new Error('message emitted while iterating');
+    });
+
+    pull.bind('inproc://stuff_aine', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_aine');
+      push.send('foo');
+      push.send('bar');
+
+      setTimeout(function () {
+        iterator.next().then(function (result) {
+          result.value[0].toString().should.equal('foo');
+          pull.removeAllListeners('message');
+          push.close();
+          pull.close();
+          done();
+        }).catch(done);
+      }, 50);
+    });
+  });
+
+  it('should resume message events after return()', function(done){
+    var iterator = pull.messages();
+
+    pull.on('message', function (msg) {
+      msg.toString().should.equal('foo');
+      push.close();
+      pull.close();
+      done();
+    });
+
+    pull.bind('inproc://stuff_air', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_air');
+      push.send('foo');
+
+      setTimeout(function () {
+        iterator.return();
+      }, 50);
+    });
+  });
+
+  it('should emit the rest of a batch after breaking out', function(done){
+    var received = [];
+
+    function onMessage(msg) {
+      received.push(msg.toString());
+      if (received.length < 2) return;
+      received.should.eql(['bar', 'baz']);
+      push.close();
+      pull.close();
+      done();
+    }
+
+    pull.bind('inproc://stuff_airest', function (error) {
+      if (error) throw error;
+      var iterator = pull.messages(16);
+      push.connect('inproc://stuff_airest');
+      push.send('foo');
+      push.send('bar');
+      push.send('baz');
+
+      // all three are queued by now and come out in one readMany()
+      setTimeout(function () {
+        iterator.next().then(function (result) {
+          result.value[0].toString().should.equal('foo');
+          pull.on('message', onMessage);
+          return iterator.return();
+        }).catch(done);
+      }, 50);
+    });
+  });
+
+  it('should finish when the socket is closed', function(done){
+    var iterator = pull.messages();
+
+    iterator.next().then(function (result) {
+      result.done.should.be.true;
+      push.close();
+      done();
+    }).catch(done);
+
+    pull.close();
+  });
+});
@@ -0,0 +1,108 @@
+var zmq = require('..')
+  , should = require('should');
+
+describe('socket.attach-many', function(){
+
+  it('should bind every address in one call', function(done){
+    var push = zmq.socket('push')
+      , pull = zmq.socket('pull')
+      , bound = [];
+
+    push.on('bind', function (addr) { bound.push(addr); });
+    push.bindMany(['inproc://many-1', 'inproc://many-2'], function (err, errors) {
+      should.not.exist(err);
+      errors.length.should.equal(2);
+      bound.should.eql(['inproc://many-1', 'inproc://many-2']);
+
+      pull.on('message', function (msg) {
+        msg.toString().should.equal('hello');
+        push.close();
+        pull.close();
+        done();
+      });
+      pull.connect('inproc://many-2');
+      push.send('hello');
+    });
+  });
+
+  it('should report errors per address', function(done){
+    var push = zmq.socket('push');
+
+    push.bindMany(['inproc://many-ok', 'bogus://many'], function (err, errors) {
+      err.should.be.an.instanceof(Error);
+      err.address.should.equal('bogus://many');
+      should.not.exist(errors[0]);
+      errors[1].should.equal(err);
+      push.close();
+      done();
+    });
+  });
+
+  it('should connect every address in one call', function(done){
+    var push = zmq.socket('push')
+      , pull1 = zmq.socket('pull')
+      , pull2 = zmq.socket('pull')
+      , received = 0;
+
+    pull1.bindSync('inproc://many-connect-1');
+    pull2.bindSync('inproc://many-connect-2');
+
+    function onMessage(msg) {
+      msg.toString().should.equal('hi');
+      if (++received === 2) {
+        push.close();
+        pull1.close();
+        pull2.close();
+        done();
+      }
+    }
+    pull1.on('message', onMessage);
+    pull2.on('message', onMessage);
+
+    push.connectMany(['inproc://many-connect-1', 'inproc://many-connect-2'], function (err) {
+      should.not.exist(err);
+      push.send('hi');
+      push.send('hi');
+    });
+  });
+
+  it('should queue sends while attaching', function(done){
+    var push = zmq.socket('push')
+      , pull = zmq.socket('pull');
+
+    pull.bindSync('inproc://many-queue');
+    push.connect('inproc://many-queue');
+
+    pull.on('message', function (msg) {
+      msg.toString().should.equal('queued');
+      push.close();
+      pull.close();
+      done();
+    });
+
+    push.bindMany(['inproc://many-queue-2']);
+    push.send('queued', 0, function (err) {
+      should.not.exist(err);
+    });
+  });
+
+  it('should read what arrived during a failed bind', function(done){
+    var push = zmq.socket('push')
+      , pull = zmq.socket('pull');
+
+    pull.bindSync('inproc://many-failed-bind');
+    push.connect('inproc://many-failed-bind');
+
+    pull.on('message', function (msg) {
+      msg.toString().should.equal('meanwhile');
+      push.close();
+      pull.close();
+      done();
+    });
+
+    pull.bind('bogus://nowhere', function (err) {
+      should.exist(err);
+    });
+    push.send('meanwhile');
+  });
+});
@@ -0,0 +1,50 @@
+var zmq = require('..')
+  , should = require('should');
+
+describe('socket.busy-poll', function(){
+
+  it('should default to no busy polling', function(){
+    var sock = zmq.socket('rep');
+    sock.busyPoll.should.equal(0);
+    sock.busyPollStats().should.eql({ hits: 0, misses: 0 });
+    sock.close();
+  });
+
+  it('should validate the busy poll time', function(){
+    var sock = zmq.socket('rep');
+    (function () { sock.busyPoll = -1; }).should.throw();
+    (function () { sock.busyPoll = 'fast'; }).should.throw();
+    sock.busyPoll = 50;
+    sock.busyPoll.should.equal(50);
+    sock.close();
+  });
+
+  it('should spin after handling a message', function(done){
+    var rep = zmq.socket('rep', { busyPoll: 200 })
+      , req = zmq.socket('req')
+      , n = 0;
+
+    rep.on('message', function (msg) {
+      rep.send(msg);
+    });
+
+    req.on('message', function (msg) {
+      msg.toString().should.equal('ping');
+      if (++n < 20) return req.send('ping');
+
+      setTimeout(function () {
+        var stats = rep.busyPollStats();
+        (stats.hits + stats.misses).should.be.above(0);
+        req.close();
+        rep.close();
+        done();
+      }, 10);
+    });
+
+    rep.bind('tcp://127.0.0.1:5624', function (error) {
+      if (error) throw error;
+      req.connect('tcp://127.0.0.1:5624');
+      req.send('ping');
+    });
+  });
+});
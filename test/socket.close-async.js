@@ -0,0 +1,69 @@
+var zmq = require('..')
+  , should = require('should');
+
+describe('socket.close-async', function(){
+
+  it('should flush queued messages before closing', function(done){
+    var push = zmq.socket('push')
+      , pull = zmq.socket('pull')
+      , received = 0;
+
+    push.bindSync('inproc://close-async-flush');
+
+    pull.on('message', function (msg) {
+      msg.toString().should.equal('m' + received);
+      if (++received === 3) {
+        pull.close();
+        done();
+      }
+    });
+
+    push.send('m0');
+    push.send('m1');
+    push.send('m2');
+    push.closeAsync(function (err, result) {
+      should.not.exist(err);
+      result.should.eql({ flushed: 3, dropped: 0 });
+    });
+
+    // the peer shows up while the socket is closing
+    pull.connect('inproc://close-async-flush');
+  });
+
+  it('should drop what is left at the deadline', function(done){
+    var push = zmq.socket('push')
+      , errors = [];
+
+    push.bindSync('inproc://close-async-drop');
+    push.send('lost', 0, function (err) { errors.push(err); });
+    push.send('lost', 0, function (err) { errors.push(err); });
+
+    push.closeAsync({ timeout: 20 }, function (err, result) {
+      should.not.exist(err);
+      result.should.eql({ flushed: 0, dropped: 2 });
+      errors.length.should.equal(2);
+      errors[0].code.should.equal('ECLOSED');
+      done();
+    });
+  });
+
+  it('should return a promise without a callback', function(done){
+    if (typeof Promise !== 'function') return done();
+    var push = zmq.socket('push');
+
+    push.closeAsync().then(function (result) {
+      result.should.eql({ flushed: 0, dropped: 0 });
+      done();
+    }, done);
+  });
+
+  it('should report closing a closed socket', function(done){
+    var push = zmq.socket('push');
+    push.close();
+    push.closeAsync(function (err) {
+      err.should.be.an.instanceof(Error);
+      done();
+    });
+  });
+
+});
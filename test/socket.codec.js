@@ -0,0 +1,115 @@
+var zmq = require('..')
+  , should = require('should');
+
+describe('socket.codec', function(){
+  var push, pull;
+
+  beforeEach(function(){
+    push = zmq.socket('push');
+    pull = zmq.socket('pull');
+  });
+
+  afterEach(function(){
+    push.close();
+    pull.close();
+  });
+
+  it('should round trip values through encode and decode', function(){
+    var value = { name: 'zmq', list: [1, -2, 3.5, 'four', null, true], nested: { empty: {} } };
+    zmq.decode(zmq.encode(value)).should.eql(value);
+  });
+
+  it('should produce MessagePack', function(){
+    zmq.encode({ a: 1 }).toString('hex').should.equal('81a16101');
+    zmq.encode([300, -1, 'hi']).toString('hex').should.equal('93cd012cffa26869');
+    zmq.encode(null).toString('hex').should.equal('c0');
+  });
+
+  it('should survive getters that encode while encoding', function(){
+    var big = new Array(1000).join('x')
+      , value = { a: big };
+
+    Object.defineProperty(value, 'b', {
+      enumerable: true,
+      get: function () { return zmq.decode(zmq.encode({ nested: big + big })); }
+    });
+    zmq.decode(zmq.encode(value)).should.eql({ a: big, b: { nested: big + big } });
+  });
+
+  it('should refuse values it cannot encode', function(){
+    (function () { zmq.encode(function () {}); }).should.throw();
+    (function () { pull.sendObject(function () {}); }).should.throw();
+  });
+
+  it('should send objects and emit them as object events', function(done){
+    var sent = { id: 7, tags: ['a', 'b'], payload: { ok: true } };
+
+    pull.on('object', function (value) {
+      value.should.eql(sent);
+      done();
+    });
+
+    pull.bind('inproc://stuff_codec', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_codec');
+      push.sendObject(sent);
+    });
+  });
+
+  it('should pass leading frames of an encoded message through', function(done){
+    pull.on('object', function (topic, value) {
+      topic.toString().should.equal('topic');
+      value.should.eql([1, 2, 3]);
+      done();
+    });
+
+    pull.bind('inproc://stuff_codecmm', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_codecmm');
+      push.send(['topic', zmq.encode([1, 2, 3])]);
+    });
+  });
+
+  it('should emit an error for messages that do not decode', function(done){
+    pull.on('object', function () {
+      done(new Error('should not decode'));
+    });
+    pull.on('error', function (error) {
+      error.should.be.an.instanceof(Error);
+      done();
+    });
+
+    pull.bind('inproc://stuff_codecerr', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_codecerr');
+      push.send(new Buffer([0xc1]));
+    });
+  });
+
+  it('should go back to message events without object listeners', function(done){
+    var onObject = function () {};
+    pull.on('object', onObject);
+    pull.removeListener('object', onObject);
+
+    pull.on('message', function (msg) {
+      zmq.decode(msg).should.eql({ raw: true });
+      done();
+    });
+
+    pull.bind('inproc://stuff_codecraw', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_codecraw');
+      push.sendObject({ raw: true });
+    });
+  });
+
+  it('should watch object listeners without listeners of its own', function(){
+    pull.listeners('newListener').length.should.equal(0);
+    pull.listeners('removeListener').length.should.equal(0);
+
+    pull.once('object', function () {});
+    pull._zmq.decode.should.be.true;
+    pull.removeAllListeners();
+    pull._zmq.decode.should.be.false;
+  });
+});
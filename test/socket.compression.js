@@ -0,0 +1,139 @@
+var zmq = require('..')
+  , should = require('should');
+
+describe('socket.compression', function(){
+  var push, pull;
+
+  beforeEach(function(){
+    push = zmq.socket('push', { compression: true });
+    pull = zmq.socket('pull', { compression: true });
+  });
+
+  it('should deflate large frames and restore them on receipt', function(done){
+    var body = new Buffer(new Array(4097).join('x'));
+
+    pull.on('message', function (topic, msg) {
+      topic.toString().should.equal('topic');
+      msg.toString().should.equal(body.toString());
+      var stats = push.compressionStats();
+      stats.compressed.should.equal(1);
+      stats.bytesIn.should.equal(body.length);
+      stats.bytesOut.should.be.below(body.length);
+      stats.ratio.should.be.below(1);
+      pull.compressionStats().inflated.should.equal(1);
+      push.close();
+      pull.close();
+      done();
+    });
+
+    pull.bind('inproc://stuff_compression', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_compression');
+      push.send(['topic', body]);
+    });
+  });
+
+  it('should send small frames as is', function(done){
+    pull.on('message', function (msg) {
+      msg.toString().should.equal('small');
+      push.compressionStats().uncompressed.should.equal(1);
+      push.compressionStats().compressed.should.equal(0);
+      push.close();
+      pull.close();
+      done();
+    });
+
+    pull.bind('inproc://stuff_compressions', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_compressions');
+      push.send('small');
+    });
+  });
+
+  it('should keep messages in order', function(done){
+    var big = new Array(2049).join('y')
+      , expected = ['a', big + '1', 'b', big + '2', 'c']
+      , received = [];
+
+    pull.on('message', function (msg) {
+      received.push(msg.toString());
+      if (received.length < expected.length) return;
+      received.should.eql(expected);
+      push.close();
+      pull.close();
+      done();
+    });
+
+    pull.bind('inproc://stuff_compressiono', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_compressiono');
+      expected.forEach(function (msg) { push.send(msg); });
+    });
+  });
+
+  it('should emit an error for a frame without a header', function(done){
+    var plain = zmq.socket('push');
+
+    pull.on('error', function (error) {
+      error.message.should.match(/compression header/);
+      plain.close();
+      pull.close();
+      done();
+    });
+
+    pull.bind('inproc://stuff_compressione', function (error) {
+      if (error) throw error;
+      plain.connect('inproc://stuff_compressione');
+      plain.send(new Buffer([7, 1, 2]));
+    });
+  });
+  it('should decode objects after inflating', function(done){
+    var value = { body: new Array(4097).join('x') };
+
+    pull.on('object', function (obj) {
+      obj.should.eql(value);
+      push.compressionStats().compressed.should.equal(1);
+      push.close();
+      pull.close();
+      done();
+    });
+
+    pull.bind('inproc://stuff_compressiono', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_compressiono');
+      push.sendObject(value);
+    });
+  });
+
+  it('should bound the messages waiting for inflate', function(done){
+    var zlib = require('zlib')
+      , inflateRaw = zlib.inflateRaw
+      , body = new Buffer(new Array(4097).join('x'))
+      , inflating = 0
+      , most = 0
+      , n = 0;
+
+    zlib.inflateRaw = function (buf, cb) {
+      most = Math.max(most, ++inflating);
+      inflateRaw.call(zlib, buf, function (error, inflated) {
+        inflating -= 1;
+        cb(error, inflated);
+      });
+    };
+
+    pull.on('message', function () {
+      if (++n < 200) return;
+      zlib.inflateRaw = inflateRaw;
+      most.should.be.within(1, 64);
+      push.close();
+      pull.close();
+      done();
+    });
+
+    pull.bind('inproc://stuff_compressionb', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_compressionb');
+      for (var i = 0; i < 200; i++) push.send(body);
+    });
+  });
+});
@@ -0,0 +1,50 @@
+var zmq = require('..')
+  , should = require('should');
+
+describe('socket.configure', function(){
+
+  it('should apply socket options from createSocket', function(){
+    var sock = zmq.socket('dealer', { backlog: 75, linger: 0, identity: 'a' });
+    sock.backlog.should.equal(75);
+    sock.linger.should.equal(0);
+    sock.identity.should.equal('a');
+    sock.close();
+  });
+
+  it('should assign other keys as properties', function(){
+    var sock = zmq.socket('dealer', { backlog: 80, ttl: 500 });
+    sock.backlog.should.equal(80);
+    sock.ttl.should.equal(500);
+    sock.close();
+  });
+
+  it('should chain', function(){
+    var sock = zmq.socket('dealer');
+    sock.configure({ backlog: 90 }).should.equal(sock);
+    sock.getsockopt('backlog').should.equal(90);
+    sock.close();
+  });
+
+  it('should read pending messages with read()', function(done){
+    var push = zmq.socket('push')
+      , pull = zmq.socket('pull');
+
+    pull.bind('inproc://configure', function (err) {
+      if (err) throw err;
+      push.connect('inproc://configure');
+      pull.pause();
+      push.send(['a', 'b']);
+
+      setTimeout(function () {
+        var msg = pull.read();
+        msg.length.should.equal(2);
+        msg[0].toString().should.equal('a');
+        msg[1].toString().should.equal('b');
+        should.not.exist(pull.read());
+        push.close();
+        pull.close();
+        done();
+      }, 50);
+    });
+  });
+});
@@ -0,0 +1,120 @@
+var zmq = require('..')
+  , should = require('should');
+
+describe('socket.conflate', function(){
+  var push, pull;
+
+  beforeEach(function(){
+    push = zmq.socket('push');
+    pull = zmq.socket('pull', { conflate: true });
+  });
+
+  afterEach(function(){
+    push.close();
+    pull.close();
+  });
+
+  it('should only emit the latest message per topic', function(done){
+    var received = [];
+
+    pull.on('message', function (topic, msg) {
+      received.push(topic + '=' + msg);
+      if (received.length < 3) return;
+      received.should.eql(['a=3', 'b=2', 'c=1']);
+      pull.conflateStats().conflated.should.equal(3);
+      done();
+    });
+
+    pull.pause();
+    pull.bind('inproc://stuff_conflate', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_conflate');
+      push.send(['a', '1']);
+      push.send(['b', '1']);
+      push.send(['a', '2']);
+      push.send(['c', '1']);
+      push.send(['b', '2']);
+      push.send(['a', '3']);
+      setTimeout(function () { pull.resume(); }, 20);
+    });
+  });
+
+  it('should keep messages that are not superseded', function(done){
+    var received = [];
+
+    pull.on('message', function (topic) {
+      received.push(topic.toString());
+      if (received.length < 3) return;
+      received.should.eql(['x', 'y', 'z']);
+      pull.conflateStats().conflated.should.equal(0);
+      done();
+    });
+
+    pull.bind('inproc://stuff_conflaten', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_conflaten');
+      push.send(['x', '1']);
+      push.send(['y', '1']);
+      push.send(['z', '1']);
+    });
+  });
+
+  it('should respect the read budget', function(done){
+    var received = []
+      , first;
+
+    pull.readBudget = 2;
+    pull.on('message', function (topic) {
+      received.push(topic.toString());
+      if (received.length < 5) return;
+      setImmediate(function () {
+        first.should.equal(2);
+        received.should.eql(['a', 'b', 'c', 'd', 'e']);
+        done();
+      });
+    });
+
+    pull.pause();
+    pull.bind('inproc://stuff_conflateb', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_conflateb');
+      ['a', 'b', 'c', 'd', 'e'].forEach(function (topic) {
+        push.send([topic, '1']);
+      });
+      setTimeout(function () {
+        pull.resume();
+        first = received.length;
+      }, 20);
+    });
+  });
+
+  it('should emit the rest of a batch when a listener throws', function(done){
+    var received = []
+      , errors = 0;
+
+    pull.on('error', function (error) {
+      error.message.should.equal('boom');
+      errors++;
+    });
+    pull.on('message', function (topic) {
+      received.push(topic.toString());
+      if (received.length === 1) throw new Error('boom');
+      if (received.length < 3) return;
+      setImmediate(function () {
+        received.should.eql(['x', 'y', 'z']);
+        errors.should.equal(1);
+        done();
+      });
+    });
+
+    pull.pause();
+    pull.bind('inproc://stuff_conflatet', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_conflatet');
+      push.send(['x', '1']);
+      push.send(['y', '1']);
+      push.send(['z', '1']);
+      setTimeout(function () { pull.resume(); }, 20);
+    });
+  });
+});
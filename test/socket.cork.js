@@ -0,0 +1,118 @@
+var zmq = require('..')
+  , should = require('should');
+
+describe('socket.cork', function(){
+  var push, pull;
+
+  beforeEach(function(){
+    push = zmq.socket('push');
+    pull = zmq.socket('pull');
+  });
+
+  afterEach(function(){
+    push.close();
+    pull.close();
+  });
+
+  it('should hold messages until uncork()', function(done){
+    var received = []
+      , callbacks = 0;
+
+    pull.on('message', function (msg) {
+      received.push(msg.toString());
+      if (received.length === 3) {
+        received.should.eql(['foo', 'bar', 'baz']);
+        callbacks.should.equal(3);
+        done();
+      }
+    });
+
+    pull.bind('inproc://stuff_cork', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_cork');
+
+      function cb() { callbacks += 1; }
+
+      push.cork();
+      push.send('foo', 0, cb);
+      push.send('bar', 0, cb);
+      push.send('baz', 0, cb);
+
+      setTimeout(function () {
+        received.length.should.equal(0);
+        callbacks.should.equal(0);
+        push.uncork();
+      }, 50);
+    });
+  });
+
+  it('should nest cork() calls', function(done){
+    var received = 0;
+
+    pull.on('message', function () {
+      received += 1;
+    });
+
+    pull.bind('inproc://stuff_corkn', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_corkn');
+
+      push.cork();
+      push.cork();
+      push.send('foo');
+      push.uncork();
+
+      setTimeout(function () {
+        received.should.equal(0);
+        push.uncork();
+        setTimeout(function () {
+          received.should.equal(1);
+          done();
+        }, 50);
+      }, 50);
+    });
+  });
+
+  it('should coalesce sends within a tick', function(done){
+    var received = 0;
+
+    push.coalesce = true;
+
+    pull.on('message', function (a, b) {
+      a.toString().should.equal('hello');
+      b.toString().should.equal(String(received));
+      if (++received === 100) done();
+    });
+
+    pull.bind('inproc://stuff_corkc', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_corkc');
+
+      for (var i = 0; i < 100; i++) {
+        push.send(['hello', String(i)]);
+      }
+    });
+  });
+
+  it('should flush corked messages after corkMaxDelay', function(done){
+    var start;
+
+    push.corkMaxDelay = 50;
+
+    pull.on('message', function (msg) {
+      msg.toString().should.equal('foo');
+      (Date.now() - start).should.be.aboveOrEqual(40);
+      push.uncork();
+      done();
+    });
+
+    pull.bind('inproc://stuff_corkd', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_corkd');
+
+      start = Date.now();
+      push.cork();
+      push.send('foo');
+    });
+  });
+});
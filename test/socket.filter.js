@@ -0,0 +1,92 @@
+var zmq = require('..')
+  , should = require('should');
+
+describe('socket.filter', function(){
+  var push, pull;
+
+  beforeEach(function(){
+    push = zmq.socket('push');
+    pull = zmq.socket('pull');
+  });
+
+  afterEach(function(){
+    push.close();
+    pull.close();
+  });
+
+  function expect(filter, send, received, done) {
+    var n = 0;
+
+    pull.setFilter(filter);
+    pull.on('message', function (msg) {
+      msg.toString().should.equal(received[n++]);
+      if (n === received.length) {
+        pull.filterStats().filtered.should.equal(send.length - received.length);
+        done();
+      }
+    });
+
+    pull.bind('inproc://stuff_filter', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_filter');
+      send.forEach(function (msg) { push.send(msg); });
+    });
+  }
+
+  it('should drop messages outside the size bounds', function(done){
+    expect({ minSize: 2, maxSize: 4 },
+      ['a', 'bb', 'ccccc', 'dddd'],
+      ['bb', 'dddd'], done);
+  });
+
+  it('should apply masked and negated byte rules', function(done){
+    expect({ bytes: [{ offset: 0, value: 0x40, mask: 0xf0 }, { offset: 1, value: 0x78, negate: true }] },
+      ['Ab', 'Ax', '1b', 'Bc', 'C'],
+      ['Ab', 'Bc', 'C'], done);
+  });
+
+  it('should apply allow and deny prefixes', function(done){
+    expect({ allow: ['news.', new Buffer('alert.')], deny: ['news.sport'] },
+      ['news.world', 'news.sport.f1', 'weather.uk', 'alert.fire'],
+      ['news.world', 'alert.fire'], done);
+  });
+
+  it('should drop every part of a rejected multipart message', function(done){
+    pull.setFilter({ deny: ['skip'] });
+    pull.on('message', function (topic, body) {
+      topic.toString().should.equal('keep');
+      body.toString().should.equal('body2');
+      var stats = pull.filterStats();
+      stats.filtered.should.equal(1);
+      stats.filteredBytes.should.equal(9);
+      done();
+    });
+
+    pull.bind('inproc://stuff_filtermm', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_filtermm');
+      push.send(['skip', 'body1']);
+      push.send(['keep', 'body2']);
+    });
+  });
+
+  it('should let everything through once the filter is removed', function(done){
+    pull.setFilter({ minSize: 10 }).setFilter(null);
+    pull.on('message', function (msg) {
+      msg.toString().should.equal('x');
+      done();
+    });
+
+    pull.bind('inproc://stuff_filteroff', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_filteroff');
+      push.send('x');
+    });
+  });
+
+  it('should reject malformed filters', function(){
+    (function () { pull.setFilter({ minSize: -1 }); }).should.throw();
+    (function () { pull.setFilter({ allow: 'news' }); }).should.throw();
+    (function () { pull.setFilter({ bytes: [{ value: 1 }] }); }).should.throw();
+  });
+});
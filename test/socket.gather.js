@@ -0,0 +1,60 @@
+var zmq = require('..')
+  , should = require('should');
+
+describe('socket.gather', function(){
+  var push, pull;
+
+  beforeEach(function(){
+    push = zmq.socket('push');
+    pull = zmq.socket('pull');
+  });
+
+  it('should join gathered buffers into one frame', function(done){
+    pull.on('message', function (msg) {
+      arguments.length.should.equal(1);
+      msg.toString().should.equal('header:body:trailer');
+      push.close();
+      pull.close();
+      done();
+    });
+
+    pull.bind('inproc://stuff_gather', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_gather');
+
+      var body = new Buffer('xxbody:xx');
+      push.send({ gather: [new Buffer('header:'), body.slice(2, 7), 'trailer'] });
+    });
+  });
+
+  it('should support gathered parts in multipart messages', function(done){
+    pull.on('message', function (topic, msg) {
+      topic.toString().should.equal('topic');
+      msg.toString().should.equal('ab15.99');
+      push.close();
+      pull.close();
+      done();
+    });
+
+    pull.bind('inproc://stuff_gathermm', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_gathermm');
+      push.send(['topic', { gather: ['a', new Buffer('b'), 15.99] }]);
+    });
+  });
+
+  it('should send an empty frame for an empty gather list', function(done){
+    pull.on('message', function (msg) {
+      msg.length.should.equal(0);
+      push.close();
+      pull.close();
+      done();
+    });
+
+    pull.bind('inproc://stuff_gathere', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_gathere');
+      push.send({ gather: [] });
+    });
+  });
+});
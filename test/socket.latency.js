@@ -0,0 +1,107 @@
+var zmq = require('..')
+  , should = require('should');
+
+describe('socket.latency', function(){
+  var push, pull;
+
+  beforeEach(function(){
+    push = zmq.socket('push');
+    pull = zmq.socket('pull');
+  });
+
+  afterEach(function(){
+    push.close();
+    pull.close();
+  });
+
+  it('should stamp received messages and record handler times', function(done){
+    var n = 0;
+
+    pull.timestamps = true;
+    pull.on('message', function () {
+      pull.receivedAt.should.be.above(0);
+      var now = process.hrtime();
+      (now[0] * 1e3 + now[1] / 1e6).should.be.aboveOrEqual(pull.receivedAt);
+      if (++n < 3) return;
+
+      setImmediate(function () {
+        var stats = pull.latencyStats(true);
+        stats.dwell.count.should.equal(3);
+        stats.handler.count.should.equal(3);
+        pull.latencyStats().dwell.count.should.equal(0);
+        done();
+      });
+    });
+
+    pull.bind('inproc://stuff_latency', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_latency');
+      push.send('a');
+      push.send('b');
+      push.send(['c', 'd']);
+    });
+  });
+
+  it('should strip the timestamp trailer and record one-way latency', function(done){
+    push.timestampTrailer = true;
+    pull.timestampTrailer = true;
+
+    pull.on('message', function (topic, msg) {
+      arguments.length.should.equal(2);
+      topic.toString().should.equal('topic');
+      msg.toString().should.equal('body');
+      pull.latencyStats().latency.count.should.equal(1);
+      done();
+    });
+
+    pull.bind('inproc://stuff_latencyt', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_latencyt');
+      push.send(['topic', 'body']);
+    });
+  });
+  it('should strip the trailer after an 8 byte last part', function(done){
+    push.timestampTrailer = true;
+    pull.timestampTrailer = true;
+
+    pull.on('message', function (topic, msg) {
+      arguments.length.should.equal(2);
+      msg.toString().should.equal('12345678');
+      done();
+    });
+
+    pull.bind('inproc://stuff_latency8', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_latency8');
+      push.send(['topic', '12345678']);
+    });
+  });
+
+  it('should stamp conflated messages', function(done){
+    var sub = zmq.socket('pull', { conflate: true });
+
+    sub.timestamps = true;
+    sub.timestampTrailer = true;
+    push.timestampTrailer = true;
+
+    sub.on('message', function (topic, msg) {
+      arguments.length.should.equal(2);
+      msg.toString().should.equal('2');
+      sub.receivedAt.should.be.above(0);
+      setImmediate(function () {
+        sub.latencyStats().handler.count.should.equal(1);
+        sub.close();
+        done();
+      });
+    });
+
+    sub.pause();
+    sub.bind('inproc://stuff_latencyc', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_latencyc');
+      push.send(['a', '1']);
+      push.send(['a', '2']);
+      setTimeout(function () { sub.resume(); }, 20);
+    });
+  });
+});
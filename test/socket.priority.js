@@ -0,0 +1,75 @@
+var zmq = require('..')
+  , should = require('should');
+
+describe('socket.priority', function(){
+  var push, pull;
+
+  beforeEach(function(){
+    push = zmq.socket('push');
+    pull = zmq.socket('pull');
+  });
+
+  afterEach(function(){
+    push.close();
+    pull.close();
+  });
+
+  function expect(received, done) {
+    var n = 0;
+
+    pull.on('message', function (msg) {
+      msg.toString().should.equal(received[n++]);
+      if (n === received.length) done();
+    });
+
+    pull.bind('inproc://stuff_priority', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_priority');
+    });
+  }
+
+  it('should send queued high priority messages first', function(done){
+    push.send('bulk1');
+    push.send('bulk2');
+    push.send('urgent', { priority: 3 });
+    push.send('bulk3');
+
+    expect(['urgent', 'bulk1', 'bulk2', 'bulk3'], done);
+  });
+
+  it('should give lower lanes their share', function(done){
+    push.priorityWeights = [1, 0, 0, 2];
+    push.send('low1');
+    push.send('low2');
+    ['high1', 'high2', 'high3', 'high4'].forEach(function (msg) {
+      push.send(msg, { priority: 3 });
+    });
+
+    expect(['high1', 'high2', 'low1', 'high3', 'high4', 'low2'], done);
+  });
+
+  it('should keep the parts of a message in one lane', function(done){
+    var n = 0;
+
+    push.send('bulk');
+    push.send('head', { flags: zmq.ZMQ_SNDMORE, priority: 2 });
+    push.send('tail');
+
+    pull.on('message', function () {
+      var parts = Array.prototype.map.call(arguments, String);
+      parts.should.eql(n++ ? ['bulk'] : ['head', 'tail']);
+      if (n === 2) done();
+    });
+
+    pull.bind('inproc://stuff_priorityp', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_priorityp');
+    });
+  });
+
+  it('should reject unknown priorities', function(){
+    (function () {
+      push.send('x', { priority: 4 });
+    }).should.throw(/Priority/);
+  });
+});
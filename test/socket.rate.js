@@ -0,0 +1,61 @@
+var zmq = require('..')
+  , should = require('should');
+
+describe('socket.rate', function(){
+  var push, pull;
+
+  beforeEach(function(){
+    push = zmq.socket('push');
+    pull = zmq.socket('pull');
+  });
+
+  afterEach(function(){
+    push.close();
+    pull.close();
+  });
+
+  it('should pace sends to the given rate', function(done){
+    var n = 0, start;
+
+    push.setRate({ messages: 100, burstMessages: 1 });
+
+    pull.on('message', function () {
+      if (++n < 5) return;
+      (Date.now() - start).should.be.aboveOrEqual(30);
+      var stats = push.rateStats();
+      stats.sent.should.equal(5);
+      stats.throttled.should.be.above(0);
+      done();
+    });
+
+    pull.bind('inproc://stuff_rate', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_rate');
+      start = Date.now();
+      for (var i = 0; i < 5; i++) push.send('tick');
+    });
+  });
+
+  it('should stop pacing when the rate is removed', function(done){
+    var n = 0;
+
+    push.setRate({ messages: 1, burstMessages: 1 });
+    push.setRate(null);
+
+    pull.on('message', function () {
+      if (++n === 10) done();
+    });
+
+    pull.bind('inproc://stuff_rater', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_rater');
+      for (var i = 0; i < 10; i++) push.send('tick');
+    });
+  });
+
+  it('should reject rates without a limit', function(){
+    (function () {
+      push.setRate({ burstMessages: 5 });
+    }).should.throw();
+  });
+});
@@ -0,0 +1,107 @@
+var zmq = require('..')
+  , should = require('should');
+
+describe('socket.read-budget', function(){
+
+  function countPerTick(counts) {
+    var inTick = false;
+    return function () {
+      if (!inTick) {
+        inTick = true;
+        counts.push(0);
+        setImmediate(function () { inTick = false; });
+      }
+      counts[counts.length - 1] += 1;
+    };
+  }
+
+  it('should limit the messages read per wakeup', function(done){
+    var push = zmq.socket('push')
+      , pull = zmq.socket('pull', { readBudget: 3 })
+      , counts = []
+      , count = countPerTick(counts)
+      , received = 0;
+
+    pull.on('message', function () {
+      count();
+      if (++received === 10) {
+        counts.forEach(function (n) { n.should.be.belowOrEqual(3); });
+        push.close();
+        pull.close();
+        done();
+      }
+    });
+
+    pull.bind('inproc://stuff_rb', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_rb');
+      for (var i = 0; i < 10; i++) push.send('hello');
+    });
+  });
+
+  it('should limit the bytes read per wakeup', function(done){
+    var push = zmq.socket('push')
+      , pull = zmq.socket('pull', { readBudgetBytes: 10 })
+      , counts = []
+      , count = countPerTick(counts)
+      , received = 0;
+
+    pull.on('message', function (msg) {
+      msg.length.should.equal(5);
+      count();
+      if (++received === 10) {
+        counts.forEach(function (n) { n.should.be.belowOrEqual(2); });
+        push.close();
+        pull.close();
+        done();
+      }
+    });
+
+    pull.bind('inproc://stuff_rbb', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_rbb');
+      for (var i = 0; i < 10; i++) push.send('hello');
+    });
+  });
+
+  it('should take turns between flooded sockets', function(done){
+    var pushA = zmq.socket('push')
+      , pullA = zmq.socket('pull', { readBudget: 2 })
+      , pushB = zmq.socket('push')
+      , pullB = zmq.socket('pull', { readBudget: 2 })
+      , order = [];
+
+    function received(name) {
+      return function () {
+        order.push(name);
+        if (order.length < 40) return;
+
+        // neither socket got to drain its 20 messages in one go
+        order.slice(0, 20).should.containEql('a');
+        order.slice(0, 20).should.containEql('b');
+        [pushA, pullA, pushB, pullB].forEach(function (s) { s.close(); });
+        done();
+      };
+    }
+
+    pullA.on('message', received('a'));
+    pullB.on('message', received('b'));
+
+    pullA.bindSync('inproc://stuff_rba');
+    pullB.bindSync('inproc://stuff_rbc');
+    pullA.pause();
+    pullB.pause();
+    pushA.connect('inproc://stuff_rba');
+    pushB.connect('inproc://stuff_rbc');
+
+    for (var i = 0; i < 20; i++) {
+      pushA.send('a');
+      pushB.send('b');
+    }
+
+    setTimeout(function () {
+      pullA.resume();
+      pullB.resume();
+    }, 50);
+  });
+});
@@ -0,0 +1,105 @@
+var zmq = require('..')
+  , should = require('should');
+
+describe('socket.recvInto', function(){
+  var push, pull;
+
+  beforeEach(function(){
+    push = zmq.socket('push');
+    pull = zmq.socket('pull');
+    pull.pause();
+  });
+
+  afterEach(function(){
+    push.close();
+    pull.close();
+  });
+
+  function later(fn) {
+    setTimeout(fn, 50);
+  }
+
+  it('should copy a message into the target buffer', function(done){
+    pull.bind('inproc://stuff_recvinto', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_recvinto');
+      push.send(['hello', 'world']);
+
+      later(function () {
+        var target = new Buffer(32)
+          , index = new Uint32Array(6);
+
+        pull.recvInto(target, 2, index).should.equal(2);
+        Array.prototype.slice.call(index).should.eql([2, 5, 1, 7, 5, 0]);
+        target.toString('utf8', 2, 12).should.equal('helloworld');
+        pull.recvInto(target, 0, index).should.equal(0);
+        done();
+      });
+    });
+  });
+
+  it('should copy several messages and report truncated lengths', function(done){
+    pull.bind('inproc://stuff_recvmanyinto', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_recvmanyinto');
+      push.send('aaaa');
+      push.send('bbbb');
+      push.send('cccccccc');
+
+      later(function () {
+        var target = new Buffer(10)
+          , index = new Uint32Array(30);
+
+        pull.recvManyInto(target, 0, index).should.equal(3);
+        Array.prototype.slice.call(index, 0, 9).should.eql([0, 4, 0, 4, 4, 0, 8, 8, 0]);
+        target.toString().should.equal('aaaabbbbcc');
+        done();
+      });
+    });
+  });
+
+  it('should stop when the index is full', function(done){
+    pull.bind('inproc://stuff_recvintoidx', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_recvintoidx');
+      push.send('one');
+      push.send('two');
+
+      later(function () {
+        var target = new Buffer(16)
+          , index = new Uint32Array(3);
+
+        pull.recvManyInto(target, 0, index, 10).should.equal(1);
+        target.toString('utf8', 0, index[1]).should.equal('one');
+        pull.recvManyInto(target, 0, index, 10).should.equal(1);
+        target.toString('utf8', 0, index[1]).should.equal('two');
+        done();
+      });
+    });
+  });
+
+  it('should keep a message the index has no room for', function(done){
+    pull.bind('inproc://stuff_recvintohold', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_recvintohold');
+      push.send('one');
+      push.send(['a', 'b', 'c']);
+
+      later(function () {
+        var target = new Buffer(16)
+          , index = new Uint32Array(6);
+
+        pull.recvManyInto(target, 0, index, 10).should.equal(1);
+        target.toString('utf8', 0, index[1]).should.equal('one');
+        (function () {
+          pull.recvManyInto(target, 0, index, 10);
+        }).should.throw(/no room/);
+
+        var msg = pull.read();
+        msg.length.should.equal(3);
+        msg[2].toString().should.equal('c');
+        done();
+      });
+    });
+  });
+});
@@ -0,0 +1,209 @@
+var zmq = require('..')
+  , should = require('should')
+  , execFile = require('child_process').execFile
+  , fs = require('fs')
+  , os = require('os')
+  , path = require('path');
+
+describe('socket.shm', function(){
+
+  if (!zmq.ZMQ_CAN_SHM) return;
+
+  it('should support push-pull', function(done){
+    var push = zmq.shmSocket('push')
+      , pull = zmq.shmSocket('pull')
+      , n = 0;
+
+    pull.on('message', function (msg) {
+      msg.should.be.an.instanceof(Buffer);
+      msg.toString().should.equal(String(n));
+      if (++n === 3) {
+        push.close();
+        pull.close();
+        done();
+      }
+    });
+
+    pull.bindSync('shm://test-push-pull');
+    push.connect('shm://test-push-pull');
+    push.send('0');
+    push.send('1');
+    push.send('2');
+  });
+
+  it('should support multipart messages', function(done){
+    var push = zmq.shmSocket('push')
+      , pull = zmq.shmSocket('pull');
+
+    pull.on('message', function (a, b, c) {
+      a.toString().should.equal('foo');
+      b.toString().should.equal('bar');
+      c.length.should.equal(0);
+      push.close();
+      pull.close();
+      done();
+    });
+
+    pull.bindSync('shm://test-multipart');
+    push.connect('shm://test-multipart');
+    push.send('foo', zmq.ZMQ_SNDMORE);
+    push.send(['bar', new Buffer(0)]);
+  });
+
+  it('should queue until the pull socket binds', function(done){
+    var push = zmq.shmSocket('push')
+      , pull = zmq.shmSocket('pull')
+      , sent = false;
+
+    push.connect('shm://test-late-bind');
+    push.send('hello', 0, function (err) {
+      should.not.exist(err);
+      sent = true;
+    });
+
+    setTimeout(function () {
+      sent.should.be.false;
+      pull.on('message', function (msg) {
+        msg.toString().should.equal('hello');
+        sent.should.be.true;
+        push.close();
+        pull.close();
+        done();
+      });
+      pull.bindSync('shm://test-late-bind');
+    }, 10);
+  });
+
+  it('should support pair', function(done){
+    var a = zmq.shmSocket('pair')
+      , b = zmq.shmSocket('pair');
+
+    a.on('message', function (msg) {
+      msg.toString().should.equal('pong');
+      a.close();
+      b.close();
+      done();
+    });
+    b.on('message', function (msg) {
+      msg.toString().should.equal('ping');
+      b.send('pong');
+    });
+
+    a.bindSync('shm://test-pair');
+    b.connect('shm://test-pair');
+    a.send('ping');
+  });
+
+  it('should wait while the ring is full', function(done){
+    var push = zmq.shmSocket('push')
+      , pull = zmq.shmSocket('pull', { capacity: 4096 })
+      , part = new Buffer(1000)
+      , received = 0;
+
+    pull.bindSync('shm://test-full');
+    push.connect('shm://test-full');
+    for (var i = 0; i < 20; i++) push.send(part);
+
+    pull.on('message', function (msg) {
+      msg.length.should.equal(1000);
+      if (++received === 20) {
+        push.close();
+        pull.close();
+        done();
+      }
+    });
+  });
+
+  it('should refuse messages larger than the ring', function(done){
+    var push = zmq.shmSocket('push')
+      , pull = zmq.shmSocket('pull', { capacity: 4096 });
+
+    pull.bindSync('shm://test-too-large');
+    push.connect('shm://test-too-large');
+    push.send(new Buffer(8192), 0, function (err) {
+      err.should.be.an.instanceof(RangeError);
+      push.close();
+      pull.close();
+      done();
+    });
+  });
+
+  it('should fail sends once the ring stayed full for sendTimeout', function(done){
+    var push = zmq.shmSocket('push', { sendTimeout: 50 })
+      , pull = zmq.shmSocket('pull', { capacity: 4096 })
+      , sent = 0
+      , failed = 0;
+
+    pull.bindSync('shm://test-send-timeout');
+    pull.pause();
+    push.connect('shm://test-send-timeout');
+    for (var i = 0; i < 20; i++) {
+      push.send(new Buffer(1000), 0, function (err) {
+        if (err) {
+          err.code.should.equal('ETIMEDOUT');
+          failed++;
+        } else {
+          sent++;
+        }
+        if (sent + failed < 20) return;
+        sent.should.be.above(0);
+        failed.should.be.above(0);
+        push.close();
+        pull.close();
+        done();
+      });
+    }
+  });
+
+  it('should skip a message whose writer died mid-write', function(done){
+    var push = zmq.shmSocket('push')
+      , pull = zmq.shmSocket('pull')
+      , ring = (fs.existsSync('/dev/shm') ? '/dev/shm' : os.tmpdir()) + '/zmq-test-dead-writer.ring'
+      , fixture = path.join(__dirname, 'fixtures', 'shm-dead-writer.js');
+
+    pull.bindSync('shm://test-dead-writer');
+    push.connect('shm://test-dead-writer');
+    pull.on('message', function (msg) {
+      msg.toString().should.equal('after');
+      push.close();
+      pull.close();
+      done();
+    });
+
+    execFile(process.execPath, [fixture, ring], function (err) {
+      if (err) return done(err);
+      push.send('after');
+    });
+  });
+
+  it('should only create push, pull and pair sockets', function(){
+    (function () { zmq.shmSocket('pub'); }).should.throw(/push, pull or pair/);
+    (function () { zmq.shmSocket('push').bind('shm://test-push-bind'); }).should.throw();
+    (function () { zmq.shmSocket('pull').bind('tcp://127.0.0.1:5555'); }).should.throw(/Invalid/);
+  });
+
+
+  it('should move writers over to a restarted reader', function(done){
+    var push = zmq.shmSocket('push')
+      , stale = zmq.shmSocket('pull')
+      , pull = zmq.shmSocket('pull');
+
+    stale.on('message', function () {
+      // the first reader took 'before', the new one must get 'after'
+      stale.removeAllListeners('message');
+      pull.bindSync('shm://test-restart');
+      push.send('after');
+    });
+
+    pull.on('message', function (msg) {
+      msg.toString().should.equal('after');
+      push.close();
+      pull.close();
+      done();
+    });
+
+    stale.bindSync('shm://test-restart');
+    push.connect('shm://test-restart');
+    push.send('before');
+  });
+});
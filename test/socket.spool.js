@@ -0,0 +1,89 @@
+var zmq = require('..')
+  , should = require('should')
+  , fs = require('fs')
+  , os = require('os');
+
+describe('socket.spool', function(){
+  var dir = os.tmpdir() + '/zmq-spool-test-' + process.pid;
+
+  before(function(){
+    fs.mkdirSync(dir);
+  });
+
+  after(function(){
+    fs.readdirSync(dir).forEach(function (name) { fs.unlinkSync(dir + '/' + name); });
+    fs.rmdirSync(dir);
+  });
+
+  it('should spool past the threshold and replay in order', function(done){
+    var push = zmq.socket('push', { spoolThreshold: 2, spoolDir: dir, spoolSegmentSize: 64 })
+      , pull = zmq.socket('pull')
+      , sent = 0
+      , n = 0;
+
+    pull.setsockopt(zmq.ZMQ_RCVHWM, 2);
+    pull.bindSync('inproc://spool-order');
+    push.connect('inproc://spool-order');
+
+    for (var i = 0; i < 20; i++) {
+      push.send(['part', String(i)], 0, function (err) {
+        should.not.exist(err);
+        sent++;
+      });
+    }
+
+    var stats = push.spoolStats();
+    stats.spooled.should.be.above(0);
+    stats.spooledBytes.should.be.above(0);
+    stats.segments.should.be.above(1);
+
+    pull.on('message', function (part, msg) {
+      part.toString().should.equal('part');
+      msg.toString().should.equal(String(n));
+      if (++n < 20) return;
+
+      setImmediate(function () {
+        sent.should.equal(20);
+        push.spoolStats().should.eql({ spooled: 0, spooledBytes: 0, segments: 0 });
+        // a drained segment is kept for reuse, closing removes it
+        fs.readdirSync(dir).length.should.equal(1);
+        push.close();
+        pull.close();
+        fs.readdirSync(dir).length.should.equal(0);
+        done();
+      });
+    });
+  });
+
+  it('should drop spooled messages on closeAsync', function(done){
+    var push = zmq.socket('push', { spoolThreshold: 1, spoolDir: dir })
+      , errors = 0;
+
+    push.bindSync('inproc://spool-drop');
+    for (var i = 0; i < 5; i++) {
+      push.send('lost', 0, function (err) {
+        err.code.should.equal('ECLOSED');
+        errors++;
+      });
+    }
+    push.spoolStats().spooled.should.equal(4);
+
+    push.closeAsync({ timeout: 10 }, function (err, result) {
+      should.not.exist(err);
+      result.dropped.should.equal(5);
+      errors.should.equal(5);
+      fs.readdirSync(dir).length.should.equal(0);
+      done();
+    });
+  });
+
+  it('should stay in memory without a threshold', function(){
+    var push = zmq.socket('push');
+    push.bindSync('inproc://spool-off');
+    push.send('kept');
+    push.spoolStats().should.eql({ spooled: 0, spooledBytes: 0, segments: 0 });
+    (function () { push.spoolThreshold = -1; }).should.throw(RangeError);
+    push.close();
+  });
+
+});
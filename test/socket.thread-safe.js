@@ -0,0 +1,95 @@
+var zmq = require('..')
+  , should = require('should');
+
+describe('socket.thread-safe', function(){
+
+  if (!zmq.ZMQ_CAN_THREADSAFE) {
+    it('should not create draft socket types', function(){
+      (function () { zmq.socket('server'); }).should.throw(/Unknown socket type/);
+    });
+    return;
+  }
+
+  it('should route replies by routing id', function(done){
+    var server = zmq.socket('server')
+      , client = zmq.socket('client');
+
+    server.on('message', function (id, msg) {
+      id.should.be.a.Number;
+      msg.toString().should.equal('ping');
+      server.send([id, 'pong']);
+    });
+
+    client.on('message', function (msg) {
+      msg.toString().should.equal('pong');
+      client.close();
+      server.close();
+      done();
+    });
+
+    server.bindSync('inproc://thread-safe-server');
+    client.connect('inproc://thread-safe-server');
+    client.send('ping');
+  });
+
+  it('should deliver joined groups only', function(done){
+    var radio = zmq.socket('radio')
+      , dish = zmq.socket('dish')
+      , timer;
+
+    dish.on('message', function (group, msg) {
+      group.should.equal('weather');
+      msg.toString().should.equal('sunny');
+      clearInterval(timer);
+      radio.close();
+      dish.close();
+      done();
+    });
+
+    dish.join('weather');
+    dish.bindSync('tcp://127.0.0.1:5527');
+    radio.connect('tcp://127.0.0.1:5527');
+
+    // RADIO drops messages until the DISH is connected
+    timer = setInterval(function () {
+      radio.send(['traffic', 'jammed']);
+      radio.send(['weather', 'sunny']);
+    }, 10);
+  });
+
+  it('should support scatter-gather', function(done){
+    var scatter = zmq.socket('scatter')
+      , gather = zmq.socket('gather')
+      , n = 0;
+
+    gather.on('message', function (msg) {
+      msg.toString().should.equal(String(n));
+      if (++n === 3) {
+        scatter.close();
+        gather.close();
+        done();
+      }
+    });
+
+    gather.bindSync('inproc://thread-safe-gather');
+    scatter.connect('inproc://thread-safe-gather');
+    scatter.send('0');
+    scatter.send('1');
+    scatter.send('2');
+  });
+
+  it('should refuse multipart messages', function(done){
+    var server = zmq.socket('server')
+      , client = zmq.socket('client');
+
+    server.bindSync('inproc://thread-safe-multipart');
+    client.connect('inproc://thread-safe-multipart');
+    client.send(['a', 'b'], 0, function (err) {
+      should.exist(err);
+      client.close();
+      server.close();
+      done();
+    });
+  });
+
+});
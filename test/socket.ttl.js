@@ -0,0 +1,77 @@
+var zmq = require('..')
+  , should = require('should');
+
+describe('socket.ttl', function(){
+  var push, pull;
+
+  beforeEach(function(){
+    push = zmq.socket('push');
+    pull = zmq.socket('pull');
+  });
+
+  afterEach(function(){
+    push.close();
+    pull.close();
+  });
+
+  it('should drop messages that could not be sent in time', function(done){
+    push.send('stale', { ttl: 10 }, function (error) {
+      should.exist(error);
+      error.code.should.equal('ETIMEDOUT');
+      push.expiryStats().expired.should.equal(1);
+      done();
+    });
+  });
+
+  it('should run every expired callback when one throws', function(done){
+    var expired = [];
+
+    push.on('error', function (error) {
+      error.message.should.equal('boom');
+      expired.should.eql(['a', 'b']);
+      done();
+    });
+
+    push.send('a', { ttl: 10 }, function () {
+      expired.push('a');
+      throw new Error('boom');
+    });
+    push.send('b', { ttl: 10 }, function () {
+      expired.push('b');
+    });
+  });
+
+  it('should use the socket ttl by default', function(done){
+    push.ttl = 10;
+    push.send('stale');
+    push.send('kept', { ttl: 0 });
+
+    setTimeout(function () {
+      push.expiryStats().expired.should.equal(1);
+
+      pull.on('message', function (msg) {
+        msg.toString().should.equal('kept');
+        done();
+      });
+
+      pull.bind('inproc://stuff_ttl', function (error) {
+        if (error) throw error;
+        push.connect('inproc://stuff_ttl');
+      });
+    }, 30);
+  });
+
+  it('should deliver messages before they expire', function(done){
+    pull.on('message', function (msg) {
+      msg.toString().should.equal('fresh');
+      push.expiryStats().expired.should.equal(0);
+      done();
+    });
+
+    pull.bind('inproc://stuff_ttlf', function (error) {
+      if (error) throw error;
+      push.connect('inproc://stuff_ttlf');
+      push.send('fresh', { ttl: 1000 });
+    });
+  });
+});
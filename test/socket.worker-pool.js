@@ -0,0 +1,110 @@
+var zmq = require('..')
+  , should = require('should');
+
+describe('socket.worker-pool', function(){
+  var workers;
+  try {
+    workers = require('worker_threads');
+  } catch (err) {
+    return;
+  }
+
+  var script = __dirname + '/fixtures/worker-pool.js';
+
+  it('should spread messages over the workers', function(done){
+    var push = zmq.socket('push')
+      , pull = zmq.socket('pull')
+      , pool = zmq.workerPool(pull, { workers: 2, script: script })
+      , bodies = [];
+
+    pull.bindSync('inproc://worker-pool');
+    push.connect('inproc://worker-pool');
+    for (var i = 0; i < 10; i++) push.send(['k' + i, String(i)]);
+
+    pool.on('message', function (msg) {
+      bodies.push(Number(msg.body));
+      if (bodies.length < 10) return;
+
+      bodies.sort(function (a, b) { return a - b; })
+        .should.eql([0, 1, 2, 3, 4, 5, 6, 7, 8, 9]);
+      var stats = pool.stats();
+      stats.length.should.equal(2);
+      stats[0].dispatched.should.equal(5);
+      stats[1].dispatched.should.equal(5);
+      pool.close(function () {
+        push.close();
+        pull.close();
+        done();
+      });
+    });
+  });
+
+  it('should keep a key on one worker', function(done){
+    var push = zmq.socket('push')
+      , pull = zmq.socket('pull')
+      , pool = zmq.workerPool(pull, { workers: 3, script: script, affinity: 'key' })
+      , threads = {}
+      , n = 0;
+
+    pull.bindSync('inproc://worker-pool-key');
+    push.connect('inproc://worker-pool-key');
+    for (var i = 0; i < 30; i++) push.send(['k' + (i % 4), String(i)]);
+
+    pool.on('message', function (msg) {
+      if (threads[msg.key] !== undefined) {
+        threads[msg.key].should.equal(msg.thread);
+      }
+      threads[msg.key] = msg.thread;
+      if (++n < 30) return;
+      pool.close(function () {
+        push.close();
+        pull.close();
+        done();
+      });
+    });
+  });
+
+  it('should carry on when a handler throws', function(done){
+    var push = zmq.socket('push')
+      , pull = zmq.socket('pull')
+      , pool = zmq.workerPool(pull, { workers: 2, script: script, affinity: 'key', queueBytes: 4096 })
+      , body = new Array(101).join('x')
+      , errors = 0
+      , received = 0;
+
+    pull.bindSync('inproc://worker-pool-throw');
+    push.connect('inproc://worker-pool-throw');
+    // enough for one key to fill its worker's queue and pause the socket
+    push.send(['k0', 'throw']);
+    for (var i = 0; i < 200; i++) push.send(['k0', body]);
+
+    pool.on('error', function (err) {
+      err.message.should.equal('handler failed');
+      errors++;
+      check();
+    });
+    pool.on('message', function () {
+      received++;
+      check();
+    });
+
+    function check() {
+      if (!errors || received + pool.dropped < 201) return;
+      pool.dropped.should.be.above(0);
+      pool.stats().length.should.equal(1);
+      pool.close(function () {
+        push.close();
+        pull.close();
+        done();
+      });
+    }
+  });
+
+  it('should need a script', function(){
+    var pull = zmq.socket('pull');
+    (function () { zmq.workerPool(pull, {}); }).should.throw(/script/);
+    (function () { zmq.workerPool(pull, { script: script, affinity: 'random' }); }).should.throw(/affinity/);
+    pull.close();
+  });
+
+});